@@ -12,16 +12,20 @@ with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <ctype.h>
 #include <stdio.h>
 #include "cue_text_parser.h"
-#define BUFFER_SIZE 4096
+#include "webvtt_buffer.h"
 
 struct item {
   void *_value;
   struct item *_next;
+  webvtt_atom _atom;
 };
 item* new_item(void *in) {
   item *re = (item*)malloc(sizeof(item));
+  if (re == NULL)
+    return NULL;
   re->_value = in;
   re->_next = NULL;
+  re->_atom = WEBVTT_NO_ATOM;
   return re;
 }
 
@@ -30,19 +34,23 @@ struct ordered_list {
 };
 ordered_list* new_ordered_list() {
   ordered_list *ol = (ordered_list*)malloc(sizeof(ordered_list));
+  if (ol == NULL)
+    return NULL;
   ol->start = ol->end = NULL;
   return ol;
 }
-void append_to_list(ordered_list *list, void *in) {
+// -1 when out of memory, in is then still the caller's
+int append_to_list(ordered_list *list, void *in) {
   item *temp = new_item(in);
-  if (temp) {
-    if (list->start == NULL) {
-      list->start = list->end = temp;
-    } else {
-      list->end->_next = temp;
-      list->end = temp;
-    }
+  if (temp == NULL)
+    return -1;
+  if (list->start == NULL) {
+    list->start = list->end = temp;
+  } else {
+    list->end->_next = temp;
+    list->end = temp;
   }
+  return 0;
 }
 
 struct node {
@@ -50,35 +58,184 @@ struct node {
   void *_node;
   struct node* _next;
   struct node* _parent;
-  ordered_list* _applicable_classes;
+  class_set _classes;
+  class_set _effective_classes;
+  // _effective_classes, or an ancestor's when this node adds none
+  const class_set *_effective;
 };
 node* new_node(node_type type) {
   node *new_node = (node*)malloc(sizeof(node));
+  if (new_node == NULL)
+    return NULL;
   new_node->_type = type;
   if (type == text_type)
     new_node->_node = new_text_node();
   else if (type == voice_type)
     new_node->_node = new_voice_node();
+  else if (type == timestamp_type)
+    new_node->_node = new_time_node();
   else
     new_node->_node = NULL;
+  if (new_node->_node == NULL && (type == text_type || type == voice_type ||
+                                  type == timestamp_type)) {
+    free(new_node);
+    return NULL;
+  }
   new_node->_next = NULL;
   new_node->_parent = NULL;
-  new_node->_applicable_classes = NULL;
+  class_set_init(&new_node->_classes);
+  class_set_init(&new_node->_effective_classes);
+  new_node->_effective = &new_node->_effective_classes;
   return new_node;
 }
 
-void append_node(node *target, node *in) {
-  while (target->_next != NULL)
-    target = target->_next;
-  target->_next = in;
+const class_set* node_classes(const node *n) {
+  return &n->_classes;
+}
+
+const class_set* node_effective_classes(const node *n) {
+  return n->_effective;
+}
+
+void class_set_init(class_set *set) {
+  set->bits = 0;
+  set->spill = NULL;
+  set->spill_count = 0;
+  set->extends = NULL;
+}
+
+void class_set_free(class_set *set) {
+  free(set->spill);
+  class_set_init(set);
+}
+
+// room for one more atom past 64, the array doubling as it fills
+static int spill_reserve(class_set *set) {
+  unsigned count = set->spill_count;
+  webvtt_atom *spill;
+  if (count && (count & (count - 1)))
+    return 0;
+  spill = (webvtt_atom*)realloc(set->spill,
+                                (count ? count * 2 : 1) * sizeof(*spill));
+  if (spill == NULL)
+    return -1;
+  set->spill = spill;
+  return 0;
+}
+
+// the first of the set's own atoms past 64 that is above atom
+static unsigned spill_after(const class_set *set, webvtt_atom atom) {
+  unsigned lo = 0, hi = set->spill_count, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (set->spill[mid] <= atom)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int class_set_add(class_set *set, webvtt_atom atom) {
+  unsigned at;
+  if (atom == WEBVTT_NO_ATOM)
+    return -1;
+  if (atom <= 64) {
+    set->bits |= (uint64_t)1 << (atom - 1);
+    return 0;
+  }
+  at = spill_after(set, atom);
+  if (at && set->spill[at - 1] == atom)
+    return 0;
+  if (spill_reserve(set) < 0)
+    return -1;
+  memmove(set->spill + at + 1, set->spill + at,
+          (set->spill_count - at) * sizeof(*set->spill));
+  set->spill[at] = atom;
+  set->spill_count++;
+  return 0;
+}
+
+int class_set_union(class_set *set, const class_set *a, const class_set *b) {
+  class_set result;
+  webvtt_atom atom;
+  class_set_init(&result);
+  result.bits = a->bits | b->bits;
+  // each is listed in ascending order, a's atoms only ever append
+  for (atom = class_set_next(a, 64); atom != WEBVTT_NO_ATOM;
+       atom = class_set_next(a, atom)) {
+    if (class_set_add(&result, atom) < 0)
+      goto fail;
+  }
+  for (atom = class_set_next(b, 64); atom != WEBVTT_NO_ATOM;
+       atom = class_set_next(b, atom)) {
+    if (class_set_add(&result, atom) < 0)
+      goto fail;
+  }
+  class_set_free(set);
+  *set = result;
+  return 0;
+
+fail:
+  class_set_free(&result);
+  return -1;
+}
+
+int class_set_has(const class_set *set, webvtt_atom atom) {
+  unsigned at;
+  if (atom == WEBVTT_NO_ATOM)
+    return 0;
+  if (atom <= 64)
+    return (set->bits >> (atom - 1)) & 1;
+  for (; set != NULL; set = set->extends) {
+    at = spill_after(set, atom);
+    if (at && set->spill[at - 1] == atom)
+      return 1;
+  }
+  return 0;
+}
+
+// every node goes at the end of the _next chain, whose tail is kept
+static void append_node(node **tail, node *in) {
+  (*tail)->_next = in;
+  *tail = in;
+}
+
+// a node without classes of its own shares its parent's effective set,
+// and one with classes extends it rather than copying it, so a deep or
+// wide tree costs no more than the classes actually written
+static int inherit_classes(node *n, const node *parent) {
+  const class_set *from = parent->_effective;
+  class_set *set = &n->_effective_classes;
+  if (n->_classes.bits == 0 && n->_classes.spill_count == 0) {
+    n->_effective = from;
+    return 0;
+  }
+  set->bits = n->_classes.bits | from->bits;
+  if (n->_classes.spill_count) {
+    set->spill = (webvtt_atom*)malloc(n->_classes.spill_count *
+                                      sizeof(*set->spill));
+    if (set->spill == NULL)
+      return -1;
+    memcpy(set->spill, n->_classes.spill,
+           n->_classes.spill_count * sizeof(*set->spill));
+    set->spill_count = n->_classes.spill_count;
+  }
+  // sets that add nothing past 64 are skipped over
+  set->extends = from->spill_count ? from : from->extends;
+  return 0;
 }
 
 struct voice_node {
   char *_voice_name;
+  webvtt_atom _voice;
 };
 voice_node* new_voice_node() {
   voice_node *node = (voice_node*)malloc(sizeof(voice_node));
+  if (node == NULL)
+    return NULL;
   node->_voice_name = NULL;
+  node->_voice = WEBVTT_NO_ATOM;
   return node;
 }
 
@@ -87,6 +244,8 @@ struct lang_node {
 };
 lang_node* new_lang_node() {
   lang_node *node = (lang_node*)malloc(sizeof(lang_node));
+  if (node == NULL)
+    return NULL;
   node->_lang_name = NULL;
   return node;
 }
@@ -96,17 +255,20 @@ struct text_node {
 };
 text_node* new_text_node() {
   text_node *node = (text_node*)malloc(sizeof(text_node));
+  if (node == NULL)
+    return NULL;
   node->_text = NULL;
   return node;
 }
 
-// TODO, this is a dummy atm
 struct time_node {
-  char *_text;
+  int64_t _time;  // milliseconds, as written
 };
 time_node* new_time_node() {
   time_node *node = (time_node*)malloc(sizeof(time_node));
-  node->_text = NULL;
+  if (node == NULL)
+    return NULL;
+  node->_time = 0;
   return node;
 }
 
@@ -116,6 +278,8 @@ struct token {
 };
 token* new_token() {
   token *_token = (token*)malloc(sizeof(token));
+  if (_token == NULL)
+    return NULL;
   _token->_obj = NULL;
   _token->_type = undefined;
   return _token;
@@ -124,9 +288,18 @@ token* new_token() {
 struct string_token {
   char *text;
 };
+// the new_*_token constructors own text and annotation from the call on,
+// they are freed when out of memory and NULL is returned. classes are
+// the caller's until a token is made
 token* new_string_token(char *text) {
   token *ntoken = new_token();
   string_token *_token = (string_token*)malloc(sizeof(string_token));
+  if (ntoken == NULL || _token == NULL) {
+    free(ntoken);
+    free(_token);
+    free(text);
+    return NULL;
+  }
   _token->text = text;
   ntoken->_obj = _token;
   ntoken->_type = string;
@@ -134,21 +307,21 @@ token* new_string_token(char *text) {
 }
 
 tag what_tag(char *text) {
-  if (memcmp("c" ,text, 2) == 0)
+  if (strcmp("c", text) == 0)
     return c_tag;
-  if (memcmp("i" ,text, 2) == 0)
+  if (strcmp("i", text) == 0)
     return i_tag;
-  if (memcmp("b" ,text, 2) == 0)
+  if (strcmp("b", text) == 0)
     return b_tag;
-  if (memcmp("u" ,text, 2) == 0)
+  if (strcmp("u", text) == 0)
     return u_tag;
-  if (memcmp("ruby" ,text, 5) == 0)
+  if (strcmp("ruby", text) == 0)
     return ruby_tag;
-  if (memcmp("rt" ,text, 3) == 0)
+  if (strcmp("rt", text) == 0)
     return rt_tag;
-  if (memcmp("v" ,text, 2) == 0)
+  if (strcmp("v", text) == 0)
     return v_tag;
-  if (memcmp("lang" ,text, 5) == 0)
+  if (strcmp("lang", text) == 0)
     return lang_tag;
   else
     return unknown_tag;
@@ -163,14 +336,19 @@ struct start_token {
 token* new_start_token(char *text, ordered_list *classes, char *annotation) {
   token *ntoken = new_token();
   start_token *_token = (start_token*)malloc(sizeof(start_token));
+  ordered_list *list = classes != NULL ? classes : new_ordered_list();
+  if (ntoken == NULL || _token == NULL || list == NULL) {
+    free(ntoken);
+    free(_token);
+    if (list != classes)
+      free(list);
+    free(text);
+    free(annotation);
+    return NULL;
+  }
   _token->tag_name = text;
   _token->_tag = what_tag(text);
-
-  if (classes != NULL)
-    _token->classes = classes;
-  else
-    _token->classes = new_ordered_list();
-
+  _token->classes = list;
   _token->annotation = annotation;
   ntoken->_obj = _token;
   ntoken->_type = start_tag;
@@ -184,6 +362,12 @@ struct end_token {
 token* new_end_token(char *text) {
   token *ntoken = new_token();
   end_token *_token = (end_token*)malloc(sizeof(end_token));
+  if (ntoken == NULL || _token == NULL) {
+    free(ntoken);
+    free(_token);
+    free(text);
+    return NULL;
+  }
   _token->tag_name = text;
   _token->_tag = what_tag(text);
   ntoken->_obj = _token;
@@ -193,36 +377,95 @@ token* new_end_token(char *text) {
 
 struct timestamp_token {
   char *tag_name;
+  int64_t time;
+  int valid;
 };
 token* new_timestamp_token(char *text) {
   token *ntoken = new_token();
   timestamp_token *_token = (timestamp_token*)malloc(sizeof(timestamp_token));
-  _token->tag_name = (char*)malloc(strlen(text)+1);
-  sprintf(_token->tag_name, "%s", text);
+  unsigned length = strlen(text);
+  if (ntoken == NULL || _token == NULL) {
+    free(ntoken);
+    free(_token);
+    free(text);
+    return NULL;
+  }
+  _token->tag_name = text;
+  // the same parser as the cue timings, the whole tag must be used
+  _token->valid = webvtt_parse_timestamp(text, length, &_token->time) ==
+    (int)length;
   ntoken->_obj = _token;
   ntoken->_type = timestamp_tag;
   return ntoken;
 }
 
-void append_char(char **dest, char c) {
-  char buffer[BUFFER_SIZE];
-  sprintf(buffer, "%s%c", *dest, c);
-  *dest = (char*)malloc(strlen(buffer)+1);
-  sprintf(*dest, "%s", buffer);
+static int add_char(webvtt_buffer *dest, char c) {
+  return webvtt_buffer_append(dest, &c, 1);
+}
+
+static int add_buffer(webvtt_buffer *dest, const webvtt_buffer *source) {
+  return webvtt_buffer_append(dest, source->data, source->length);
 }
 
-void append_string(char **dest, char *source) {
-  char buffer[BUFFER_SIZE];
-  sprintf(buffer, "%s%s", *dest, source);
-  *dest = (char*)malloc(strlen(buffer)+1);
-  sprintf(*dest, "%s", buffer);
+// a NUL terminated copy of what the buffer holds, which is then emptied.
+// NULL when out of memory
+static char* take(webvtt_buffer *source) {
+  char *text = (char*)malloc(source->length + 1);
+  if (text == NULL)
+    return NULL;
+  if (source->length)
+    memcpy(text, source->data, source->length);
+  text[source->length] = '\0';
+  source->length = 0;
+  return text;
 }
 
-int is_empty(char *text) {
+static int holds(const webvtt_buffer *buffer, const char *text) {
+  size_t length = strlen(text);
+  return buffer->length == length && memcmp(buffer->data, text, length) == 0;
+}
+
+static int is_empty(char *text) {
   return strcmp(text, "") == 0;
 }
 
-token* text_tokenizer(char *text, int *i) {
+static void free_list(ordered_list *list) {
+  item *next;
+  for (; list->start != NULL; list->start = next) {
+    next = list->start->_next;
+    free(list->start->_value);
+    free(list->start);
+  }
+  free(list);
+}
+
+static void free_token(token *t) {
+  switch (t->_type) {
+  case string:
+    // the text went to a text node
+    break;
+  case start_tag:
+    free(((start_token*)t->_obj)->tag_name);
+    free_list(((start_token*)t->_obj)->classes);
+    free(((start_token*)t->_obj)->annotation);
+    break;
+  case end_tag:
+    free(((end_token*)t->_obj)->tag_name);
+    break;
+  case timestamp_tag:
+    free(((timestamp_token*)t->_obj)->tag_name);
+    break;
+  default:
+    break;
+  }
+  free(t->_obj);
+  free(t);
+}
+
+// result and buffer are the caller's, kept from one token to the next
+// so a token costs no more than its length. NULL when out of memory
+token* text_tokenizer(char *text, int *i, webvtt_buffer *result,
+                      webvtt_buffer *buffer) {
   enum tokenizer_states {
     data_state, escape_state, tag_state, start_tag_state,
     start_tag_class_state, start_tag_annotation_state, end_tag_state,
@@ -230,79 +473,107 @@ token* text_tokenizer(char *text, int *i) {
   };
 
   enum tokenizer_states token_state = data_state;
-  char *result = "";
-  char *buffer = "";
-  char *tb;
-  int ti = 0;
+  size_t from, to;
   ordered_list *classes = new_ordered_list();
+  token *t;
+  char *taken, *annotation;
   char c = text[*i];
 
+  if (classes == NULL)
+    return NULL;
+  result->length = 0;
+  buffer->length = 0;
   while(1) {
     switch (token_state) {
     case data_state:
       switch (c) {
       case '&':
-        append_char(&buffer,c);
+        buffer->length = 0;
+        if (add_char(buffer, c) < 0)
+          goto fail;
         token_state = escape_state;
         break;
       case '<':
-        if (is_empty(result)) {
+        if (result->length == 0) {
           token_state = tag_state;
         } else {
-          return new_string_token(result);
+          if ((taken = take(result)) == NULL)
+            goto fail;
+          if ((t = new_string_token(taken)) == NULL)
+            goto fail;
+          goto done;
         }
         break;
       case '\0':
-        return new_string_token(result);
-        break;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_string_token(taken)) == NULL)
+          goto fail;
+        goto done;
       default:
-        append_char(&result, c);
+        if (add_char(result, c) < 0)
+          goto fail;
       } // end c switch
       break; // case data_state
     case escape_state:
       switch (c) {
       case '&':
-        append_string(&result, buffer);
-        buffer = "";
-        append_char(&buffer, c);
+        if (add_buffer(result, buffer) < 0)
+          goto fail;
+        buffer->length = 0;
+        if (add_char(buffer, c) < 0)
+          goto fail;
         break;
       case ';':
-        if (strcmp(buffer, "&amp") == 0) {
-          append_char(&result, '&');
+        if (holds(buffer, "&amp")) {
+          if (add_char(result, '&') < 0)
+            goto fail;
         }
-        else if (strcmp(buffer, "&lt") == 0) {
-          append_char(&result, '<');
+        else if (holds(buffer, "&lt")) {
+          if (add_char(result, '<') < 0)
+            goto fail;
         }
-        else if (strcmp(buffer, "&gt") == 0) {
-          append_char(&result, '>');
+        else if (holds(buffer, "&gt")) {
+          if (add_char(result, '>') < 0)
+            goto fail;
         }
-        else if (strcmp(buffer, "&lrm") == 0) {
-          append_char(&result, 'lr');
+        else if (holds(buffer, "&lrm")) {
+          if (add_char(result, 'lr') < 0)
+            goto fail;
         }
-        else if (strcmp(buffer, "&rlm") == 0) {
-          append_char(&result, 'rl');
+        else if (holds(buffer, "&rlm")) {
+          if (add_char(result, 'rl') < 0)
+            goto fail;
         }
-        else if (strcmp(buffer, "&nbsp") == 0) {
-          append_char(&result, ' ');
+        else if (holds(buffer, "&nbsp")) {
+          if (add_char(result, ' ') < 0)
+            goto fail;
         }
         else {
-          append_string(&result, buffer);
-          append_char(&result, ';');
+          if (add_buffer(result, buffer) < 0 || add_char(result, ';') < 0)
+            goto fail;
         }
         token_state = data_state;
         break; // case ;
       case '<':
       case '\0':
-        append_string(&result, buffer);
-        return new_string_token(result);
-        break;
+        if (add_buffer(result, buffer) < 0)
+          goto fail;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_string_token(taken)) == NULL)
+          goto fail;
+        goto done;
       default:
         if (isalnum(c)) {
-          append_char(&buffer, c);
+          if (add_char(buffer, c) < 0)
+            goto fail;
           break;
         }
-        append_string(&result, buffer);
-        append_char(&result, c);
+        if (add_buffer(result, buffer) < 0)
+          goto fail;
+        if (add_char(result, c) < 0)
+          goto fail;
         token_state = data_state;
       } // end c switch
 
@@ -325,11 +596,15 @@ token* text_tokenizer(char *text, int *i) {
       case '>':
         (*i)++;
       case '\0':
-        return new_start_token("", NULL, NULL);
-        break;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_start_token(taken, NULL, NULL)) == NULL)
+          goto fail;
+        goto done;
       default:
-        result = "";
-        append_char(&result, c);
+        result->length = 0;
+        if (add_char(result, c) < 0)
+          goto fail;
         if (isdigit(c)) {
           token_state = timestamp_tag_state;
           break;
@@ -348,8 +623,9 @@ token* text_tokenizer(char *text, int *i) {
         break;
       case '\r':
       case '\n':
-        buffer = "";
-        append_char(&buffer, c);
+        buffer->length = 0;
+        if (add_char(buffer, c) < 0)
+          goto fail;
         token_state = start_tag_annotation_state;
         break;
       case '.':
@@ -358,10 +634,14 @@ token* text_tokenizer(char *text, int *i) {
       case '>':
         (*i)++;
       case '\0':
-        return new_start_token(result, NULL, NULL);
-        break;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_start_token(taken, NULL, NULL)) == NULL)
+          goto fail;
+        goto done;
       default:
-        append_char(&result, c);
+        if (add_char(result, c) < 0)
+          goto fail;
       } // end c switch
       break; // end starTag
     case start_tag_class_state:
@@ -370,29 +650,52 @@ token* text_tokenizer(char *text, int *i) {
       case '\f':
       case ' ':
         // classes append buffer
-        append_to_list(classes, buffer);
-        buffer = "";
+        if ((taken = take(buffer)) == NULL)
+          goto fail;
+        if (append_to_list(classes, taken) < 0) {
+          free(taken);
+          goto fail;
+        }
         token_state = start_tag_annotation_state;
         break;
       case '\r':
       case '\n':
-        append_to_list(classes, buffer);
-        buffer = "";
-        append_char(&buffer, c);
+        if ((taken = take(buffer)) == NULL)
+          goto fail;
+        if (append_to_list(classes, taken) < 0) {
+          free(taken);
+          goto fail;
+        }
+        if (add_char(buffer, c) < 0)
+          goto fail;
         token_state = start_tag_annotation_state;
         break;
       case '.':
-        append_to_list(classes, buffer);
-        buffer = "";
+        if ((taken = take(buffer)) == NULL)
+          goto fail;
+        if (append_to_list(classes, taken) < 0) {
+          free(taken);
+          goto fail;
+        }
         break;
       case '>':
         (*i)++;
       case '\0':
-        append_to_list(classes, buffer);
-        return new_start_token(result, classes, NULL);
-        break;
+        if ((taken = take(buffer)) == NULL)
+          goto fail;
+        if (append_to_list(classes, taken) < 0) {
+          free(taken);
+          goto fail;
+        }
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_start_token(taken, classes, NULL)) == NULL)
+          goto fail;
+        classes = NULL;
+        goto done;
       default:
-        append_char(&buffer, c);
+        if (add_char(buffer, c) < 0)
+          goto fail;
       } // end c switch
       break; // end start_tag_class_state
     case start_tag_annotation_state:
@@ -400,29 +703,29 @@ token* text_tokenizer(char *text, int *i) {
       case '>':
         (*i)++;
       case '\0':
-        // trim leading space
-        ti = 0;
-        while (isspace(buffer[ti])) {
-          ti++;
-        }
-        tb = buffer + ti;
-        // trim trailing space
-        ti = strlen(tb) - 1;
-        if (ti <= 0) { // empty trailing space
-          return new_start_token(result, NULL, NULL);
-        }
-        while (isspace(tb[ti])) {
-          ti--;
+        // trim leading and trailing space
+        for (from = 0; from < buffer->length && isspace(buffer->data[from]);
+             from++)
+          ;
+        for (to = buffer->length; to > from && isspace(buffer->data[to - 1]);
+             to--)
+          ;
+        memmove(buffer->data, buffer->data + from, to - from);
+        buffer->length = to - from;
+        annotation = NULL;
+        if (buffer->length && (annotation = take(buffer)) == NULL)
+          goto fail;
+        if ((taken = take(result)) == NULL) {
+          free(annotation);
+          goto fail;
         }
-        tb[ti+1] = '\0';
-
-        buffer = "";
-        append_string(&buffer, tb);
-
-        return new_start_token(result, classes, buffer);
-        break;
+        if ((t = new_start_token(taken, classes, annotation)) == NULL)
+          goto fail;
+        classes = NULL;
+        goto done;
       default:
-        append_char(&buffer, c);
+        if (add_char(buffer, c) < 0)
+          goto fail;
       } // end c switch
       break; // end start_tag_annotation_state
     case end_tag_state:
@@ -430,10 +733,14 @@ token* text_tokenizer(char *text, int *i) {
       case '>':
         (*i)++;
       case '\0':
-        return new_end_token(result);
-        break;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_end_token(taken)) == NULL)
+          goto fail;
+        goto done;
       default:
-        append_char(&result, c);
+        if (add_char(result, c) < 0)
+          goto fail;
       } // end c switch
       break; // end end_tag_state
     case timestamp_tag_state:
@@ -441,216 +748,515 @@ token* text_tokenizer(char *text, int *i) {
       case '>':
         (*i)++;
       case '\0':
-        return new_timestamp_token(result);
-        break;
+        if ((taken = take(result)) == NULL)
+          goto fail;
+        if ((t = new_timestamp_token(taken)) == NULL)
+          goto fail;
+        goto done;
       default:
-        append_char(&result, c);
+        if (add_char(result, c) < 0)
+          goto fail;
       } // end c switch
       break; // end timestamp_tag_state
     } // end token_state switch
 
     c = text[++(*i)];
   }
+
+fail:
+  t = NULL;
+done:
+  if (classes != NULL)
+    free_list(classes);
+  return t;
+}
+
+static int compare_atoms(const void *a, const void *b) {
+  webvtt_atom x = *(const webvtt_atom*)a, y = *(const webvtt_atom*)b;
+  return x < y ? -1 : x > y;
+}
+
+// intern the classes of a tag into the node's set. those past 64 are
+// sorted once at the end, a tag can have any number of them
+void intern_classes(node *n, ordered_list *classes, webvtt_atoms *atoms) {
+  class_set *set = &n->_classes;
+  item *temp;
+  unsigned i, kept;
+  for (temp = classes->start; temp != NULL; temp = temp->_next) {
+    if (is_empty((char*)temp->_value))
+      continue;
+    temp->_atom = webvtt_atom_intern(atoms, (char*)temp->_value,
+                                     strlen((char*)temp->_value));
+    if (temp->_atom == WEBVTT_NO_ATOM)
+      continue;
+    if (temp->_atom <= 64) {
+      class_set_add(set, temp->_atom);
+    } else if (spill_reserve(set) == 0) {
+      set->spill[set->spill_count++] = temp->_atom;
+    }
+  }
+  if (set->spill_count < 2)
+    return;
+  qsort(set->spill, set->spill_count, sizeof(*set->spill), compare_atoms);
+  for (i = kept = 1; i < set->spill_count; i++) {
+    if (set->spill[i] != set->spill[kept - 1])
+      set->spill[kept++] = set->spill[i];
+  }
+  set->spill_count = kept;
 }
 
-node* attach_to_node(node* current, node_type ntype, ordered_list *classes) {
+// NULL when out of memory. a node that was made is on the chain all
+// the same
+node* attach_to_node(node* current, node **tail, node_type ntype,
+                     ordered_list *classes, webvtt_atoms *atoms) {
   node* n_node = new_node(ntype);
-  n_node->_applicable_classes = classes;
+  if (n_node == NULL)
+    return NULL;
+  intern_classes(n_node, classes, atoms);
   n_node->_parent = current;
-  append_node(current, n_node);
+  append_node(tail, n_node);
+  if (inherit_classes(n_node, current) < 0)
+    return NULL;
   current = n_node;
 
   return current;
 }
 
+static node* close_node(node *current, unsigned *depth) {
+  (*depth)--;
+  return current->_parent;
+}
+
+node* parse_cue_text(char *text, webvtt_atoms *atoms) {
+  webvtt_limits limits;
+  webvtt_limits_init(&limits);
+  return parse_cue_text_limited(text, atoms, &limits);
+}
+
 // 3.3
-node* parse_cue_text(char *text) {
+node* parse_cue_text_limited(char *text, webvtt_atoms *atoms,
+                             const webvtt_limits *limits) {
   int position = 0;
   node *result = new_node(list_type);
   node *current = result;
-  token *_token;
+  node *tail = result;
+  token *_token = NULL;
   node *n_node;
   void *temp_ptr;
+  char *voice;
+  unsigned depth = 0;
+  webvtt_buffer scratch, escape;
+
+  if (result == NULL)
+    return NULL;
+  if (atoms == NULL)
+    atoms = webvtt_atoms_process();
+  webvtt_buffer_init(&scratch);
+  webvtt_buffer_init(&escape);
   // 6
   while (1) {
     if (text[position] == '\0') {
+      webvtt_buffer_free(&scratch);
+      webvtt_buffer_free(&escape);
       return result;
     }
-    _token = text_tokenizer(text, &position);
+    _token = text_tokenizer(text, &position, &scratch, &escape);
+    if (_token == NULL)
+      goto fail;
 
     switch (_token->_type) {
     case string:
       temp_ptr = _token->_obj;
       n_node = new_node(text_type);
+      if (n_node == NULL) {
+        // the text is not freed with the token
+        free(((string_token*)temp_ptr)->text);
+        goto fail;
+      }
       ((text_node*)n_node->_node)->_text = ((string_token*)temp_ptr)->text;
       n_node->_parent = current;
-      append_node(current, n_node);
+      append_node(&tail, n_node);
+      if (inherit_classes(n_node, current) < 0)
+        goto fail;
       break;
     case start_tag:
       temp_ptr = _token->_obj;
+      // past the depth limit a tag is ignored, its text is its parent's
+      if (limits->depth && depth >= limits->depth)
+        break;
+      n_node = current;
       switch (((start_token*)temp_ptr)->_tag) {
       case c_tag:
-        current = attach_to_node(current, class_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, class_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case i_tag:
-        current = attach_to_node(current, italic_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, italic_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case b_tag:
-        current = attach_to_node(current, bold_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, bold_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case u_tag:
-        current = attach_to_node(current, underline_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, underline_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case ruby_tag:
-        current = attach_to_node(current, ruby_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, ruby_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case rt_tag:
-        current = attach_to_node(current, ruby_text_type, ((start_token*)temp_ptr)->classes);
+        current = attach_to_node(current, &tail, ruby_text_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
         break;
       case v_tag:
-        current = attach_to_node(current, voice_type, ((start_token*)temp_ptr)->classes);
-        if (((start_token*)temp_ptr)->annotation)
-          ((voice_node*)current->_node)->_voice_name = ((start_token*)temp_ptr)->annotation;
-        else
-          ((voice_node*)current->_node)->_voice_name = "";
+        current = attach_to_node(current, &tail, voice_type, ((start_token*)temp_ptr)->classes, atoms);
+        if (current == NULL)
+          goto fail;
+        voice = ((start_token*)temp_ptr)->annotation;
+        if (!voice)
+          voice = "";
+        ((voice_node*)current->_node)->_voice = webvtt_atom_intern(atoms, voice, strlen(voice));
+        ((voice_node*)current->_node)->_voice_name =
+          (char*)webvtt_atom_string(atoms, ((voice_node*)current->_node)->_voice, NULL);
         break;
       case lang_tag:
         // not coded
         break;
       }
+      if (current != n_node)
+        depth++;
       break; // end start_tag
     case end_tag:
       temp_ptr = _token->_obj;
       switch (((end_token*)temp_ptr)->_tag) {
       case c_tag:
         if (current->_type == class_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case i_tag:
         if (current->_type == italic_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case b_tag:
         if (current->_type == bold_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case u_tag:
         if (current->_type == underline_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case ruby_tag:
         if (current->_type == ruby_type)
-          current = current->_parent;
-        if (current->_type == ruby_text_type)
-          current = current->_parent->_parent;
+          current = close_node(current, &depth);
+        if (current->_type == ruby_text_type) {
+          current = close_node(current, &depth);
+          // an rt outside of any ruby only closes itself
+          if (current->_type == ruby_type)
+            current = close_node(current, &depth);
+        }
         break;
       case rt_tag:
         if (current->_type == ruby_text_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case v_tag:
         if (current->_type == voice_type)
-          current = current->_parent;
+          current = close_node(current, &depth);
         break;
       case lang_tag:
         if (current->_type == language_type) {
-          current = current->_parent;
+          current = close_node(current, &depth);
           // TODO
         }
         break;
       }
       break; // end end_tag
     case timestamp_tag:
-      // TODO
+      temp_ptr = _token->_obj;
+      if (!((timestamp_token*)temp_ptr)->valid)
+        break;
+      n_node = new_node(timestamp_type);
+      if (n_node == NULL)
+        goto fail;
+      ((time_node*)n_node->_node)->_time = ((timestamp_token*)temp_ptr)->time;
+      n_node->_parent = current;
+      append_node(&tail, n_node);
+      if (inherit_classes(n_node, current) < 0)
+        goto fail;
       break; // end timestamp_tag
     }
+    free_token(_token);
   }
+
+fail:
+  if (_token != NULL)
+    free_token(_token);
+  webvtt_buffer_free(&scratch);
+  webvtt_buffer_free(&escape);
+  free_nodes(result);
+  return NULL;
+}
+
+int karaoke_schedule_build(node *root, const webvtt_timestamp_map *map,
+                           karaoke_schedule *schedule) {
+  unsigned index = 0, capacity = 0;
+  int64_t time;
+  node *n;
+
+  schedule->count = 0;
+  schedule->times = NULL;
+  schedule->nodes = NULL;
+  for (n = root; n != NULL; n = n->_next) {
+    if (n->_type == timestamp_type)
+      capacity++;
+  }
+  if (capacity) {
+    schedule->times = (int64_t*)malloc(capacity * sizeof(int64_t));
+    schedule->nodes = (unsigned*)malloc(capacity * sizeof(unsigned));
+    if (schedule->times == NULL || schedule->nodes == NULL) {
+      karaoke_schedule_free(schedule);
+      return -1;
+    }
+  }
+  for (n = root; n != NULL; n = n->_next, index++) {
+    if (n->_type != timestamp_type)
+      continue;
+    time = webvtt_map_timestamp(map, ((time_node*)n->_node)->_time);
+    if (schedule->count && time <= schedule->times[schedule->count - 1])
+      continue;
+    schedule->times[schedule->count] = time;
+    schedule->nodes[schedule->count] = index;
+    schedule->count++;
+  }
+  schedule->node_count = index;
   return 0;
 }
 
-void print_olist(ordered_list *list) {
-  item *temp = list->start;
-  if (!temp)
-    printf("none\n");
-  while (temp) {
-    printf("%s\n", (char*)temp->_value);
-    temp = temp->_next;
+void karaoke_schedule_free(karaoke_schedule *schedule) {
+  free(schedule->times);
+  free(schedule->nodes);
+  schedule->times = NULL;
+  schedule->nodes = NULL;
+  schedule->count = 0;
+}
+
+static unsigned boundary_of(const karaoke_schedule *schedule, unsigned step) {
+  return step < schedule->count ? schedule->nodes[step] : schedule->node_count;
+}
+
+unsigned karaoke_schedule_boundary(const karaoke_schedule *schedule,
+                                   int64_t t) {
+  unsigned lo = 0, hi = schedule->count, mid;
+  // the number of steps at or before t
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (schedule->times[mid] <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return boundary_of(schedule, lo);
 }
 
-node* print_node(node *current, node *parent, int depth) {
-  if (current->_type == list_type) {
-    printf("<ROOT>\n");
-    current = current->_next;
+void karaoke_cursor_init(karaoke_cursor *cursor,
+                         const karaoke_schedule *schedule) {
+  cursor->schedule = schedule;
+  cursor->step = 0;
+  cursor->t = INT64_MIN;
+}
+
+unsigned karaoke_cursor_seek(karaoke_cursor *cursor, int64_t t) {
+  const karaoke_schedule *schedule = cursor->schedule;
+  if (t < cursor->t) {
+    // seeking back, start over
+    cursor->step = 0;
   }
+  while (cursor->step < schedule->count && schedule->times[cursor->step] <= t)
+    cursor->step++;
+  cursor->t = t;
+  return boundary_of(schedule, cursor->step);
+}
 
-  while(current != NULL) {
-    int i = 0;
-    for (; i != depth; i++)
-      printf(">", depth);
-
-    switch (current->_type) {
-    case text_type:
-      printf("Text node: ");
-      printf("%s\n", ((text_node*)current->_node)->_text);
-      if (current->_next != NULL && current->_next->_parent != current->_parent)
-        return current;
-      break;
-    case class_type:
-      printf("Class node: \n");
-      printf("_Applicable classes: ");
-      print_olist(current->_applicable_classes);
-      printf("_Children: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case italic_type:
-      printf("Italic node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case bold_type:
-      printf("Bold node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case underline_type:
-      printf("Underline node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case ruby_type:
-      printf("Ruby node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case ruby_text_type:
-      printf("Ruby text node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case voice_type:
-      printf("Voice node: \n");
-      printf("Speaker: %s\n", ((voice_node*)current->_node)->_voice_name);
-      current = print_node(current->_next, current, depth+1);
-      break;
-    case language_type:
-      printf("Language node: \n");
-      current = print_node(current->_next, current, depth+1);
-      break;
+webvtt_atom class_set_next(const class_set *set, webvtt_atom after) {
+  webvtt_atom next = WEBVTT_NO_ATOM;
+  unsigned at;
+  uint64_t bits;
+  // bit after is that of atom after + 1, the first candidate
+  if (after < 64) {
+    bits = set->bits >> after;
+    if (bits)
+      return after + __builtin_ctzll(bits) + 1;
+  }
+  // the lowest of what each set in the chain has past after
+  for (; set != NULL; set = set->extends) {
+    at = spill_after(set, after);
+    if (at < set->spill_count &&
+        (next == WEBVTT_NO_ATOM || set->spill[at] < next))
+      next = set->spill[at];
+  }
+  return next;
+}
+
+node_type node_get_type(const node *n) {
+  return n->_type;
+}
+
+const node* node_parent(const node *n) {
+  return n->_parent;
+}
+
+const char* node_text(const node *n) {
+  return n->_type == text_type ? ((text_node*)n->_node)->_text : NULL;
+}
+
+webvtt_atom node_voice(const node *n) {
+  return n->_type == voice_type ? ((voice_node*)n->_node)->_voice : WEBVTT_NO_ATOM;
+}
+
+int64_t node_time(const node *n) {
+  return n->_type == timestamp_type ? ((time_node*)n->_node)->_time : 0;
+}
+
+static int is_leaf(const node *n) {
+  return n->_type == text_type || n->_type == timestamp_type;
+}
+
+int walk_nodes(const node *root, node_visitor *visitor) {
+  const node **stack, **bigger;
+  const node *n;
+  unsigned depth = 0, capacity = 16;
+  int stopped = 0;
+
+  stack = (const node**)malloc(capacity * sizeof(*stack));
+  if (stack == NULL)
+    return -1;
+  stack[depth++] = root;
+  if (visitor->enter && visitor->enter(visitor, root, 0))
+    goto stop;
+  for (n = root->_next; n != NULL; n = n->_next) {
+    // close the elements this node is not inside of
+    while (depth > 1 && stack[depth - 1] != n->_parent) {
+      depth--;
+      if (visitor->leave && visitor->leave(visitor, stack[depth], depth))
+        goto stop;
     }
-    
-    if (current == NULL)
-      return 0;
-    if (depth > 0 && current->_next != NULL && current->_next->_parent != parent)
-      return current;
+    if (visitor->enter && visitor->enter(visitor, n, depth))
+      goto stop;
+    if (is_leaf(n)) {
+      if (visitor->leave && visitor->leave(visitor, n, depth))
+        goto stop;
+      continue;
+    }
+    if (depth == capacity) {
+      bigger = (const node**)realloc(stack, capacity * 2 * sizeof(*stack));
+      if (bigger == NULL) {
+        free(stack);
+        return -1;
+      }
+      stack = bigger;
+      capacity *= 2;
+    }
+    stack[depth++] = n;
+  }
+  while (depth) {
+    depth--;
+    if (visitor->leave && visitor->leave(visitor, stack[depth], depth))
+      goto stop;
+  }
+  free(stack);
+  return 0;
 
-    current = current->_next;
+stop:
+  stopped = 1;
+  free(stack);
+  return stopped;
+}
 
+typedef struct printer printer;
+struct printer {
+  node_visitor base;
+  webvtt_atoms *atoms;
+};
+
+static void print_classes(const class_set *set, webvtt_atoms *atoms) {
+  webvtt_atom atom = class_set_next(set, WEBVTT_NO_ATOM);
+  if (atom == WEBVTT_NO_ATOM)
+    printf(" none");
+  for (; atom != WEBVTT_NO_ATOM; atom = class_set_next(set, atom))
+    printf(" %s", webvtt_atom_string(atoms, atom, NULL));
+  printf("\n");
+}
+
+static int print_enter(node_visitor *visitor, const node *n, unsigned depth) {
+  static const char *names[] = {
+    "Root", "Class", "Italic", "Bold", "Underline", "Ruby", "Ruby text",
+    "Voice", "Language", "Text", "Timestamp"
+  };
+  webvtt_atoms *atoms = ((printer*)visitor)->atoms;
+  unsigned i;
+
+  for (i = 1; i < depth; i++)
+    printf(">");
+  printf("%s node: ", names[n->_type]);
+  switch (n->_type) {
+  case text_type:
+    printf("%s\n", ((text_node*)n->_node)->_text);
+    break;
+  case timestamp_type:
+    printf("%lld\n", (long long)((time_node*)n->_node)->_time);
+    break;
+  case voice_type:
+    printf("%s, classes", ((voice_node*)n->_node)->_voice_name);
+    print_classes(&n->_classes, atoms);
+    break;
+  case list_type:
+    printf("\n");
+    break;
+  default:
+    printf("classes");
+    print_classes(&n->_classes, atoms);
   }
-  printf("<END ROOT>\n");
   return 0;
 }
 
+// every node is on the _next chain of the root, so no walk is needed
+void free_nodes(node *root) {
+  node *next;
+  for (; root != NULL; root = next) {
+    next = root->_next;
+    if (root->_type == text_type)
+      free(((text_node*)root->_node)->_text);
+    free(root->_node);
+    class_set_free(&root->_classes);
+    class_set_free(&root->_effective_classes);
+    free(root);
+  }
+}
+
+void print_node(node *root, webvtt_atoms *atoms) {
+  printer p;
+  p.base.enter = print_enter;
+  p.base.leave = NULL;
+  p.atoms = atoms;
+  walk_nodes(root, &p.base);
+}
+
+#ifdef CUE_TEXT_PARSER_MAIN
 int main() {
   char *temp = "BEGIN: <v testSpeaker>test</v><c.testClass>in<b>c, b <v> c,b,v</v></b> c</c> a test. <i>Italic<b>bold and italic here <u> b,i,u </u></b> continue italic text</i> ha";
-  node *test = parse_cue_text(temp);
+  webvtt_atoms *atoms = webvtt_atoms_new();
+  node *test = parse_cue_text(temp, atoms);
   printf("Input: %s\n\n", temp);
-  print_node(test, NULL, 0);
+  print_node(test, atoms);
 
   return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -1,3 +1,10 @@
+#ifndef _CUE_TEXT_PARSER_H_
+#define _CUE_TEXT_PARSER_H_
+
+#include <stdint.h>
+
+#include "webvtt.h"
+
 typedef struct item item;
 typedef struct ordered_list ordered_list;
 
@@ -54,3 +61,122 @@ enum tag {
   v_tag,
   lang_tag
 };
+
+// a set of class atoms: a bit per atom for the first 64, inline, and
+// the rest in an ascending array that only exists when a class needs
+// it, so a set costs what it holds whatever the atom numbers. a set
+// can extend another, whose atoms past 64 are then its own without
+// being copied: the effective classes of a node extend its parent's
+typedef struct class_set class_set;
+struct class_set {
+  uint64_t bits;              // atoms 1 to 64, the extended set's too
+  webvtt_atom *spill;         // atoms 65 and up, ascending
+  unsigned spill_count;
+  const class_set *extends;   // NULL, or the set extended
+};
+
+void class_set_init(class_set *set);
+void class_set_free(class_set *set);
+// returns -1 when out of memory
+int class_set_add(class_set *set, webvtt_atom atom);
+// set = a | b, returns -1 when out of memory
+int class_set_union(class_set *set, const class_set *a, const class_set *b);
+int class_set_has(const class_set *set, webvtt_atom atom);
+// whether set holds every class of selector, e.g. ::cue(.yellow.big).
+// the selector extends nothing
+static inline int class_set_matches(const class_set *set,
+                                    const class_set *selector) {
+  unsigned i;
+  if ((set->bits & selector->bits) != selector->bits)
+    return 0;
+  for (i = 0; i < selector->spill_count; i++) {
+    if (!class_set_has(set, selector->spill[i]))
+      return 0;
+  }
+  return 1;
+}
+
+// the first atom in set after the given one, WEBVTT_NO_ATOM past the
+// last. start from WEBVTT_NO_ATOM to list a set
+webvtt_atom class_set_next(const class_set *set, webvtt_atom after);
+
+// the classes written on a node's own tag, and those together with
+// the classes of every ancestor, which is what selectors match
+const class_set* node_classes(const node *n);
+const class_set* node_effective_classes(const node *n);
+
+node_type node_get_type(const node *n);
+const node* node_parent(const node *n);
+// the text of a text node, NULL for other nodes
+const char* node_text(const node *n);
+// the speaker of a voice node, WEBVTT_NO_ATOM for other nodes
+webvtt_atom node_voice(const node *n);
+// the time of a timestamp node in milliseconds, 0 for other nodes
+int64_t node_time(const node *n);
+
+// walk a tree in document order without recursion, the open elements
+// are kept on a heap stack so deep nesting cannot overflow the C
+// stack. leaves (text and timestamps) are entered and left at once.
+// depth is 0 for the root. a callback returning non-zero stops the walk
+typedef struct node_visitor node_visitor;
+struct node_visitor {
+  int (*enter)(node_visitor *visitor, const node *n, unsigned depth);
+  int (*leave)(node_visitor *visitor, const node *n, unsigned depth);
+};
+
+// returns 0 when the whole tree was walked, 1 when a callback stopped
+// it and -1 when out of memory
+int walk_nodes(const node *root, node_visitor *visitor);
+
+// dump a tree to stdout, for debugging
+void print_node(node *root, webvtt_atoms *atoms);
+
+// names (voices, classes) are interned in atoms, or in the process
+// table when atoms is NULL. class atoms are set bits, so a table that
+// holds little besides cue text names keeps the sets inline
+node* parse_cue_text(char *text, webvtt_atoms *atoms);
+
+// the same within limits->depth, tags nested deeper being ignored.
+// parse_cue_text takes the default limits. either is linear in the
+// length of the text, and returns NULL when out of memory
+node* parse_cue_text_limited(char *text, webvtt_atoms *atoms,
+                             const webvtt_limits *limits);
+
+// release a tree returned by parse_cue_text
+void free_nodes(node *root);
+
+// karaoke timing of a cue. nodes are numbered in document order, which
+// is the order of the _next chain, the root being 0. from times[i] on,
+// the nodes from nodes[i], a timestamp node, up to the next step have
+// been reached. timestamps that do not increase are dropped
+typedef struct karaoke_schedule karaoke_schedule;
+struct karaoke_schedule {
+  unsigned count;
+  unsigned node_count;
+  int64_t *times;       // increasing, on the clock of the cue times
+  unsigned *nodes;
+};
+
+// map is the one the cue's own times went through, see
+// webvtt_parse_timestamp_map. returns -1 when out of memory
+int karaoke_schedule_build(node *root, const webvtt_timestamp_map *map,
+                           karaoke_schedule *schedule);
+void karaoke_schedule_free(karaoke_schedule *schedule);
+// the first node still in the future at t, node_count when there is
+// none. nodes before it are past or current. a binary search
+unsigned karaoke_schedule_boundary(const karaoke_schedule *schedule,
+                                   int64_t t);
+
+// the same for a playhead that mostly moves forward, O(1) per frame
+typedef struct karaoke_cursor karaoke_cursor;
+struct karaoke_cursor {
+  const karaoke_schedule *schedule;
+  unsigned step;        // steps with times <= the last t
+  int64_t t;
+};
+
+void karaoke_cursor_init(karaoke_cursor *cursor,
+                         const karaoke_schedule *schedule);
+unsigned karaoke_cursor_seek(karaoke_cursor *cursor, int64_t t);
+
+#endif /* _CUE_TEXT_PARSER_H_ */
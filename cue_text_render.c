@@ -0,0 +1,270 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cue_text_render.h"
+
+typedef struct text_renderer text_renderer;
+struct text_renderer {
+  node_visitor base;
+  webvtt_buffer *out;
+};
+
+static int text_enter(node_visitor *visitor, const node *n, unsigned depth) {
+  const char *text = node_text(n);
+  (void)depth;
+  if (text == NULL)
+    return 0;
+  return webvtt_buffer_append(((text_renderer*)visitor)->out, text,
+                              strlen(text)) < 0;
+}
+
+int
+  render_text(const node *root, webvtt_buffer *out)
+{
+  text_renderer r;
+  r.base.enter = text_enter;
+  r.base.leave = NULL;
+  r.out = out;
+  return walk_nodes(root, &r.base) ? -1 : 0;
+}
+
+typedef struct html_renderer html_renderer;
+struct html_renderer {
+  node_visitor base;
+  webvtt_atoms *atoms;
+  webvtt_buffer *out;
+};
+
+static const char *open_tags[] = {
+  "", "<span", "<i", "<b", "<u", "<ruby", "<rt", "<span", "<span", "", ""
+};
+
+static const char *close_tags[] = {
+  "", "</span>", "</i>", "</b>", "</u>", "</ruby>", "</rt>", "</span>",
+  "</span>", "", ""
+};
+
+#define PUT(s) webvtt_buffer_append(out, s, sizeof(s) - 1)
+
+/* text with the characters HTML gives a meaning escaped, in runs */
+static int put_escaped(webvtt_buffer *out, const char *s) {
+  const char *run = s;
+
+  for (;; s++) {
+    switch (*s) {
+    case '\0':
+      return webvtt_buffer_append(out, run, s - run);
+    case '&':
+    case '<':
+    case '>':
+    case '"':
+      if (webvtt_buffer_append(out, run, s - run) < 0)
+        return -1;
+      if ((*s == '&' && PUT("&amp;") < 0) ||
+          (*s == '<' && PUT("&lt;") < 0) ||
+          (*s == '>' && PUT("&gt;") < 0) ||
+          (*s == '"' && PUT("&quot;") < 0))
+        return -1;
+      run = s + 1;
+      break;
+    }
+  }
+}
+
+static char *put_two(char *p, int v) {
+  p[0] = '0' + v / 10;
+  p[1] = '0' + v % 10;
+  return p + 2;
+}
+
+/* hh:mm:ss.ttt, hours grow past two digits when needed */
+static int put_time(webvtt_buffer *out, int64_t ms) {
+  char buffer[32], digits[20], *p = buffer;
+  int64_t hours = ms / 3600000;
+  int n = 0, rest = (int)(ms % 3600000);
+
+  do {
+    digits[n++] = '0' + hours % 10;
+    hours /= 10;
+  } while (hours);
+  if (n < 2)
+    *p++ = '0';
+  while (n)
+    *p++ = digits[--n];
+  *p++ = ':';
+  p = put_two(p, rest / 60000);
+  *p++ = ':';
+  p = put_two(p, rest / 1000 % 60);
+  *p++ = '.';
+  *p++ = '0' + rest % 1000 / 100;
+  p = put_two(p, rest % 100);
+  return webvtt_buffer_append(out, buffer, p - buffer);
+}
+
+static int put_classes(webvtt_buffer *out, webvtt_atoms *atoms,
+                       const class_set *classes) {
+  webvtt_atom atom = class_set_next(classes, WEBVTT_NO_ATOM);
+
+  if (atom == WEBVTT_NO_ATOM)
+    return 0;
+  if (PUT(" class=\"") < 0)
+    return -1;
+  for (; atom != WEBVTT_NO_ATOM; atom = class_set_next(classes, atom)) {
+    if (put_escaped(out, webvtt_atom_string(atoms, atom, NULL)) < 0)
+      return -1;
+    if (class_set_next(classes, atom) != WEBVTT_NO_ATOM && PUT(" ") < 0)
+      return -1;
+  }
+  return PUT("\"");
+}
+
+static int html_enter(node_visitor *visitor, const node *n, unsigned depth) {
+  html_renderer *r = (html_renderer*)visitor;
+  webvtt_buffer *out = r->out;
+  node_type type = node_get_type(n);
+  const char *tag = open_tags[type];
+  (void)depth;
+
+  switch (type) {
+  case list_type:
+    return 0;
+  case text_type:
+    return put_escaped(out, node_text(n)) < 0;
+  case timestamp_type:
+    return PUT("<?timestamp ") < 0 || put_time(out, node_time(n)) < 0 ||
+      PUT("?>") < 0;
+  default:
+    break;
+  }
+  if (webvtt_buffer_append(out, tag, strlen(tag)) < 0 ||
+      put_classes(out, r->atoms, node_classes(n)) < 0)
+    return 1;
+  if (type == voice_type &&
+      (PUT(" title=\"") < 0 ||
+       put_escaped(out, webvtt_atom_string(r->atoms, node_voice(n), NULL)) < 0 ||
+       PUT("\"") < 0))
+    return 1;
+  return PUT(">") < 0;
+}
+
+static int html_leave(node_visitor *visitor, const node *n, unsigned depth) {
+  const char *tag = close_tags[node_get_type(n)];
+  (void)depth;
+  return webvtt_buffer_append(((html_renderer*)visitor)->out, tag,
+                              strlen(tag)) < 0;
+}
+
+int
+  render_html(const node *root, webvtt_atoms *atoms, webvtt_buffer *out)
+{
+  html_renderer r;
+  r.base.enter = html_enter;
+  r.base.leave = html_leave;
+  r.atoms = atoms;
+  r.out = out;
+  return walk_nodes(root, &r.base) ? -1 : 0;
+}
+
+typedef struct run_renderer run_renderer;
+struct run_renderer {
+  node_visitor base;
+  styled_run *runs;
+  unsigned capacity, count;
+  unsigned depth[RUN_RUBY_TEXT + 1];  /* open elements of each style */
+  webvtt_atom *voices;                /* open voices, innermost last */
+  unsigned voice_count, voice_capacity;
+};
+
+static unsigned style_of(node_type type) {
+  switch (type) {
+  case italic_type:
+    return RUN_ITALIC;
+  case bold_type:
+    return RUN_BOLD;
+  case underline_type:
+    return RUN_UNDERLINE;
+  case ruby_text_type:
+    return RUN_RUBY_TEXT;
+  default:
+    return 0;
+  }
+}
+
+static int run_enter(node_visitor *visitor, const node *n, unsigned depth) {
+  run_renderer *r = (run_renderer*)visitor;
+  node_type type = node_get_type(n);
+  styled_run *run;
+  webvtt_atom *voices;
+  unsigned style = 0, bit;
+  (void)depth;
+
+  if (type == voice_type) {
+    if (r->voice_count == r->voice_capacity) {
+      r->voice_capacity = r->voice_capacity ? r->voice_capacity * 2 : 8;
+      voices = (webvtt_atom*)realloc(r->voices, r->voice_capacity *
+                                     sizeof(*voices));
+      if (voices == NULL)
+        return 1;
+      r->voices = voices;
+    }
+    r->voices[r->voice_count++] = node_voice(n);
+    return 0;
+  }
+  if (type != text_type) {
+    r->depth[style_of(type)]++;
+    return 0;
+  }
+
+  if (r->count < r->capacity) {
+    for (bit = RUN_ITALIC; bit <= RUN_RUBY_TEXT; bit <<= 1) {
+      if (r->depth[bit])
+        style |= bit;
+    }
+    run = &r->runs[r->count];
+    run->text = node_text(n);
+    run->length = strlen(run->text);
+    run->style = style;
+    run->voice = r->voice_count ? r->voices[r->voice_count - 1] :
+      WEBVTT_NO_ATOM;
+    run->classes = node_effective_classes(n);
+  }
+  r->count++;
+  return 0;
+}
+
+static int run_leave(node_visitor *visitor, const node *n, unsigned depth) {
+  run_renderer *r = (run_renderer*)visitor;
+  node_type type = node_get_type(n);
+  (void)depth;
+
+  if (type == voice_type)
+    r->voice_count--;
+  else if (type != text_type)
+    r->depth[style_of(type)]--;
+  return 0;
+}
+
+int
+  render_runs(const node *root, styled_run *runs, unsigned capacity)
+{
+  run_renderer r;
+  int result;
+
+  memset(&r, 0, sizeof(r));
+  r.base.enter = run_enter;
+  r.base.leave = run_leave;
+  r.runs = runs;
+  r.capacity = capacity;
+  result = walk_nodes(root, &r.base);
+  free(r.voices);
+  return result ? -1 : (int)r.count;
+}
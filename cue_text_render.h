@@ -0,0 +1,56 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _CUE_TEXT_RENDER_H_
+#define _CUE_TEXT_RENDER_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "cue_text_parser.h"
+#include "webvtt_buffer.h"
+
+  /* single pass renderers over a cue text tree, built on walk_nodes.
+  they return 0, or -1 when out of memory */
+
+  /* the text alone, markup and timestamps dropped */
+  int render_text(const node *root, webvtt_buffer *out);
+
+  /* an HTML fragment following the WebVTT DOM mapping: c and v become
+  span, lang a span with a lang attribute, timestamps processing
+  instructions. class names and speakers are looked up in atoms */
+  int render_html(const node *root, webvtt_atoms *atoms, webvtt_buffer *out);
+
+  enum run_style {
+    RUN_ITALIC = 0x1,
+    RUN_BOLD = 0x2,
+    RUN_UNDERLINE = 0x4,
+    RUN_RUBY_TEXT = 0x8
+  };
+
+  /* a piece of text with the styling in effect over it */
+  typedef struct styled_run styled_run;
+  struct styled_run {
+    const char *text;         /** points into the tree */
+    unsigned length;
+    unsigned style;           /** enum run_style bits */
+    webvtt_atom voice;        /** innermost speaker, WEBVTT_NO_ATOM if none */
+    const class_set *classes; /** effective classes, owned by the tree */
+  };
+
+  /* fill runs with up to capacity runs. returns how many runs the tree
+  has, which may be more than capacity, or -1 when out of memory */
+  int render_runs(const node *root, styled_run *runs, unsigned capacity);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _CUE_TEXT_RENDER_H_ */
@@ -7,9 +7,17 @@
 
  */
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
 
 #include "webvtt.h"
+#include "webvtt_writer.h"
+#include "webvtt_json.h"
+#include "webvtt_stream.h"
+#include "webvtt_inflate.h"
 
 #define FAIL(msg) { \
   fprintf(stderr, "ERROR: " msg "\n"); \
@@ -19,15 +27,77 @@
 int main(int argc, char *argv[])
 {
   webvtt_parser *ctx = webvtt_parse_new();
+  int json = -1;
 
   if (ctx == NULL)
     FAIL("Couldnt' allocate parser context");
 
+  /* --json or --ndjson convert to JSON instead of writing WebVTT */
+  if (argc > 2 && argv[1][0] == '-') {
+    json = strcmp(argv[1], "--ndjson") == 0 ? WEBVTT_JSON_LINES : 0;
+    if (!json && strcmp(argv[1], "--json") != 0)
+      FAIL("Unknown option");
+    argv++;
+    argc--;
+  }
+
   if (argc > 1) {
-    webvtt_cue *cue = webvtt_parse_filename(ctx, argv[1]);
+    size_t length = strlen(argv[1]);
+    webvtt_cue *cue;
+    webvtt_cue *next;
+    webvtt_buffer out;
+    webvtt_stream *stream;
+    int fd;
+    /* subs.srt.gz is still SRT */
+    if (length > 3 && strcasecmp(argv[1] + length - 3, ".gz") == 0)
+      length -= 3;
+    else if (length > 4 && strcasecmp(argv[1] + length - 4, ".zst") == 0)
+      length -= 4;
+    if (length > 4 && strncasecmp(argv[1] + length - 4, ".srt", 4) == 0)
+      webvtt_parse_set_format(ctx, WEBVTT_FORMAT_SRT);
+    /* read and decompress ahead on a second thread while parsing */
+    stream = webvtt_stream_new(ctx);
+    fd = open(argv[1], O_RDONLY);
+    if (stream == NULL || fd < 0 ||
+        webvtt_stream_read_compressed(stream, fd, 1) < 0)
+      FAIL("Couldn't read cues");
+    close(fd);
+    cue = webvtt_stream_take(stream);
+    webvtt_stream_free(stream);
     if (cue == NULL)
       FAIL("No cues returned");
-    free(cue);
+
+    webvtt_buffer_init(&out);
+    if (json >= 0) {
+      webvtt_json writer;
+      webvtt_timestamp_map map = webvtt_parse_timestamp_map(ctx);
+      const webvtt_cue *c;
+      webvtt_cue_view view;
+      int r;
+
+      webvtt_json_init(&writer, &out, STDOUT_FILENO, json | WEBVTT_JSON_DOM,
+                       webvtt_timebase_ms);
+      writer.header = webvtt_parse_header(ctx);
+      writer.map = &map;
+      r = webvtt_json_begin(&writer);
+      for (c = cue; r == 0 && c != NULL; c = c->next) {
+        webvtt_cue_view_of(c, &view);
+        r = webvtt_json_write_view(&writer, &view);
+      }
+      if (r < 0 || webvtt_json_end(&writer) < 0)
+        FAIL("Couldn't write cues");
+      webvtt_json_free(&writer);
+    } else if (webvtt_write_cues(&out, cue, webvtt_timebase_ms,
+                                 webvtt_parse_header(ctx)) < 0 ||
+               webvtt_buffer_flush(&out, STDOUT_FILENO) < 0) {
+      FAIL("Couldn't write cues");
+    }
+    webvtt_buffer_free(&out);
+
+    for (; cue != NULL; cue = next) {
+      next = cue->next;
+      webvtt_cue_free(cue);
+    }
   }
 
   webvtt_parse_free(ctx);
@@ -0,0 +1,362 @@
+/* WebVTT parser
+   Copyright 2012 Mozilla Foundation
+
+   This Source Code Form is subject to the terms of the Mozilla
+   Public License, v. 2.0. If a copy of the MPL was not distributed
+   with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+ */
+
+/* pathological inputs through the whole pipeline, the stream with the
+   default limits and then the cue text parser on every cue. each one
+   is run at 1x, 4x and 16x its size and must take about 4 and 16 times
+   as long, and each runs in a child whose peak RSS must stay under a
+   ceiling, and a case can check what each cue carries. inputs are made
+   as they are fed, so only what the parser holds counts. build and run
+   from the top of the tree:
+
+     cc -O2 -I. stress/stress.c webvtt*.c cue_text_parser.c \
+       cue_text_render.c -pthread -lz -o webvtt-stress && ./webvtt-stress
+
+   exits 1 when any case fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#include "webvtt.h"
+#include "webvtt_atoms.h"
+#include "webvtt_buffer.h"
+#include "webvtt_stream.h"
+#include "webvtt_inflate.h"
+#include "cue_text_parser.h"
+
+/* what is fed to the stream at a time */
+#define PIECE_SIZE (64 * 1024)
+
+/* a 4x larger input may take this much longer than 4x, and anything
+   under FLOOR seconds is noise */
+#define SLACK 3.0
+#define FLOOR 0.02
+
+/* peak RSS of a case in KiB, at all three sizes */
+#define RSS_CEILING (64 * 1024)
+
+/* timings are the best of this many runs */
+#define RUNS 3
+
+typedef struct stress_case stress_case;
+struct stress_case {
+  const char *name;
+  const char *head;           /* the file up to the repeated part */
+  const char *tail;
+  /* append repetition i of n */
+  void (*repeat)(webvtt_buffer *out, unsigned long i, unsigned long n);
+  unsigned long count;        /* repetitions at 1x */
+  enum webvtt_format format;
+  int compressed;             /* read through a gzip file */
+  int regions;                /* every cue must be in a declared region */
+};
+
+static void put(webvtt_buffer *out, const char *s) {
+  if (webvtt_buffer_append(out, s, strlen(s)) < 0)
+    abort();
+}
+
+static void put_run(webvtt_buffer *out, char c, size_t length) {
+  if (webvtt_buffer_reserve(out, length) < 0)
+    abort();
+  memset(out->data + out->length, c, length);
+  out->length += length;
+}
+
+/* 4 KiB more of one line */
+static void long_line(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  put_run(out, 'x', 4096);
+}
+
+/* short lines that never end the block */
+static void long_block(webvtt_buffer *out, unsigned long i,
+                       unsigned long n) {
+  put(out, "a short line\n");
+}
+
+static void tags(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  put(out, i % 64 == 63 ? "<b>x</b>\n" : "<b>x</b>");
+}
+
+/* opened all the way down, then closed all the way up */
+static void nesting(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  put(out, i < n / 2 ? "<i>" : "</i>");
+  if (i % 64 == 63)
+    put(out, "\n");
+}
+
+static void entities(webvtt_buffer *out, unsigned long i,
+                     unsigned long n) {
+  put(out, "&amp;&lt;&gt;&nbsp;&lrm;&bogus;&& x");
+  if (i % 256 == 255) {
+    put(out, "&");
+    put_run(out, 'a', 1000);
+  }
+  if (i % 16 == 15)
+    put(out, "\n");
+}
+
+/* every class a new name */
+static void classes(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  char name[32];
+  unsigned k;
+
+  put(out, "<c");
+  for (k = 0; k < 8; k++) {
+    snprintf(name, sizeof(name), ".k%lu", i * 8 + k);
+    put(out, name);
+  }
+  put(out, i % 8 == 7 ? ">x</c>\n" : ">x</c>");
+}
+
+static void cues(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  char cue[96];
+
+  snprintf(cue, sizeof(cue), "%02lu:%02lu.%03lu --> %02lu:%02lu.%03lu\n"
+           "cue <b>%lu</b>\n\n", i / 60000 % 60, i / 1000 % 60, i % 1000,
+           i / 60000 % 60, i / 1000 % 60, i % 1000, i);
+  put(out, cue);
+}
+
+/* SubRip text is escaped, every < grows to four bytes */
+static void srt_brackets(webvtt_buffer *out, unsigned long i,
+                         unsigned long n) {
+  char counter[32];
+
+  snprintf(counter, sizeof(counter), "%lu\n", i + 1);
+  put(out, counter);
+  put(out, "00:00:01,000 --> 00:00:02,000\n");
+  put_run(out, '<', 256);
+  put(out, "\n\n");
+}
+
+/* an id far longer than the other settings, declared in the head */
+#define LONG_ID "a-region-id-that-runs-on-and-on-and-on-and-on-and-on-" \
+  "and-on-and-on-and-on-and-on-and-on-and-on-and-on-and-on-and-on-and-on"
+
+static void regions(webvtt_buffer *out, unsigned long i, unsigned long n) {
+  char cue[64];
+
+  snprintf(cue, sizeof(cue), "%02lu:%02lu.%03lu --> 59:00.000 region:",
+           i / 60000 % 60, i / 1000 % 60, i % 1000);
+  put(out, cue);
+  put(out, LONG_ID "\nx\n\n");
+}
+
+static const stress_case cases[] = {
+  { "megabyte line", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    long_line, 256, WEBVTT_FORMAT_VTT, 0 },
+  { "megabyte block", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "",
+    long_block, 80000, WEBVTT_FORMAT_VTT, 0 },
+  { "100k tags", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    tags, 6250, WEBVTT_FORMAT_VTT, 0 },
+  { "deep nesting", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    nesting, 8192, WEBVTT_FORMAT_VTT, 0 },
+  { "entity flood", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    entities, 1024, WEBVTT_FORMAT_VTT, 0 },
+  { "distinct classes", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    classes, 1024, WEBVTT_FORMAT_VTT, 0 },
+  { "many cues", "WEBVTT\n\n", "", cues, 25000, WEBVTT_FORMAT_VTT, 0 },
+  { "SubRip brackets", "", "", srt_brackets, 2000, WEBVTT_FORMAT_SRT, 0 },
+  { "gzip line", "WEBVTT\n\n00:00.000 --> 00:01.000\n", "\n",
+    long_line, 1024, WEBVTT_FORMAT_VTT, 1 },
+  { "long region ids", "WEBVTT\n\nREGION\nid:" LONG_ID "\n\n", "",
+    regions, 10000, WEBVTT_FORMAT_VTT, 0, 1 },
+};
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* parse the text of every cue parsed so far, then free them */
+static unsigned long drain(const stress_case *c, webvtt_stream *stream,
+                           webvtt_parser *ctx) {
+  webvtt_cue *cue = webvtt_stream_take(stream), *next;
+  webvtt_atoms *atoms = webvtt_atoms_new();
+  webvtt_cue_view view;
+  unsigned long count = 0;
+  node *root;
+
+  if (atoms == NULL)
+    abort();
+  for (; cue != NULL; cue = next) {
+    next = cue->next;
+    webvtt_cue_view_of(cue, &view);
+    if (c->regions && view.region == 0) {
+      printf("  %s: a cue lost its region\n", c->name);
+      exit(1);
+    }
+    root = parse_cue_text_limited(cue->text, atoms,
+                                  webvtt_parse_limits(ctx));
+    if (root == NULL)
+      abort();
+    free_nodes(root);
+    webvtt_cue_free(cue);
+    count++;
+  }
+  webvtt_atoms_free(atoms);
+  return count;
+}
+
+/* the whole file written out once, to be read back at each run */
+static int compress_case(const stress_case *c, unsigned long n) {
+  char path[] = "/tmp/webvtt-stress-XXXXXX";
+  webvtt_buffer piece;
+  unsigned long i;
+  gzFile gz;
+  int fd = mkstemp(path);
+
+  if (fd < 0)
+    return -1;
+  unlink(path);
+  gz = gzdopen(dup(fd), "wb1");
+  if (gz == NULL)
+    abort();
+  webvtt_buffer_init(&piece);
+  put(&piece, c->head);
+  for (i = 0; i < n; i++) {
+    c->repeat(&piece, i, n);
+    if (piece.length >= PIECE_SIZE) {
+      gzwrite(gz, piece.data, piece.length);
+      piece.length = 0;
+    }
+  }
+  put(&piece, c->tail);
+  gzwrite(gz, piece.data, piece.length);
+  webvtt_buffer_free(&piece);
+  if (gzclose(gz) != Z_OK)
+    abort();
+  return fd;
+}
+
+/* one run at n repetitions, returning the cues seen */
+static unsigned long run(const stress_case *c, unsigned long n, int fd) {
+  webvtt_parser *ctx = webvtt_parse_new();
+  webvtt_stream *stream;
+  webvtt_buffer piece;
+  unsigned long i, count = 0;
+
+  if (ctx == NULL)
+    abort();
+  webvtt_parse_set_format(ctx, c->format);
+  stream = webvtt_stream_new(ctx);
+  if (stream == NULL)
+    abort();
+  if (fd >= 0) {
+    if (lseek(fd, 0, SEEK_SET) < 0 ||
+        webvtt_stream_read_compressed(stream, fd, 0) < 0)
+      abort();
+  } else {
+    webvtt_buffer_init(&piece);
+    put(&piece, c->head);
+    for (i = 0; i < n; i++) {
+      c->repeat(&piece, i, n);
+      if (piece.length >= PIECE_SIZE) {
+        if (webvtt_stream_feed(stream, piece.data, piece.length) < 0)
+          abort();
+        piece.length = 0;
+        count += drain(c, stream, ctx);
+      }
+    }
+    put(&piece, c->tail);
+    if (webvtt_stream_feed(stream, piece.data, piece.length) < 0 ||
+        webvtt_stream_finish(stream) < 0)
+      abort();
+    webvtt_buffer_free(&piece);
+  }
+  count += drain(c, stream, ctx);
+  webvtt_stream_free(stream);
+  webvtt_parse_free(ctx);
+  return count;
+}
+
+/* the three sizes of a case. returns 0 when they scale linearly; a
+   size that does not is the last one tried, the next would take longer
+   still */
+static int time_case(const stress_case *c) {
+  static const unsigned scales[3] = { 1, 4, 16 };
+  double best[3] = { 0, 0, 0 }, t;
+  unsigned long n, count = 0;
+  unsigned s, k;
+  int fd = -1, failed = 0;
+
+  for (s = 0; s < 3 && !failed; s++) {
+    n = c->count * scales[s];
+    if (c->compressed && (fd = compress_case(c, n)) < 0)
+      abort();
+    for (k = 0; k < RUNS; k++) {
+      t = now();
+      count = run(c, n, fd);
+      t = now() - t;
+      if (k == 0 || t < best[s])
+        best[s] = t;
+    }
+    if (fd >= 0)
+      close(fd);
+    if (count == 0) {
+      printf("  %s: no cues at %ux\n", c->name, scales[s]);
+      failed = 1;
+    }
+    if (s > 0 && best[s] > best[s - 1] * 4 * SLACK + FLOOR) {
+      printf("  %s: %ux took %.3f s after %.3f s at %ux\n", c->name,
+             scales[s], best[s], best[s - 1], scales[s - 1]);
+      failed = 1;
+    }
+  }
+  printf("%-18s %8.3f %8.3f %8.3f s", c->name, best[0], best[1], best[2]);
+  fflush(stdout);
+  return failed;
+}
+
+int main(void) {
+  unsigned i, failures = 0;
+  struct rusage usage;
+  pid_t pid;
+  int status;
+
+  printf("%-18s %8s %8s %8s   peak RSS\n", "case", "1x", "4x", "16x");
+  fflush(stdout);
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      /* the parser reports what it finds on stderr */
+      if (freopen("/dev/null", "w", stderr) == NULL)
+        _exit(2);
+      _exit(time_case(cases + i));
+    }
+    if (wait4(pid, &status, 0, &usage) < 0) {
+      perror("wait4");
+      return 1;
+    }
+    printf(" %8ld KiB\n", usage.ru_maxrss);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("  %s: failed\n", cases[i].name);
+      failures++;
+    } else if (usage.ru_maxrss > RSS_CEILING) {
+      printf("  %s: peak RSS over %d KiB\n", cases[i].name, RSS_CEILING);
+      failures++;
+    }
+    fflush(stdout);
+  }
+  printf(failures ? "%u cases failed\n" : "all cases passed\n", failures);
+  return failures != 0;
+}
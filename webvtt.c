@@ -7,15 +7,22 @@ with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 */
 
+#include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "webvtt.h"
+#include "webvtt_buffer.h"
+#include "webvtt_utf8.h"
 
 #define BUFFER_SIZE 4096
 #define DEBUG 1
 #define DEFAULT 20
+/* keeps every timestamp well inside int64_t milliseconds */
+#define MAX_HOURS 2000000000
 
 #ifndef MIN
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -37,8 +44,11 @@ with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
 }
 #endif
 
+/* a block parse survives malformed input, anywhere else it is fatal */
 #if DEBUG
 #define ERROR(msg) { \
+  if (ctx->recover) \
+    longjmp(*ctx->recover, 1); \
   fprintf(stderr, "ERROR: " msg "\n"); \
   exit(-1); \
 }
@@ -48,6 +58,14 @@ struct webvtt_parser {
   int state;
   char *buffer;
   unsigned offset, length;
+  unsigned capacity;    /** of buffer, at least BUFFER_SIZE */
+  jmp_buf *recover;     /** set while parsing a block */
+  webvtt_timestamp_map map;  /** timebase and X-TIMESTAMP-MAP */
+  webvtt_atoms *atoms;  /** where ids and settings go, may be NULL */
+  webvtt_header *header;  /** STYLE and REGION blocks seen so far */
+  enum webvtt_format format;
+  webvtt_limits limits;  /** what one file may make it keep */
+  webvtt_buffer text;   /** cue text being put together */
 };
 
 webvtt_parser *
@@ -63,58 +81,235 @@ webvtt_parser *
     }
     ctx->offset = 0;
     ctx->length = 0;
+    ctx->capacity = BUFFER_SIZE;
+    ctx->recover = NULL;
+    webvtt_timestamp_map_init(&ctx->map, webvtt_timebase_ms);
+    ctx->atoms = NULL;
+    ctx->header = NULL;
+    ctx->format = WEBVTT_FORMAT_VTT;
+    webvtt_limits_init(&ctx->limits);
+    webvtt_buffer_init(&ctx->text);
   }
   return ctx;
 }
 
+int
+  webvtt_parse_set_timebase(webvtt_parser *ctx, webvtt_timebase timebase)
+{
+  if (timebase.num == 0 || timebase.den == 0)
+    return -1;
+  ctx->map.timebase = timebase;
+  return 0;
+}
+
+void
+  webvtt_parse_set_atoms(webvtt_parser *ctx, webvtt_atoms *atoms)
+{
+  ctx->atoms = atoms;
+}
+
+void
+  webvtt_parse_set_format(webvtt_parser *ctx, enum webvtt_format format)
+{
+  ctx->format = format;
+}
+
+void
+  webvtt_limits_init(webvtt_limits *limits)
+{
+  limits->line_length = 64 * 1024;
+  limits->cue_text = 1024 * 1024;
+  limits->depth = 256;
+  limits->cues = 0;
+}
+
+void
+  webvtt_parse_set_limits(webvtt_parser *ctx, const webvtt_limits *limits)
+{
+  ctx->limits = *limits;
+}
+
+const webvtt_limits *
+  webvtt_parse_limits(const webvtt_parser *ctx)
+{
+  return &ctx->limits;
+}
+
+webvtt_header *
+  webvtt_parse_take_header(webvtt_parser *ctx)
+{
+  webvtt_header *header = ctx->header;
+  ctx->header = NULL;
+  return header;
+}
+
+const webvtt_header *
+  webvtt_parse_header(const webvtt_parser *ctx)
+{
+  return ctx->header;
+}
+
+/* floor((value * mul + div / 2) / div), rounding to the nearest tick */
+static int64_t mul_div_round(int64_t value, uint64_t mul, uint64_t div) {
+#if defined(__SIZEOF_INT128__)
+  __int128 n = (__int128)value * mul + div / 2;
+  __int128 q = n / (__int128)div;
+  if (n % (__int128)div < 0)
+    q--;
+  return (int64_t)q;
+#else
+  long double n = (long double)value * mul + div / 2;
+  long double q = n / div;
+  int64_t r = (int64_t)q;
+  if (r > q)
+    r--;
+  return r;
+#endif
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* a tick count in one timebase is the same duration as
+value * from.num * to.den / (from.den * to.num) ticks in another. a
+timebase with a zero in it is no timebase, values are left alone */
+static void rescale_ratio(webvtt_timebase from, webvtt_timebase to,
+                          uint64_t *mul, uint64_t *div) {
+  uint64_t g;
+  *mul = (uint64_t)from.num * to.den;
+  *div = (uint64_t)from.den * to.num;
+  if (*mul == 0 || *div == 0) {
+    *mul = *div = 1;
+    return;
+  }
+  g = gcd(*mul, *div);
+  *mul /= g;
+  *div /= g;
+}
+
+int64_t
+  webvtt_rescale(int64_t value, webvtt_timebase from, webvtt_timebase to)
+{
+  uint64_t mul, div;
+  rescale_ratio(from, to, &mul, &div);
+  if (div == 1 && mul == 1)
+    return value;
+  return mul_div_round(value, mul, div);
+}
+
+void
+  webvtt_rescale_cues(webvtt_cue *head, webvtt_timebase from,
+                      webvtt_timebase to)
+{
+  webvtt_cue *cue;
+  uint64_t mul, div;
+
+  rescale_ratio(from, to, &mul, &div);
+  if (mul == 1 && div == 1)
+    return;
+  if (div == 1) {
+    /* ms to 90 kHz and friends, exact */
+    for (cue = head; cue != NULL; cue = cue->next) {
+      cue->start *= (int64_t)mul;
+      cue->end *= (int64_t)mul;
+    }
+    return;
+  }
+  for (cue = head; cue != NULL; cue = cue->next) {
+    cue->start = mul_div_round(cue->start, mul, div);
+    cue->end = mul_div_round(cue->end, mul, div);
+  }
+}
+
+void
+  webvtt_timestamp_map_init(webvtt_timestamp_map *map,
+                            webvtt_timebase timebase)
+{
+  map->timebase = timebase;
+  map->local = 0;
+  map->mpegts = 0;
+}
+
+int64_t
+  webvtt_map_timestamp(const webvtt_timestamp_map *map, int64_t ms)
+{
+  return webvtt_rescale(ms - map->local, webvtt_timebase_ms, map->timebase)
+    + map->mpegts;
+}
+
+webvtt_timestamp_map
+  webvtt_parse_timestamp_map(const webvtt_parser *ctx)
+{
+  return ctx->map;
+}
+
+/* a cue timestamp, in milliseconds of the file's local clock, in ticks
+of the output timebase with the X-TIMESTAMP-MAP offset applied */
+static int64_t local_to_ticks(webvtt_parser *ctx, int64_t ms) {
+  return webvtt_map_timestamp(&ctx->map, ms);
+}
+
+void
+  webvtt_parse_reset(webvtt_parser *ctx)
+{
+  ctx->state = Initial;
+  ctx->offset = 0;
+  ctx->length = 0;
+  webvtt_timestamp_map_init(&ctx->map, ctx->map.timebase);
+  webvtt_header_free(ctx->header);
+  ctx->header = NULL;
+}
+
 void
   webvtt_parse_free(webvtt_parser *ctx)
 {
   if (ctx) {
-    ctx->state = 0;
-    if (ctx->buffer) {
-      free(ctx->buffer);
-      ctx->buffer = NULL;
-    }
-    ctx->offset = 0;
-    ctx->length = 0;
+    webvtt_header_free(ctx->header);
+    webvtt_buffer_free(&ctx->text);
+    free(ctx->buffer);
+    free(ctx);
   }
 }
 
-int
-  webvtt_print_cue(FILE *out, webvtt_cue *cue)
+void
+  webvtt_cue_view_of(const webvtt_cue *cue, webvtt_cue_view *view)
 {
-  int err;
-  int h, m, s, ms;
-  long time;
+  view->start = cue->start;
+  view->end = cue->end;
+  view->text = cue->text ? cue->text : "";
+  view->text_length = strlen(view->text);
+  view->cueID = cue->cueID;
+  view->cueID_length = cue->cueID ? strlen(cue->cueID) : 0;
+  view->settings = cue->settings;
+  view->settings_length = cue->settings ? strlen(cue->settings) : 0;
+  view->pauseOnExit = cue->pauseOnExit;
+  view->snapToLine = cue->snapToLine;
+  view->lineAuto = cue->lineAuto;
+  view->vertical = (enum webvtt_vertical)cue->vertical;
+  view->align = (enum webvtt_align)cue->align;
+  view->line = cue->line;
+  view->position = cue->position;
+  view->size = cue->size;
+  view->region = cue->region;
+}
 
-  if (out == NULL || cue == NULL)
-    return -1;
-  if (cue->cueID != NULL)
-    err = fprintf(out, "%s", cue->cueID);
-  if (cue->settings != NULL)
-    err = fprintf(out, "%s", cue->settings);
-  time = cue->start;
-  h = time/3600000;
-  time %= 3600000;
-  m = time/60000;
-  time %= 60000;
-  s = time/1000;
-  ms = time%1000;
-  err = fprintf(out, "%02d:%02d:%02d.%03d", h, m, s, ms);
-
-  time = cue->end;
-  h = time/3600000;
-  time %= 3600000;
-  m = time/60000;
-  time %= 60000;
-  s = time/1000;
-  ms = time%1000;
-  err = fprintf(out, " --> %02d:%02d:%02d.%03d\n", h, m, s, ms);
-
-  err = fprintf(out, "%s\n", cue->text);
-
-  return err;
+void
+  webvtt_cue_free(webvtt_cue *cue)
+{
+  if (cue) {
+    free(cue->text);
+    if (!cue->interned) {
+      free(cue->cueID);
+      free(cue->settings);
+    }
+    free(cue);
+  }
 }
 
 int has_file_identifier(webvtt_parser *ctx) {
@@ -155,27 +350,52 @@ int move_to_next_line(webvtt_parser *ctx) {
       return 0;
     }
   }
+  // end of input ends the line too
+  return 1;
+}
+
+/* where the current line ends, before its terminator */
+static unsigned line_end(webvtt_parser *ctx) {
+  unsigned end = ctx->offset;
+  while (end < ctx->length && !isNewline(ctx->buffer[end]))
+    end++;
+  return end;
+}
+
+/* get_line, going through the parser's atom table when it has one */
+static char *get_shared_line(webvtt_parser *ctx, webvtt_cue *cue) {
+  char *line = get_line(ctx);
+  webvtt_atom atom;
+  const char *shared;
+
+  if (ctx->atoms == NULL || line == NULL)
+    return line;
+  atom = webvtt_atom_intern(ctx->atoms, line, strlen(line));
+  if (atom == WEBVTT_NO_ATOM) {
+    FAIL("Couldn't intern cue string\n");
+  }
+  shared = webvtt_atom_string(ctx->atoms, atom, NULL);
+  free(line);
+  cue->interned = 1;
+  return (char*)shared;
 }
 
 int get_cue_id(webvtt_parser *ctx, webvtt_cue *cue) {
   char *p = ctx->buffer;
-  unsigned originalOffSet = ctx->offset;
-  while (!move_to_next_line(ctx) && ctx->offset < ctx->length) {
-    if (!memcmp(p + ctx->offset, "-->", 3)) {
-      ctx->offset = originalOffSet;
+  unsigned end = line_end(ctx), i;
+  for (i = ctx->offset; i + 3 <= end; i++) {
+    if (!memcmp(p + i, "-->", 3))
       return TimingsAndSettings;
-    }
-    ctx->offset++;
   }
-  ctx->offset = originalOffSet;
-  cue->cueID = get_line(ctx);
+  cue->cueID = get_shared_line(ctx, cue);
   return TimingsAndSettings;
 }
 
 int get_timing_and_settings(webvtt_parser *ctx, webvtt_cue *cue) {
   char *p = ctx->buffer;
+  unsigned end, i;
 
-  double start_time = collect_timestamp(ctx);
+  int64_t start_time = collect_timestamp(ctx);
 
   if (!isASpace(p[ctx->offset])) {
     ERROR("Need a space after timestamp");
@@ -195,124 +415,182 @@ int get_timing_and_settings(webvtt_parser *ctx, webvtt_cue *cue) {
   while (isASpace(p[ctx->offset]))
     ctx->offset++;
 
-  double end_time = collect_timestamp(ctx);
+  int64_t end_time = collect_timestamp(ctx);
 
   if (start_time > end_time) {
     ERROR("Start time cannot be > end time");
   }
 
-  while (!move_to_next_line(ctx)) {
-    ctx->offset++;
-    if (isalpha(*(p + ctx->offset))) {
-      cue->settings = get_line(ctx);
-      parse_settings(cue->settings, cue);
-      break;
-    }
+  // settings start at the first letter after the end time
+  end = line_end(ctx);
+  for (i = ctx->offset + 1; i < end && !isalpha(p[i]); i++)
+    ;
+  if (i < end) {
+    ctx->offset = i;
+    cue->settings = get_shared_line(ctx, cue);
+    parse_settings(ctx, cue->settings, cue);
+  } else {
+    ctx->offset = end;
+    move_to_next_line(ctx);
   }
-  cue->start = start_time * 1e3;
-  cue->end = end_time * 1e3;
+  cue->start = local_to_ticks(ctx, start_time);
+  cue->end = local_to_ticks(ctx, end_time);
   return CueText;
 }
 
-char* get_number(char *text, unsigned *position) {
-  char *num = (char*)malloc(DEFAULT);
-  int i = 0;
-  while (is_a_number(text[*position])) {
-    num[i++] = text[*position];
-    (*position)++;
+/* accumulate a run of digits, returns how many there were. values
+that would overflow are clamped, the callers range check them anyway */
+int collect_digits(webvtt_parser *ctx, int64_t *value) {
+  char *p = ctx->buffer;
+  int digits = 0;
+  *value = 0;
+  while (ctx->offset < ctx->length && is_a_number(p[ctx->offset])) {
+    if (*value < INT64_MAX / 10)
+      *value = *value * 10 + (p[ctx->offset] - '0');
+    ctx->offset++;
+    digits++;
   }
-  num[i] = '\0';
-  return num;
+  return digits;
 }
 
-double collect_timestamp(webvtt_parser *ctx) {
-  if (move_to_next_line(ctx)) {
-    ERROR("Couldn't parse cue timestamps");
+/* a run of digits at s, at most max of them are looked at */
+static int scan_digits(const char *s, unsigned max, int64_t *value) {
+  unsigned n = 0;
+  *value = 0;
+  while (n < max && is_a_number(s[n])) {
+    if (*value < INT64_MAX / 10)
+      *value = *value * 10 + (s[n] - '0');
+    n++;
   }
-  enum Mode { minutes, hours };
-  enum Mode mode = minutes;
-  char *num1, *num2, *num3, *num4;
-  int number1, number2, number3, number4;
-  unsigned i = 0;
-  char *p = ctx->buffer;
+  return n;
+}
 
-  while (isASpace(p[ctx->offset]))
-    ctx->offset++;
+int
+  webvtt_parse_timestamp(const char *s, unsigned length, int64_t *ms)
+{
+  return webvtt_parse_timestamp_sep(s, length, '.', ms);
+}
 
-  if (!is_a_number(p[ctx->offset])) {
-    ERROR("Parse cue timestamps: Not a number");
-  } else {
-    num1 = get_number(p, &ctx->offset);
-    sscanf(num1, "%d", &number1);
-  }
-  if (number1 > 59 || strlen(num1) < 2) {
-    mode = hours;
-  }
-  if (p[ctx->offset] != ':') {
-    ERROR("Parse cue timestamps: Expected ':'");
-  }
-  else {
-    ctx->offset++;
-  }
-  if (!is_a_number(p[ctx->offset])) {
-    ERROR("Parse cue timestamps: Not a number after':'");
-  } else {
-    num2 = get_number(p, &ctx->offset);
-    if (strlen(num2) < 2) {
-      ERROR("Parse cue timestamps: Minute digit < 2");
-    }
-    sscanf(num2, "%d", &number2);
-  }
+int
+  webvtt_parse_timestamp_sep(const char *s, unsigned length, char separator,
+                             int64_t *ms)
+{
+  int64_t number1, number2, number3, number4;
+  unsigned at = 0;
+  int digits, hours;
+
+  digits = scan_digits(s, length, &number1);
+  if (!digits)
+    return -1;
+  // more than two digits or more than 59 can only be hours
+  hours = digits != 2 || number1 > 59;
+  at += digits;
+  if (at >= length || s[at] != ':')
+    return -1;
+  at++;
+  digits = scan_digits(s + at, length - at, &number2);
+  if (digits != 2)
+    return -1;
+  at += digits;
   //12.1
-  if (mode == hours || (!move_to_next_line(ctx) && p[ctx->offset] == ':')) {
-    if (move_to_next_line(ctx) || p[ctx->offset] != ':') {
-      ERROR("Parse cue timestamps: No minute");
-    } else {
-      ctx->offset++;
-    }
-    if (!is_a_number(p[ctx->offset])) {
-      ERROR("Parse cue timestamps: Not a number after second ':'");
-    } else {
-      num3 = get_number(p, &ctx->offset);
-      if (strlen(num3) != 2) {
-        ERROR("Parse cue timestamps: Minute digit != 2");
-      }
-      sscanf(num3, "%d", &number3);
-    }
+  if (hours || (at < length && s[at] == ':')) {
+    if (at >= length || s[at] != ':')
+      return -1;
+    at++;
+    digits = scan_digits(s + at, length - at, &number3);
+    if (digits != 2)
+      return -1;
+    at += digits;
   } else {
     number3 = number2;
     number2 = number1;
     number1 = 0;
   }
   //13
-  if (p[ctx->offset] != '.') {
-    ERROR("Parse cue timestamps: No millisecond");
-  } else {
+  if (at >= length || s[at] != separator)
+    return -1;
+  at++;
+  //14
+  digits = scan_digits(s + at, length - at, &number4);
+  if (digits != 3)
+    return -1;
+  at += digits;
+  //17
+  if (number2 > 59 || number3 > 59 || number1 > MAX_HOURS)
+    return -1;
+
+  *ms = ((number1 * 60 + number2) * 60 + number3) * 1000 + number4;
+  return at;
+}
+
+int64_t collect_timestamp(webvtt_parser *ctx) {
+  char *p = ctx->buffer;
+  int64_t ms;
+  int used;
+
+  if (move_to_next_line(ctx)) {
+    ERROR("Couldn't parse cue timestamps");
+  }
+  while (isASpace(p[ctx->offset]))
     ctx->offset++;
+
+  used = webvtt_parse_timestamp(p + ctx->offset, ctx->length - ctx->offset,
+                                &ms);
+  if (used < 0) {
+    ERROR("Parse cue timestamps: Not a valid timestamp");
   }
-  //14
-  if (!is_a_number(p[ctx->offset])) {
-    ERROR("Parse cue timestamps: Not a number at millisecond");
-  } else {
-    num4 = get_number(p, &ctx->offset);
-    if (strlen(num4) != 3) {
-      ERROR("Parse cue timestamps: Millisecond digit != 3");
+  ctx->offset += used;
+  return ms;
+}
+
+/* X-TIMESTAMP-MAP=MPEGTS:<90 kHz ticks>,LOCAL:<timestamp>, as used by
+HLS. cue times are mapped so that LOCAL lands on MPEGTS */
+void collect_timestamp_map(webvtt_parser *ctx) {
+  char *p = ctx->buffer;
+  int64_t local = 0, mpegts = 0;
+
+  while (ctx->offset < ctx->length) {
+    if (ctx->length - ctx->offset > 7 &&
+        !memcmp(p + ctx->offset, "MPEGTS:", 7)) {
+      ctx->offset += 7;
+      if (!collect_digits(ctx, &mpegts)) {
+        ERROR("X-TIMESTAMP-MAP: MPEGTS is not a number");
+      }
+    } else if (ctx->length - ctx->offset > 6 &&
+               !memcmp(p + ctx->offset, "LOCAL:", 6)) {
+      ctx->offset += 6;
+      local = collect_timestamp(ctx);
+    } else {
+      break;
     }
-    sscanf(num4, "%d", &number4);
-  }
-  //17
-  if (number2 > 59 || number3 > 59) {
-    ERROR("Parse cue timestamps: Minute or second is bigger than 59");
+    if (p[ctx->offset] != ',')
+      break;
+    ctx->offset++;
   }
 
-  return number1*60*60 + number2*60 + number3 + (double)number4/1000;
+  ctx->map.local = local;
+  ctx->map.mpegts = webvtt_rescale(mpegts, webvtt_timebase_90khz,
+                                   ctx->map.timebase);
 }
 
-char* get_word(char *text, int *position) {
-  char setting[DEFAULT];
+/* one line of the header block, anything we don't know is skipped */
+void parse_header_line(webvtt_parser *ctx) {
+  char *p = ctx->buffer;
+
+  if (ctx->length - ctx->offset > 16 &&
+      !memcmp(p + ctx->offset, "X-TIMESTAMP-MAP=", 16)) {
+    ctx->offset += 16;
+    collect_timestamp_map(ctx);
+  }
+  ctx->offset = line_end(ctx);
+  move_to_next_line(ctx);
+}
+
+char* get_word(char *text, int *position, char *setting) {
   int i = 0;
   while (!isspace(text[*position]) && text[*position] != '\0') {
-    setting[i++] = text[*position];
+    if (i < DEFAULT - 1)
+      setting[i++] = text[*position];
     (*position)++;
   }
   setting[i] = '\0';
@@ -341,13 +619,15 @@ int is_empty(char *text) {
   return 1;
 }
 
-void parse_settings(char *settings, webvtt_cue *cue) {
-  int position = 0, i = 0, i2 = 0, num = 0;
-  char *setting;
+void parse_settings(webvtt_parser *ctx, char *settings, webvtt_cue *cue) {
+  int position = 0, start = 0, i = 0, i2 = 0, num = 0;
+  char setting[DEFAULT];
   char setting_name[DEFAULT];
-  char *setting_value = (char*)malloc(DEFAULT);
+  char setting_value[DEFAULT];
+  const char *id;
   while (!isNewline(settings[position])) {
-    setting = get_word(settings, &position);
+    start = position;
+    get_word(settings, &position, setting);
 
     if (setting[0] == ':' || setting[0] == '\0')
       continue;
@@ -386,8 +666,10 @@ void parse_settings(char *settings, webvtt_cue *cue) {
         ERROR("Invalid vertical name?");
         continue;
       }
-      if (strcmp(setting_value, "rl") == 0 || strcmp(setting_value, "lr") == 0)
-        cue->vertical = setting_value;
+      if (strcmp(setting_value, "rl") == 0)
+        cue->vertical = WEBVTT_VERTICAL_RL;
+      else if (strcmp(setting_value, "lr") == 0)
+        cue->vertical = WEBVTT_VERTICAL_LR;
       else {
         ERROR("Invalid verticle setting");
         continue;
@@ -398,17 +680,20 @@ void parse_settings(char *settings, webvtt_cue *cue) {
         ERROR("Invalid setting name");
         continue;
       }
-      // I hope there is a better way
-      if (strcmp(setting_value, "start") != 0 &&
-        strcmp(setting_value, "middle") != 0 &&
-        strcmp(setting_value, "end") != 0 &&
-        strcmp(setting_value, "left") != 0 &&
-        strcmp(setting_value, "right") != 0) {
-          ERROR("Invalid align value");
-          continue;
+      if (strcmp(setting_value, "start") == 0)
+        cue->align = WEBVTT_ALIGN_START;
+      else if (strcmp(setting_value, "middle") == 0)
+        cue->align = WEBVTT_ALIGN_MIDDLE;
+      else if (strcmp(setting_value, "end") == 0)
+        cue->align = WEBVTT_ALIGN_END;
+      else if (strcmp(setting_value, "left") == 0)
+        cue->align = WEBVTT_ALIGN_LEFT;
+      else if (strcmp(setting_value, "right") == 0)
+        cue->align = WEBVTT_ALIGN_RIGHT;
+      else {
+        ERROR("Invalid align value");
+        continue;
       }
-
-      cue->align = setting_value;
       break;
     case 'l':
       if (strcmp(setting_name, "line") != 0) {
@@ -444,8 +729,13 @@ void parse_settings(char *settings, webvtt_cue *cue) {
       if (setting_value[i-1] == '%' && (num < 0 || num > 100)) {
         ERROR("Invalid line value: Invalid percentage");
         continue;
+      } else if (num < -32768 || num > 32767) {
+        ERROR("Invalid line value: Out of range");
+        continue;
       } else {
         cue->line = num;
+        cue->snapToLine = setting_value[i-1] != '%';
+        cue->lineAuto = 0;
       }
       break;
     case 'p':
@@ -516,20 +806,46 @@ void parse_settings(char *settings, webvtt_cue *cue) {
         cue->size = num;
       }
 
+      break;
+    case 'r':
+      if (strcmp(setting_name, "region") != 0) {
+        ERROR("Invalid region name?");
+        continue;
+      }
+      // a region nobody declared is ignored. the id is taken from the
+      // line, as it can be longer than setting_value holds
+      if (ctx->header) {
+        id = settings + start + strlen("region:");
+        for (i = 0; id[i] != '\0' && !isspace(id[i]); i++)
+          ;
+        num = webvtt_header_find_region(ctx->header, id, i);
+        if (num >= 0)
+          cue->region = num + 1;
+      }
       break;
     default:
       ERROR("Unknown setting name");
     }
-    setting_value = (char*)malloc(DEFAULT);
   }
 }
 
+/* the rest of the current line without its trailing spaces and line
+terminator, which are consumed. past the line length limit the line
+is cut, on a character boundary */
 char* get_line(webvtt_parser *ctx) {
   char *p = ctx->buffer + ctx->offset;
-  while (ctx->offset < ctx->length && !move_to_next_line(ctx))
-    ctx->offset++;
-  char *e = ctx->buffer + ctx->offset;
-  char *text = (char*)malloc(e - p);
+  unsigned end = line_end(ctx);
+  char *e = ctx->buffer + end;
+  ctx->offset = end;
+  move_to_next_line(ctx);
+  while (e > p && isASpace(e[-1]))
+    e--;
+  if (ctx->limits.line_length && e - p > ctx->limits.line_length) {
+    e = p + ctx->limits.line_length;
+    while (e > p && (*e & 0xc0) == 0x80)
+      e--;
+  }
+  char *text = (char*)malloc(e - p + 1);
   if (text == NULL) {
     FAIL("Couldn't allocate cue text buffer\n");
   }
@@ -538,33 +854,96 @@ char* get_line(webvtt_parser *ctx) {
   return text;
 }
 
+/* whether a line of length more fits the cue text limit after text */
+static int text_fits(webvtt_parser *ctx, const webvtt_buffer *text,
+                     size_t more) {
+  return ctx->limits.cue_text == 0 ||
+    text->length + more <= ctx->limits.cue_text;
+}
+
 int get_cue_text(webvtt_parser *ctx, webvtt_cue *cue) {
-  cue->text = get_line(ctx);
-
-  // multiple line support
-  if (!move_to_next_line(ctx)) {
-    char buffer[BUFFER_SIZE];
-    sprintf(buffer, "%s", cue->text);
-    while (!move_to_next_line(ctx)) {
-      sprintf(buffer, "%s %s", buffer, get_line(ctx));
+  webvtt_buffer *text = &ctx->text;
+  char *line;
+  size_t line_length;
+  int lines = 0, full = 0;
+
+  // multiple line support, lines stay separated by '\n'. once a line
+  // does not fit the limit, it and the ones after it are dropped
+  text->length = 0;
+  do {
+    line = get_line(ctx);
+    line_length = strlen(line);
+    full = full || !text_fits(ctx, text, (lines > 0) + line_length);
+    if (!full && ((lines++ && webvtt_buffer_append(text, "\n", 1) < 0) ||
+                  webvtt_buffer_append(text, line, line_length) < 0)) {
+      FAIL("Couldn't allocate cue text buffer\n");
     }
-    char *ret = (char*)malloc(strlen(buffer)+1);
-    sprintf(ret, "%s", buffer);
-    cue->text = ret;
+    free(line);
+  } while (!move_to_next_line(ctx));
+  cue->text = (char*)malloc(text->length + 1);
+  if (cue->text == NULL) {
+    FAIL("Couldn't allocate cue text buffer\n");
   }
+  if (text->length)
+    memcpy(cue->text, text->data, text->length);
+  cue->text[text->length] = '\0';
 
   return NextCue;
 }
 
-char* append_char(char *text, char c) {
-  char buffer[BUFFER_SIZE];
-  sprintf(buffer, "%s", text);
-  int len = strlen(buffer)+1;
-  buffer[len] = c;
-  buffer[len + 1] = c;
-  char *ret = (char*)malloc(strlen(buffer)+1);
-  sprintf(ret, "%s", buffer);
-  return ret;
+/* whether the line at the current offset is just the keyword */
+static int is_block_keyword(webvtt_parser *ctx, const char *keyword) {
+  char *p = ctx->buffer + ctx->offset;
+  unsigned n = strlen(keyword), i;
+
+  if (ctx->length - ctx->offset < n || memcmp(p, keyword, n) != 0)
+    return 0;
+  for (i = ctx->offset + n; i < ctx->length && isASpace(ctx->buffer[i]); i++)
+    ;
+  return i == ctx->length || isNewline(ctx->buffer[i]);
+}
+
+/* a STYLE or REGION block, which can only come before the first cue.
+returns 1 when one was consumed */
+static int parse_header_block(webvtt_parser *ctx) {
+  webvtt_buffer block;
+  char *line;
+  int style, r;
+
+  if (is_block_keyword(ctx, "STYLE"))
+    style = 1;
+  else if (is_block_keyword(ctx, "REGION"))
+    style = 0;
+  else
+    return 0;
+  free(get_line(ctx));
+
+  if (ctx->header == NULL) {
+    ctx->header = webvtt_header_new(ctx->atoms);
+    if (ctx->header == NULL) {
+      FAIL("Couldn't allocate header\n");
+    }
+  }
+  webvtt_buffer_init(&block);
+  while (ctx->offset < ctx->length && !move_to_next_line(ctx)) {
+    line = get_line(ctx);
+    if ((block.length && webvtt_buffer_append(&block, "\n", 1) < 0) ||
+        webvtt_buffer_append(&block, line, strlen(line)) < 0) {
+      FAIL("Couldn't allocate header block\n");
+    }
+    free(line);
+  }
+  if (style)
+    r = webvtt_header_add_style(ctx->header, block.data ? block.data : "",
+                                block.length);
+  else
+    r = webvtt_header_add_region(ctx->header, block.data ? block.data : "",
+                                 block.length);
+  webvtt_buffer_free(&block);
+  if (r < 0) {
+    FAIL("Couldn't store header block\n");
+  }
+  return 1;
 }
 
 int ignore_bad_cue(webvtt_parser *ctx) {
@@ -579,19 +958,216 @@ webvtt_cue* new_cue() {
   if (cue == NULL) {
     FAIL("Couldn't allocate cue structure\n");
   }
+  cue->start = 0;
+  cue->end = 0;
+  cue->next = NULL;
   cue->cueID = NULL;
   cue->pauseOnExit = 0;
-  cue->vertical = NULL; //horizontal
+  cue->vertical = WEBVTT_HORIZONTAL;
   cue->snapToLine = 1;
-  cue->line = 0; //?
+  cue->lineAuto = 1;
+  cue->interned = 0;
+  cue->region = 0;
+  cue->line = 0;
   cue->position = 50;
   cue->size = 100;
-  cue->align = "middle";
+  cue->align = WEBVTT_ALIGN_MIDDLE;
   cue->text = NULL;
   cue->settings = NULL;
   return cue;
 }
 
+/* the timing line of a SubRip block. anything after the end time, like
+the X1: Y1: box some files carry, is ignored. returns -1 if malformed */
+static int srt_timings(webvtt_parser *ctx, webvtt_cue *cue) {
+  char *p = ctx->buffer;
+  unsigned end = line_end(ctx);
+  int64_t start_time, end_time;
+  int used;
+
+  while (isASpace(p[ctx->offset]))
+    ctx->offset++;
+  used = webvtt_parse_timestamp_sep(p + ctx->offset, end - ctx->offset, ',',
+                                    &start_time);
+  if (used < 0)
+    return -1;
+  ctx->offset += used;
+  while (isASpace(p[ctx->offset]))
+    ctx->offset++;
+  if (end - ctx->offset < 3 || memcmp(p + ctx->offset, "-->", 3) != 0)
+    return -1;
+  ctx->offset += 3;
+  while (isASpace(p[ctx->offset]))
+    ctx->offset++;
+  used = webvtt_parse_timestamp_sep(p + ctx->offset, end - ctx->offset, ',',
+                                    &end_time);
+  if (used < 0 || start_time > end_time)
+    return -1;
+
+  ctx->offset = end;
+  move_to_next_line(ctx);
+  cue->start = local_to_ticks(ctx, start_time);
+  cue->end = local_to_ticks(ctx, end_time);
+  return 0;
+}
+
+/* the color of a font tag as a class name: quotes and '#' dropped,
+lower case */
+static void srt_font_class(webvtt_buffer *text, const char *tag,
+                           unsigned length) {
+  const char *color = NULL;
+  unsigned i;
+
+  for (i = 4; i + 6 <= length; i++) {
+    if (!strncasecmp(tag + i, "color=", 6)) {
+      color = tag + i + 6;
+      break;
+    }
+  }
+  if (webvtt_buffer_append(text, "<c", 2) < 0) {
+    FAIL("Couldn't allocate cue text buffer\n");
+  }
+  if (color) {
+    if (webvtt_buffer_append(text, ".color-", 7) < 0) {
+      FAIL("Couldn't allocate cue text buffer\n");
+    }
+    for (; color < tag + length && (*color == '"' || *color == '\'' ||
+                                    *color == '#'); color++)
+      ;
+    for (; color < tag + length && isalnum((unsigned char)*color); color++) {
+      char c = tolower((unsigned char)*color);
+      if (webvtt_buffer_append(text, &c, 1) < 0) {
+        FAIL("Couldn't allocate cue text buffer\n");
+      }
+    }
+  }
+  if (webvtt_buffer_append(text, ">", 1) < 0) {
+    FAIL("Couldn't allocate cue text buffer\n");
+  }
+}
+
+/* one line of SubRip text as WebVTT cue text. the tags SubRip shares
+with cue text are kept, font becomes a class span, anything else in
+angle brackets goes. & < and > that are not markup are escaped */
+static void srt_text_line(webvtt_buffer *text, const char *line) {
+  const char *s, *close = line;
+  char tag[4], c;
+  unsigned length, n;
+  int r = 0;
+
+  for (s = line; *s && r == 0; s++) {
+    if (*s == '&') {
+      r = webvtt_buffer_append(text, "&amp;", 5);
+    } else if (*s == '>') {
+      r = webvtt_buffer_append(text, "&gt;", 4);
+    } else if (*s != '<') {
+      r = webvtt_buffer_append(text, s, 1);
+    } else if ((close != NULL && close <= s &&
+                (close = strchr(s, '>')) == NULL) || close == NULL) {
+      /* no '>' is left, which is only looked for once */
+      r = webvtt_buffer_append(text, "&lt;", 4);
+    } else {
+      length = close - s - 1;
+      c = tolower((unsigned char)s[length]);
+      if ((length == 1 || (length == 2 && s[1] == '/')) &&
+          (c == 'i' || c == 'b' || c == 'u')) {
+        n = 0;
+        tag[n++] = '<';
+        if (length == 2)
+          tag[n++] = '/';
+        tag[n++] = c;
+        tag[n++] = '>';
+        r = webvtt_buffer_append(text, tag, n);
+      } else if (length >= 4 && !strncasecmp(s + 1, "font", 4) &&
+                 (length == 4 || isspace((unsigned char)s[5]))) {
+        srt_font_class(text, s + 1, length);
+      } else if (length == 5 && !strncasecmp(s + 1, "/font", 5)) {
+        r = webvtt_buffer_append(text, "</c>", 4);
+      }
+      s = close;
+    }
+  }
+  if (r < 0) {
+    FAIL("Couldn't allocate cue text buffer\n");
+  }
+}
+
+/* text lines up to the blank line ending the block, as many as fit
+the cue text limit */
+static void srt_text(webvtt_parser *ctx, webvtt_cue *cue) {
+  webvtt_buffer *text = &ctx->text;
+  char *line;
+  size_t length;
+  int full = 0;
+
+  text->length = 0;
+  while (ctx->offset < ctx->length && !move_to_next_line(ctx)) {
+    line = get_line(ctx);
+    length = text->length;
+    if (!full && text->length && webvtt_buffer_append(text, "\n", 1) < 0) {
+      FAIL("Couldn't allocate cue text buffer\n");
+    }
+    if (!full)
+      srt_text_line(text, line);
+    if (!full && !text_fits(ctx, text, 0)) {
+      text->length = length;
+      full = 1;
+    }
+    free(line);
+  }
+  cue->text = (char*)malloc(text->length + 1);
+  if (cue->text == NULL) {
+    FAIL("Couldn't allocate cue text buffer\n");
+  }
+  if (text->length)
+    memcpy(cue->text, text->data, text->length);
+  cue->text[text->length] = '\0';
+}
+
+/* SubRip: blocks of a counter line, a timing line and text, separated
+by blank lines. the counter becomes the cue id. blocks without a valid
+timing line are skipped */
+static webvtt_cue *parse_srt(webvtt_parser *ctx) {
+  webvtt_cue *head = NULL, *current = NULL, *cue;
+  char *p = ctx->buffer;
+  unsigned end, i, count = 0;
+
+  if (ctx->offset == 0 && ctx->length >= 3 && p[0] == (char)0xef &&
+      p[1] == (char)0xbb && p[2] == (char)0xbf)
+    ctx->offset = 3;
+
+  while (ctx->offset < ctx->length) {
+    if (move_to_next_line(ctx))
+      continue;
+    cue = new_cue();
+    end = line_end(ctx);
+    for (i = ctx->offset; i + 3 <= end && memcmp(p + i, "-->", 3); i++)
+      ;
+    if (i + 3 > end) {
+      cue->cueID = get_shared_line(ctx, cue);
+      if (move_to_next_line(ctx)) {
+        webvtt_cue_free(cue);
+        continue;
+      }
+    }
+    if (srt_timings(ctx, cue) < 0) {
+      webvtt_cue_free(cue);
+      while (ctx->offset < ctx->length && !move_to_next_line(ctx))
+        free(get_line(ctx));
+      continue;
+    }
+    srt_text(ctx, cue);
+    if (head == NULL)
+      head = cue;
+    else
+      current->next = cue;
+    current = cue;
+    if (++count == ctx->limits.cues)
+      break;
+  }
+  return head;
+}
+
 webvtt_cue *
   webvtt_parse(webvtt_parser *ctx)
 {
@@ -599,6 +1175,10 @@ webvtt_cue *
   webvtt_cue *head = NULL;
   webvtt_cue *current = NULL;
   char *p = ctx->buffer;
+  unsigned count = 0;
+
+  if (ctx->format == WEBVTT_FORMAT_SRT)
+    return parse_srt(ctx);
   while (ctx->offset < ctx->length) {
     switch (ctx->state) {
     case Initial:
@@ -608,16 +1188,17 @@ webvtt_cue *
       ctx->state = Header;
       break;
     case Header:
-      if (move_to_next_line(ctx))
+      if (move_to_next_line(ctx)) {
         ctx->state = Id;
-
-      // this is for the first cue
-      cue = new_cue();
-
+      } else {
+        parse_header_line(ctx);
+      }
       break;
     case Id:
       if (move_to_next_line(ctx))
         break;
+      if (!head && parse_header_block(ctx))
+        break;
 
       cue = new_cue();
 
@@ -640,6 +1221,8 @@ webvtt_cue *
       cue->next = NULL;
       break;
     case NextCue:
+      if (++count == ctx->limits.cues)
+        ctx->offset = ctx->length;
       if (!head)
         current = head = cue;
       else if(head->next == NULL) {
@@ -658,24 +1241,167 @@ webvtt_cue *
       FAIL("Something is seriously wrong");
     }
   }
-  if (current != cue) {
-    current->next = cue;
+  // input ended right after the last cue text
+  if (ctx->state == NextCue) {
+    if (!head)
+      head = cue;
+    else
+      current->next = cue;
     current = cue;
   }
-  while (head != NULL) {
-    webvtt_print_cue(stderr, head);
-    head = head->next;
+  return head;
+}
+
+unsigned
+  webvtt_next_block(const char *s, unsigned length, unsigned *start)
+{
+  unsigned i = *start, line, end;
+
+  /* blank lines, spaces and tabs only, come before the block */
+  for (;;) {
+    line = i;
+    while (i < length && isASpace(s[i]))
+      i++;
+    if (i == length) {
+      *start = length;
+      return length;
+    }
+    if (!isNewline(s[i]))
+      break;
+    i += (s[i] == '\r' && i + 1 < length && s[i + 1] == '\n') ? 2 : 1;
+  }
+  *start = line;
+  /* then lines up to the next blank one or the end */
+  for (;;) {
+    while (i < length && !isNewline(s[i]))
+      i++;
+    end = i;
+    if (i == length)
+      return end;
+    i += (s[i] == '\r' && i + 1 < length && s[i + 1] == '\n') ? 2 : 1;
+    while (i < length && isASpace(s[i]))
+      i++;
+    if (i == length || isNewline(s[i]))
+      return end;
+  }
+}
+
+/* WEBVTT at the start of the first block, after an optional byte order
+mark, and then nothing or a space before the end of the line */
+static int block_signature(webvtt_parser *ctx) {
+  char *p = ctx->buffer;
+
+  if (ctx->length >= 3 && p[0] == (char)0xef && p[1] == (char)0xbb &&
+      p[2] == (char)0xbf)
+    ctx->offset = 3;
+  if (ctx->length - ctx->offset < 6 || memcmp(p + ctx->offset, "WEBVTT", 6))
+    return 0;
+  ctx->offset += 6;
+  return ctx->offset == ctx->length || isASpace(p[ctx->offset]) ||
+    isNewline(p[ctx->offset]);
+}
+
+int
+  webvtt_parse_block(webvtt_parser *ctx, const char *block, unsigned length,
+                     webvtt_cue **cue)
+{
+  jmp_buf recover;
+  webvtt_cue *volatile parsed = NULL;
+  char *bigger;
+  int r = 0;
+
+  *cue = NULL;
+  /* a few zero bytes past the end, the scanners look ahead */
+  if (length + 4 > ctx->capacity) {
+    bigger = (char*)realloc(ctx->buffer, length + 4);
+    if (bigger == NULL)
+      return -1;
+    ctx->buffer = bigger;
+    ctx->capacity = length + 4;
+  }
+  memcpy(ctx->buffer, block, length);
+  memset(ctx->buffer + length, 0, 4);
+  ctx->offset = 0;
+  ctx->length = length;
+
+  /* SubRip has no header, and its parser never gives up on a file */
+  if (ctx->format == WEBVTT_FORMAT_SRT) {
+    *cue = parse_srt(ctx);
+    return 0;
+  }
+
+  ctx->recover = &recover;
+  if (setjmp(recover) == 0) {
+    switch (ctx->state) {
+    case Initial:
+      if (!block_signature(ctx)) {
+        r = -1;
+        break;
+      }
+      while (ctx->offset < ctx->length)
+        parse_header_line(ctx);
+      ctx->state = Header;
+      break;
+    case Header:
+      if (parse_header_block(ctx))
+        break;
+      /* fall through */
+    default:
+      parsed = new_cue();
+      get_cue_id(ctx, parsed);
+      if (move_to_next_line(ctx)) {
+        webvtt_cue_free(parsed);
+        parsed = NULL;
+        break;
+      }
+      get_timing_and_settings(ctx, parsed);
+      get_cue_text(ctx, parsed);
+      ctx->state = Id;
+    }
+  } else {
+    /* a block that is no cue, a NOTE or a bad one, is dropped */
+    webvtt_cue_free(parsed);
+    parsed = NULL;
+  }
+  ctx->recover = NULL;
+  *cue = parsed;
+  return r;
+}
+
+int
+  webvtt_parse_signed(const webvtt_parser *ctx)
+{
+  return ctx->format == WEBVTT_FORMAT_SRT || ctx->state != Initial;
+}
+
+/* turn the input into well formed UTF-8 before anything looks at it.
+when it has to change, the converted copy becomes the buffer */
+static void normalize_input(webvtt_parser *ctx) {
+  webvtt_buffer fixed;
+  int r;
+
+  webvtt_buffer_init(&fixed);
+  r = webvtt_to_utf8(ctx->buffer, ctx->length, &fixed);
+  if (r < 0 || (r == 1 && webvtt_buffer_reserve(&fixed, BUFFER_SIZE) < 0)) {
+    FAIL("Couldn't allocate input buffer\n");
+  }
+  if (r == 1) {
+    free(ctx->buffer);
+    ctx->buffer = fixed.data;
+    ctx->length = fixed.length;
+    ctx->capacity = fixed.capacity;
   }
-  return cue;
 }
 
 webvtt_cue *
   webvtt_parse_buffer(webvtt_parser *ctx, char *buffer, long length)
 {
-  long bytes = MIN(length, BUFFER_SIZE - ctx->length);
+  long bytes = MIN(length, BUFFER_SIZE);
 
+  webvtt_parse_reset(ctx);
   memcpy(ctx->buffer, buffer, bytes);
-  ctx->length += bytes;
+  ctx->length = bytes;
+  normalize_input(ctx);
 
   return webvtt_parse(ctx);
 }
@@ -683,12 +1409,13 @@ webvtt_cue *
 webvtt_cue *
   webvtt_parse_file(webvtt_parser *ctx, FILE *in)
 {
+  webvtt_parse_reset(ctx);
   ctx->length = fread(ctx->buffer, 1, BUFFER_SIZE, in);
-  ctx->offset = 0;
 
   if (ctx->length >= BUFFER_SIZE)
     fprintf(stderr, "WARNING: truncating input at %d bytes."
     " This is a bug,\n", BUFFER_SIZE);
+  normalize_input(ctx);
 
   return webvtt_parse(ctx);
 }
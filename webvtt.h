@@ -15,28 +15,130 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
+
+#include "webvtt_atoms.h"
+#include "webvtt_header.h"
+
+  /* timestamps are integer ticks, one tick lasting num/den seconds */
+  typedef struct webvtt_timebase webvtt_timebase;
+  struct webvtt_timebase {
+    uint32_t num, den;
+  };
+
+  static const webvtt_timebase webvtt_timebase_ms = { 1, 1000 };
+  static const webvtt_timebase webvtt_timebase_90khz = { 1, 90000 };
+
+  /* convert a tick count between timebases, rounding to the nearest
+  tick. exact whenever the target is a multiple of the source. a
+  timebase with a zero num or den is invalid, the value is returned as
+  it is then */
+  int64_t webvtt_rescale(int64_t value, webvtt_timebase from,
+                         webvtt_timebase to);
+
+  /* how the timestamps of a file, milliseconds of its own clock,
+  become cue times: an X-TIMESTAMP-MAP header moves LOCAL to MPEGTS,
+  and the result is in ticks of timebase. timestamps inside cue text,
+  like karaoke tags, must go through the map of their file too */
+  typedef struct webvtt_timestamp_map webvtt_timestamp_map;
+  struct webvtt_timestamp_map {
+    webvtt_timebase timebase;
+    int64_t local;      /** LOCAL, milliseconds */
+    int64_t mpegts;     /** MPEGTS, ticks of timebase */
+  };
+
+  /* the map of a file with no X-TIMESTAMP-MAP */
+  void webvtt_timestamp_map_init(webvtt_timestamp_map *map,
+                                 webvtt_timebase timebase);
+
+  /* a timestamp of the file in ticks */
+  int64_t webvtt_map_timestamp(const webvtt_timestamp_map *map, int64_t ms);
+
+  /* parse a timestamp, hh:mm:ss.ttt or mm:ss.ttt, at the start of s.
+  hours may have more than two digits. returns how many bytes it took,
+  -1 when s does not start with a timestamp */
+  int webvtt_parse_timestamp(const char *s, unsigned length, int64_t *ms);
+
+  /* the same with another character before the milliseconds, SubRip
+  writes hh:mm:ss,ttt */
+  int webvtt_parse_timestamp_sep(const char *s, unsigned length,
+                                 char separator, int64_t *ms);
+
+  /* writing direction and alignment settings as small codes */
+  enum webvtt_vertical {
+    WEBVTT_HORIZONTAL = 0,
+    WEBVTT_VERTICAL_RL,
+    WEBVTT_VERTICAL_LR
+  };
+
+  enum webvtt_align {
+    WEBVTT_ALIGN_MIDDLE = 0,
+    WEBVTT_ALIGN_START,
+    WEBVTT_ALIGN_END,
+    WEBVTT_ALIGN_LEFT,
+    WEBVTT_ALIGN_RIGHT
+  };
 
   /* webvtt files are a sequence of cues
   each cue has a start and end time for presentation
   and some text content (which my be marked up)
   there may be other attributes, but we ignore them
-  we store these in a linked list */
+  we store these in a linked list.
+  the fields read by timeline scans come first, the whole cue fits in
+  one 64 byte cache line */
   typedef struct webvtt_cue webvtt_cue;
   struct webvtt_cue {
+    int64_t start, end; /** timestamps in ticks of the parser timebase */
     char *text;       /** text value of the cue */
-    long start, end;  /** timestamps in milliseconds */
     webvtt_cue *next; /** pointer to the next cue */
     char *cueID;
-    char *settings;
+    char *settings;   /** raw settings line, NULL when there is none */
+    short line;       /** percentage unless snapToLine is set */
+    short position;   /** percentage */
+    short size;       /** percentage */
+    unsigned char vertical; /** enum webvtt_vertical */
+    unsigned char align;    /** enum webvtt_align */
+    unsigned short region;  /** region index + 1 in the header, 0 for none */
+    unsigned pauseOnExit : 1;
+    unsigned snapToLine : 1;
+    unsigned lineAuto : 1;  /** no line setting, line is meaningless */
+    unsigned interned : 1;  /** cueID and settings belong to an atom table */
+  };
+
+  /* read-only view of a cue. strings point into storage owned by
+  whoever produced the view and carry an explicit length; they are not
+  always NUL terminated. id and settings are NULL when absent. region
+  is the cue's, an index into the header of the track it came from */
+  typedef struct webvtt_cue_view webvtt_cue_view;
+  struct webvtt_cue_view {
+    int64_t start, end;
+    const char *text;
+    unsigned text_length;
+    const char *cueID;
+    unsigned cueID_length;
+    const char *settings;
+    unsigned settings_length;
     int pauseOnExit;
-    char *vertical;
     int snapToLine;
+    int lineAuto;
+    enum webvtt_vertical vertical;
+    enum webvtt_align align;
     long line;
     long position;
     long size;
-    char *align;
+    unsigned region;  /** region index + 1 in the header, 0 for none */
   };
 
+  /* release a cue and the strings it owns */
+  void webvtt_cue_free(webvtt_cue *cue);
+
+  /* fill a view describing a parsed cue */
+  void webvtt_cue_view_of(const webvtt_cue *cue, webvtt_cue_view *view);
+
+  /* convert the timestamps of a whole cue list */
+  void webvtt_rescale_cues(webvtt_cue *head, webvtt_timebase from,
+                           webvtt_timebase to);
+
 
   /* context structure for our parser */
   typedef struct webvtt_parser webvtt_parser;
@@ -44,9 +146,80 @@ extern "C" {
   /* allocate and initialize a parser context */
   webvtt_parser *webvtt_parse_new(void);
 
+  /* choose the timebase cue timestamps are produced in, milliseconds
+  by default. set it before parsing; an X-TIMESTAMP-MAP header is
+  applied on top of it. returns -1, keeping the one set before, when
+  num or den is 0 */
+  int webvtt_parse_set_timebase(webvtt_parser *ctx,
+                                webvtt_timebase timebase);
+
+  /* intern cue ids and settings lines in atoms instead of giving every
+  cue its own copies. identical settings lines, which is most of them,
+  are then stored once. the table must outlive the cues; NULL, the
+  default, turns interning off */
+  void webvtt_parse_set_atoms(webvtt_parser *ctx, webvtt_atoms *atoms);
+
+  /* what the input is. SubRip files come out as the same cues, their
+  markup rewritten to cue text: i, b and u are kept, a font color
+  becomes a class named color-<value>, other tags are dropped */
+  enum webvtt_format {
+    WEBVTT_FORMAT_VTT = 0,
+    WEBVTT_FORMAT_SRT
+  };
+
+  void webvtt_parse_set_format(webvtt_parser *ctx, enum webvtt_format format);
+
+  /* caps on what one file can make the parser keep. parsing takes
+  time linear in the input whatever they are, so they are there to
+  bound memory and the work done later on what was kept. 0 is no
+  limit */
+  typedef struct webvtt_limits webvtt_limits;
+  struct webvtt_limits {
+    unsigned line_length;     /** bytes kept of a line, the rest of it
+                                  is skipped */
+    unsigned cue_text;        /** bytes of text in a cue, lines past it
+                                  are dropped */
+    unsigned depth;           /** cue text tags open at once, deeper
+                                  ones are ignored */
+    unsigned cues;            /** in a file, later ones are dropped */
+  };
+
+  /* the defaults: 64 KiB lines, 1 MiB of text a cue, tags 256 deep and
+  any number of cues */
+  void webvtt_limits_init(webvtt_limits *limits);
+
+  /* the limits files are parsed with, the defaults until set */
+  void webvtt_parse_set_limits(webvtt_parser *ctx,
+                               const webvtt_limits *limits);
+
+  const webvtt_limits *webvtt_parse_limits(const webvtt_parser *ctx);
+
+  /* the map the cue times of the file being parsed went through. keep
+  a copy with its cues to build their karaoke schedules later */
+  webvtt_timestamp_map webvtt_parse_timestamp_map(const webvtt_parser *ctx);
+
+  /* the STYLE and REGION blocks of the last file parsed, NULL when it
+  had none. the caller owns the header from then on; the region
+  numbers of the cues index into it */
+  webvtt_header *webvtt_parse_take_header(webvtt_parser *ctx);
+
+  /* the same without taking it, it stays the context's */
+  const webvtt_header *webvtt_parse_header(const webvtt_parser *ctx);
+
+  /* forget the file being parsed so the context can take the next
+  one. the input buffer is kept, and so are the timebase, atoms,
+  format and limits set on it. a header not taken is freed. the read
+  functions below call this first, a parse never depends on the one
+  before */
+  void webvtt_parse_reset(webvtt_parser *ctx);
+
   /* shut down and release a parser context */
   void webvtt_parse_free(webvtt_parser *ctx);
 
+  /* a parser touches nothing but its context, so separate contexts can
+  parse on separate threads at once. the process atom table is the one
+  shared thing, and it locks */
+
   /* read a webvtt file stored in a buffer */
   struct webvtt_cue *
     webvtt_parse_buffer(webvtt_parser *ctx, char *buffer, long length);
@@ -59,6 +232,31 @@ extern "C" {
   struct webvtt_cue *
     webvtt_parse_filename(webvtt_parser *ctx, const char *filename);
 
+  /* blocks are what blank lines separate: the signature and header
+  lines, STYLE, REGION and NOTE blocks, and cues. from *start on, find
+  the next one, moving *start to where it begins and returning where
+  its last line ends, before the line terminator. both are length when
+  only blank lines are left */
+  unsigned webvtt_next_block(const char *s, unsigned length,
+                             unsigned *start);
+
+  /* parse a file one block at a time, for input that is edited or
+  arrives in pieces. reset the context, then hand it the blocks in
+  order, the first being the signature and header lines. STYLE and
+  REGION blocks are taken until the first cue. *cue is set to the cue
+  the block held, NULL when it held none. returns 0, or -1 when the
+  first block is no signature or when out of memory. unlike the read
+  functions above, malformed input never ends the process: a block
+  that fails to parse as a cue is dropped. the input must be UTF-8.
+  SubRip blocks are taken as they come, there is no header to them */
+  int webvtt_parse_block(webvtt_parser *ctx, const char *block,
+                         unsigned length, webvtt_cue **cue);
+
+  /* whether the blocks handed in so far began with the signature. a
+  WebVTT file that ends without one is no WebVTT file, empty or blank
+  input included. always 1 for SubRip */
+  int webvtt_parse_signed(const webvtt_parser *ctx);
+
   static inline int isNewline(char c)
   {
     return c == '\n' || c == '\f' || c == '\r' || c == '\0';
@@ -74,8 +272,8 @@ extern "C" {
 
   enum ParseState { Initial, Header, Id, TimingsAndSettings, CueText, NextCue, BadCue };
   int get_timing_and_settings(webvtt_parser *ctx, webvtt_cue *cue);
-  double collect_timestamp(webvtt_parser *ctx);
-  void parse_settings(char *settings, webvtt_cue *cue);
+  int64_t collect_timestamp(webvtt_parser *ctx);
+  void parse_settings(webvtt_parser *ctx, char *settings, webvtt_cue *cue);
   char* get_line(webvtt_parser *ctx);
 
 #if defined(__cplusplus)
@@ -0,0 +1,138 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_arena.h"
+
+#define BLOCK_SIZE 16384
+#define ALIGN 16
+
+/* allocations bigger than this get a block of their own, so they do not
+waste the rest of the current one */
+#define LARGE (BLOCK_SIZE / 4)
+
+struct webvtt_arena_block {
+  webvtt_arena_block *next;
+  size_t size;
+};
+
+/* block headers are padded so the space after them is aligned */
+#define HEADER ((sizeof(webvtt_arena_block) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+void
+  webvtt_arena_init(webvtt_arena *arena)
+{
+  arena->blocks = NULL;
+  arena->next = NULL;
+  arena->end = NULL;
+  arena->size = 0;
+}
+
+void
+  webvtt_arena_free(webvtt_arena *arena)
+{
+  webvtt_arena_block *block, *next;
+
+  for (block = arena->blocks; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+  webvtt_arena_init(arena);
+}
+
+void
+  webvtt_arena_reset(webvtt_arena *arena)
+{
+  webvtt_arena_block *block = arena->blocks, *next;
+
+  if (block == NULL)
+    return;
+  for (next = block->next; next != NULL; next = block->next) {
+    block->next = next->next;
+    free(next);
+  }
+  arena->size = block->size;
+  arena->next = (char*)block + HEADER;
+  arena->end = (char*)block + block->size;
+}
+
+static webvtt_arena_block *new_block(webvtt_arena *arena, size_t size) {
+  webvtt_arena_block *block = (webvtt_arena_block*)malloc(size);
+  if (block == NULL)
+    return NULL;
+  block->size = size;
+  arena->size += size;
+  return block;
+}
+
+/* strings only need byte alignment, packing them saves a lot on the
+short names that make up most of what is interned */
+static void *allocate(webvtt_arena *arena, size_t size, size_t align) {
+  webvtt_arena_block *block;
+  uintptr_t at = ((uintptr_t)arena->next + align - 1) & ~(uintptr_t)(align - 1);
+  char *p;
+
+  if (arena->next && at <= (uintptr_t)arena->end &&
+      (uintptr_t)arena->end - at >= size) {
+    p = (char*)at;
+    arena->next = p + size;
+    return p;
+  }
+
+  if (size > LARGE) {
+    /* behind the newest block, which keeps serving small requests */
+    block = new_block(arena, HEADER + size);
+    if (block == NULL)
+      return NULL;
+    if (arena->blocks) {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    } else {
+      block->next = NULL;
+      arena->blocks = block;
+    }
+    return (char*)block + HEADER;
+  }
+
+  block = new_block(arena, BLOCK_SIZE);
+  if (block == NULL)
+    return NULL;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  p = (char*)block + HEADER;
+  arena->next = p + size;
+  arena->end = (char*)block + BLOCK_SIZE;
+  return p;
+}
+
+void *
+  webvtt_arena_alloc(webvtt_arena *arena, size_t size)
+{
+  return allocate(arena, size, ALIGN);
+}
+
+char *
+  webvtt_arena_strndup(webvtt_arena *arena, const char *s, size_t length)
+{
+  char *copy = (char*)allocate(arena, length + 1, 1);
+  if (copy) {
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+size_t
+  webvtt_arena_size(const webvtt_arena *arena)
+{
+  return arena->size;
+}
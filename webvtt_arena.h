@@ -0,0 +1,51 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_ARENA_H_
+#define _WEBVTT_ARENA_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  /* bump allocator for data that lives exactly as long as its owner.
+  memory is carved out of large blocks and only released all at once */
+  typedef struct webvtt_arena_block webvtt_arena_block;
+  typedef struct webvtt_arena webvtt_arena;
+  struct webvtt_arena {
+    webvtt_arena_block *blocks;   /** newest first */
+    char *next, *end;             /** free space in the newest block */
+    size_t size;                  /** bytes held in blocks */
+  };
+
+  void webvtt_arena_init(webvtt_arena *arena);
+
+  void webvtt_arena_free(webvtt_arena *arena);
+
+  /* forget everything allocated but keep the newest block, so a reused
+  arena does not go back to malloc */
+  void webvtt_arena_reset(webvtt_arena *arena);
+
+  /* size bytes aligned for any type, NULL when out of memory */
+  void *webvtt_arena_alloc(webvtt_arena *arena, size_t size);
+
+  /* a NUL terminated copy of length bytes at s */
+  char *webvtt_arena_strndup(webvtt_arena *arena, const char *s,
+                             size_t length);
+
+  /* bytes the arena holds from malloc */
+  size_t webvtt_arena_size(const webvtt_arena *arena);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_ARENA_H_ */
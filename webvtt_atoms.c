@@ -0,0 +1,220 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_atoms.h"
+#include "webvtt_arena.h"
+
+typedef struct entry entry;
+struct entry {
+  const char *s;
+  unsigned length;
+  unsigned hash;
+};
+
+struct webvtt_atoms {
+  entry *entries;           /* atom n is entries[n - 1] */
+  unsigned count, capacity;
+  webvtt_atom *slots;       /* open addressing, 0 is empty */
+  unsigned slot_count;
+  webvtt_arena strings;
+  int shared;               /* the process table, lock around every call */
+  pthread_mutex_t lock;
+};
+
+static webvtt_atoms process_atoms;
+static pthread_once_t process_once = PTHREAD_ONCE_INIT;
+
+static unsigned hash_string(const char *s, unsigned length) {
+  unsigned h = 2166136261u;
+  unsigned i;
+  for (i = 0; i < length; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static void atoms_init(webvtt_atoms *atoms) {
+  atoms->entries = NULL;
+  atoms->count = 0;
+  atoms->capacity = 0;
+  atoms->slots = NULL;
+  atoms->slot_count = 0;
+  atoms->shared = 0;
+  webvtt_arena_init(&atoms->strings);
+}
+
+webvtt_atoms *
+  webvtt_atoms_new(void)
+{
+  webvtt_atoms *atoms = (webvtt_atoms*)malloc(sizeof(*atoms));
+  if (atoms)
+    atoms_init(atoms);
+  return atoms;
+}
+
+void
+  webvtt_atoms_free(webvtt_atoms *atoms)
+{
+  if (atoms && !atoms->shared) {
+    free(atoms->entries);
+    free(atoms->slots);
+    webvtt_arena_free(&atoms->strings);
+    free(atoms);
+  }
+}
+
+static void process_init(void) {
+  atoms_init(&process_atoms);
+  pthread_mutex_init(&process_atoms.lock, NULL);
+  process_atoms.shared = 1;
+}
+
+webvtt_atoms *
+  webvtt_atoms_process(void)
+{
+  pthread_once(&process_once, process_init);
+  return &process_atoms;
+}
+
+static void lock(webvtt_atoms *atoms) {
+  if (atoms->shared)
+    pthread_mutex_lock(&atoms->lock);
+}
+
+static void unlock(webvtt_atoms *atoms) {
+  if (atoms->shared)
+    pthread_mutex_unlock(&atoms->lock);
+}
+
+/* the slot holding s, or the empty slot where it would go */
+static webvtt_atom *find_slot(webvtt_atoms *atoms, const char *s,
+                              unsigned length, unsigned hash) {
+  unsigned mask = atoms->slot_count - 1;
+  unsigned h = hash & mask;
+  const entry *e;
+
+  while (atoms->slots[h]) {
+    e = &atoms->entries[atoms->slots[h] - 1];
+    if (e->hash == hash && e->length == length &&
+        memcmp(e->s, s, length) == 0)
+      break;
+    h = (h + 1) & mask;
+  }
+  return &atoms->slots[h];
+}
+
+static int grow(webvtt_atoms *atoms) {
+  unsigned slot_count = atoms->slot_count ? atoms->slot_count * 2 : 64;
+  webvtt_atom *slots = (webvtt_atom*)calloc(slot_count, sizeof(*slots));
+  entry *entries;
+  unsigned i, h;
+
+  if (slots == NULL)
+    return -1;
+  entries = (entry*)realloc(atoms->entries, slot_count / 2 * sizeof(*entries));
+  if (entries == NULL) {
+    free(slots);
+    return -1;
+  }
+  atoms->entries = entries;
+  for (i = 0; i < atoms->count; i++) {
+    h = entries[i].hash & (slot_count - 1);
+    while (slots[h])
+      h = (h + 1) & (slot_count - 1);
+    slots[h] = i + 1;
+  }
+  free(atoms->slots);
+  atoms->slots = slots;
+  atoms->slot_count = slot_count;
+  atoms->capacity = slot_count / 2;
+  return 0;
+}
+
+webvtt_atom
+  webvtt_atom_intern(webvtt_atoms *atoms, const char *s, unsigned length)
+{
+  unsigned hash = hash_string(s, length);
+  webvtt_atom *slot, atom = WEBVTT_NO_ATOM;
+  entry *e;
+
+  lock(atoms);
+  if (atoms->count == atoms->capacity && grow(atoms) < 0)
+    goto done;
+  slot = find_slot(atoms, s, length, hash);
+  if (*slot) {
+    atom = *slot;
+    goto done;
+  }
+  e = &atoms->entries[atoms->count];
+  e->s = webvtt_arena_strndup(&atoms->strings, s, length);
+  if (e->s == NULL)
+    goto done;
+  e->length = length;
+  e->hash = hash;
+  atom = *slot = ++atoms->count;
+done:
+  unlock(atoms);
+  return atom;
+}
+
+webvtt_atom
+  webvtt_atom_find(webvtt_atoms *atoms, const char *s, unsigned length)
+{
+  webvtt_atom atom = WEBVTT_NO_ATOM;
+
+  lock(atoms);
+  if (atoms->count)
+    atom = *find_slot(atoms, s, length, hash_string(s, length));
+  unlock(atoms);
+  return atom;
+}
+
+const char *
+  webvtt_atom_string(webvtt_atoms *atoms, webvtt_atom atom, unsigned *length)
+{
+  const char *s = NULL;
+  unsigned n = 0;
+
+  lock(atoms);
+  if (atom != WEBVTT_NO_ATOM && atom <= atoms->count) {
+    s = atoms->entries[atom - 1].s;
+    n = atoms->entries[atom - 1].length;
+  }
+  unlock(atoms);
+  if (length)
+    *length = n;
+  return s;
+}
+
+unsigned
+  webvtt_atoms_count(webvtt_atoms *atoms)
+{
+  unsigned count;
+
+  lock(atoms);
+  count = atoms->count;
+  unlock(atoms);
+  return count;
+}
+
+size_t
+  webvtt_atoms_size(webvtt_atoms *atoms)
+{
+  size_t size;
+
+  lock(atoms);
+  size = sizeof(*atoms) + atoms->capacity * sizeof(entry) +
+    atoms->slot_count * sizeof(webvtt_atom) +
+    webvtt_arena_size(&atoms->strings);
+  unlock(atoms);
+  return size;
+}
@@ -0,0 +1,66 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_ATOMS_H_
+#define _WEBVTT_ATOMS_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+  /* string interning. equal strings get the same small atom, numbered
+  from 1 in the order they were first seen, so voice, class and region
+  names compare as integers and a speaker named a thousand times in a
+  track is stored once */
+  typedef uint32_t webvtt_atom;
+
+#define WEBVTT_NO_ATOM 0
+
+  typedef struct webvtt_atoms webvtt_atoms;
+
+  /* an empty table, NULL when out of memory. a table is normally kept
+  per track; it is not safe to share between threads */
+  webvtt_atoms *webvtt_atoms_new(void);
+
+  void webvtt_atoms_free(webvtt_atoms *atoms);
+
+  /* the table shared by the whole process. it is never freed and every
+  call on it takes a lock, so any thread may use it */
+  webvtt_atoms *webvtt_atoms_process(void);
+
+  /* the atom of the length bytes at s, added when new. returns
+  WEBVTT_NO_ATOM when out of memory */
+  webvtt_atom webvtt_atom_intern(webvtt_atoms *atoms, const char *s,
+                                 unsigned length);
+
+  /* the atom of a string without adding it, WEBVTT_NO_ATOM when the
+  string was never interned. matching a style or filtering on a speaker
+  looks names up this way once and then compares atoms */
+  webvtt_atom webvtt_atom_find(webvtt_atoms *atoms, const char *s,
+                               unsigned length);
+
+  /* the interned copy, NUL terminated and valid as long as the table.
+  length may be NULL */
+  const char *webvtt_atom_string(webvtt_atoms *atoms, webvtt_atom atom,
+                                 unsigned *length);
+
+  /* how many atoms there are, the largest atom is this number */
+  unsigned webvtt_atoms_count(webvtt_atoms *atoms);
+
+  /* bytes held by the table */
+  size_t webvtt_atoms_size(webvtt_atoms *atoms);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_ATOMS_H_ */
@@ -0,0 +1,432 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "webvtt_binary.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+/* the cue record is part of the file format */
+typedef char binary_cue_size_check[sizeof(webvtt_binary_cue) == 56 ? 1 : -1];
+typedef char binary_header_size_check[sizeof(webvtt_binary_header) == 72 ? 1 : -1];
+
+static uint32_t pool_add(char *pool, size_t *used, const char *s,
+                         unsigned length) {
+  uint32_t offset;
+  if (s == NULL)
+    return WEBVTT_BINARY_NONE;
+  offset = (uint32_t)*used;
+  memcpy(pool + *used, s, length);
+  pool[*used + length] = '\0';
+  *used += length + 1;
+  return offset;
+}
+
+/* stable bottom-up merge sort of the cue numbers by start time, so equal
+starts stay in cue order. scratch holds count numbers */
+static void sort_by_start(uint32_t *order, uint32_t *scratch,
+                          const webvtt_binary_cue *cues, uint32_t count) {
+  uint32_t *from = order, *to = scratch, *swap;
+  size_t width, lo, mid, hi, i, j, k;
+  for (i = 0; i < count; i++)
+    order[i] = (uint32_t)i;
+  for (width = 1; width < count; width *= 2) {
+    for (lo = 0; lo < count; lo += 2 * width) {
+      mid = lo + width < count ? lo + width : count;
+      hi = mid + width < count ? mid + width : count;
+      i = lo;
+      j = mid;
+      for (k = lo; k < hi; k++) {
+        if (j < hi && (i == mid ||
+                       cues[from[j]].start < cues[from[i]].start))
+          to[k] = from[j++];
+        else
+          to[k] = from[i++];
+      }
+    }
+    swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != order)
+    memcpy(order, from, count * sizeof(*order));
+}
+
+int
+  webvtt_binary_compile(const webvtt_cue *head, webvtt_timebase timebase,
+                        unsigned flags, void **out, size_t *out_length)
+{
+  const webvtt_cue *cue;
+  webvtt_cue_view view;
+  webvtt_binary_header *header;
+  webvtt_binary_cue *record;
+  int64_t *max_end;
+  uint32_t *order;
+  uint32_t count = 0, i;
+  size_t pool_size = 0, pool_used = 0, total;
+  char *blob, *pool;
+
+  if (out == NULL || out_length == NULL)
+    return -1;
+
+  for (cue = head; cue != NULL; cue = cue->next) {
+    webvtt_cue_view_of(cue, &view);
+    pool_size += view.text_length + 1;
+    if (view.cueID)
+      pool_size += view.cueID_length + 1;
+    if (view.settings)
+      pool_size += view.settings_length + 1;
+    count++;
+  }
+  if (pool_size > WEBVTT_BINARY_NONE)
+    return -1;
+
+  total = sizeof(*header);
+  total += (size_t)count * sizeof(*record);
+  total = ALIGN8(total + pool_size);
+  if (flags & WEBVTT_BINARY_INDEX)
+    total += (size_t)count * (sizeof(*max_end) + sizeof(*order));
+
+  blob = (char*)calloc(1, total);
+  if (blob == NULL)
+    return -1;
+
+  header = (webvtt_binary_header*)blob;
+  memcpy(header->magic, WEBVTT_BINARY_MAGIC, 4);
+  header->version = WEBVTT_BINARY_VERSION;
+  header->flags = flags & WEBVTT_BINARY_INDEX;
+  header->byte_order = BYTE_ORDER_MARK;
+  header->cue_count = count;
+  header->cue_stride = sizeof(*record);
+  header->timebase_num = timebase.num;
+  header->timebase_den = timebase.den;
+  header->cue_offset = sizeof(*header);
+  header->pool_offset = header->cue_offset + (uint64_t)count * sizeof(*record);
+  header->pool_size = pool_size;
+  header->total_size = total;
+
+  record = (webvtt_binary_cue*)(blob + header->cue_offset);
+  pool = blob + header->pool_offset;
+  for (cue = head; cue != NULL; cue = cue->next, record++) {
+    webvtt_cue_view_of(cue, &view);
+    record->start = view.start;
+    record->end = view.end;
+    record->text_offset = pool_add(pool, &pool_used, view.text,
+                                   view.text_length);
+    record->text_length = view.text_length;
+    record->id_offset = pool_add(pool, &pool_used, view.cueID,
+                                 view.cueID_length);
+    record->id_length = view.cueID_length;
+    record->settings_offset = pool_add(pool, &pool_used, view.settings,
+                                       view.settings_length);
+    record->settings_length = view.settings_length;
+    record->line = (int32_t)view.line;
+    record->position = (int16_t)view.position;
+    record->size = (int16_t)view.size;
+    record->vertical = (uint8_t)view.vertical;
+    record->align = (uint8_t)view.align;
+    record->region = (uint16_t)view.region;
+    if (view.pauseOnExit)
+      record->flags |= WEBVTT_BINARY_PAUSE_ON_EXIT;
+    if (view.snapToLine)
+      record->flags |= WEBVTT_BINARY_SNAP_TO_LINE;
+    if (view.lineAuto)
+      record->flags |= WEBVTT_BINARY_LINE_AUTO;
+  }
+
+  if (flags & WEBVTT_BINARY_INDEX) {
+    header->index_offset = ALIGN8(header->pool_offset + pool_size);
+    max_end = (int64_t*)(blob + header->index_offset);
+    order = (uint32_t*)(max_end + count);
+    record = (webvtt_binary_cue*)(blob + header->cue_offset);
+    /* max_end is not filled yet, and is twice the size the sort needs */
+    sort_by_start(order, (uint32_t*)max_end, record, count);
+    for (i = 0; i < count; i++) {
+      max_end[i] = record[order[i]].end;
+      if (i && max_end[i - 1] > max_end[i])
+        max_end[i] = max_end[i - 1];
+    }
+  }
+
+  *out = blob;
+  *out_length = total;
+  return 0;
+}
+
+int
+  webvtt_binary_write(const webvtt_cue *head, webvtt_timebase timebase,
+                      unsigned flags, const char *filename)
+{
+  void *blob;
+  size_t length;
+  FILE *out;
+  int err = 0;
+
+  if (webvtt_binary_compile(head, timebase, flags, &blob, &length) < 0)
+    return -1;
+
+  out = fopen(filename, "wb");
+  if (out == NULL) {
+    free(blob);
+    return -1;
+  }
+  if (fwrite(blob, 1, length, out) != length)
+    err = -1;
+  if (fclose(out) != 0)
+    err = -1;
+  free(blob);
+  return err;
+}
+
+/* inside the pool and NUL terminated, as views promise */
+static int string_in_pool(const webvtt_binary_header *header,
+                          const char *pool, uint32_t offset,
+                          uint32_t length) {
+  if (offset == WEBVTT_BINARY_NONE)
+    return length == 0;
+  return (uint64_t)offset + length < header->pool_size &&
+    pool[offset + length] == '\0';
+}
+
+int
+  webvtt_binary_load(webvtt_binary_track *track,
+                     const void *data, size_t length)
+{
+  const webvtt_binary_header *header = (const webvtt_binary_header*)data;
+  const char *base = (const char*)data;
+  uint64_t table_end, pool_end;
+  uint32_t i;
+
+  if (track == NULL || data == NULL || length < sizeof(*header))
+    return -1;
+  if (memcmp(header->magic, WEBVTT_BINARY_MAGIC, 4) != 0 ||
+      header->version != WEBVTT_BINARY_VERSION ||
+      header->byte_order != BYTE_ORDER_MARK ||
+      header->cue_stride != sizeof(webvtt_binary_cue) ||
+      header->timebase_num == 0 || header->timebase_den == 0 ||
+      header->total_size != length)
+    return -1;
+
+  /* each part is checked against what is left of the file, as the sums
+  of crafted fields could wrap */
+  if (header->cue_offset != sizeof(*header) ||
+      header->cue_count > (length - sizeof(*header)) /
+      sizeof(webvtt_binary_cue))
+    return -1;
+  table_end = header->cue_offset + (uint64_t)header->cue_count *
+    sizeof(webvtt_binary_cue);
+  if (header->pool_offset != table_end ||
+      header->pool_size > length - header->pool_offset)
+    return -1;
+  pool_end = header->pool_offset + header->pool_size;
+  if (header->index_offset &&
+      (header->index_offset & 7 ||
+       header->index_offset < pool_end || header->index_offset > length ||
+       header->cue_count > (length - header->index_offset) /
+       (sizeof(int64_t) + sizeof(uint32_t))))
+    return -1;
+
+  track->header = header;
+  track->cues = (const webvtt_binary_cue*)(base + header->cue_offset);
+  track->pool = base + header->pool_offset;
+  track->max_end = NULL;
+  track->order = NULL;
+  if (header->index_offset) {
+    track->max_end = (const int64_t*)(base + header->index_offset);
+    track->order = (const uint32_t*)(track->max_end + header->cue_count);
+  }
+
+  /* offsets and codes are checked once here so the accessors can trust
+  them */
+  for (i = 0; i < header->cue_count; i++) {
+    const webvtt_binary_cue *cue = track->cues + i;
+    if (!string_in_pool(header, track->pool, cue->text_offset,
+                        cue->text_length) ||
+        cue->text_offset == WEBVTT_BINARY_NONE ||
+        !string_in_pool(header, track->pool, cue->id_offset,
+                        cue->id_length) ||
+        !string_in_pool(header, track->pool, cue->settings_offset,
+                        cue->settings_length) ||
+        cue->vertical > WEBVTT_VERTICAL_LR ||
+        cue->align > WEBVTT_ALIGN_RIGHT)
+      return -1;
+  }
+
+  /* and so can the interval query. the order is by start and then cue
+  number, as the compiler's stable sort leaves it, which also makes
+  every cue appear exactly once; max_end is the running max of end */
+  for (i = 0; track->order && i < header->cue_count; i++) {
+    const webvtt_binary_cue *cue, *before;
+    int64_t max_end;
+    if (track->order[i] >= header->cue_count)
+      return -1;
+    cue = track->cues + track->order[i];
+    max_end = cue->end;
+    if (i) {
+      before = track->cues + track->order[i - 1];
+      if (before->start > cue->start ||
+          (before->start == cue->start &&
+           track->order[i - 1] >= track->order[i]))
+        return -1;
+      if (track->max_end[i - 1] > max_end)
+        max_end = track->max_end[i - 1];
+    }
+    if (track->max_end[i] != max_end)
+      return -1;
+  }
+  track->mapping = NULL;
+  track->mapping_length = 0;
+  return 0;
+}
+
+int
+  webvtt_binary_open(webvtt_binary_track *track, const char *filename)
+{
+  struct stat st;
+  void *mapping;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    close(fd);
+    return -1;
+  }
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return -1;
+
+  if (webvtt_binary_load(track, mapping, st.st_size) < 0) {
+    munmap(mapping, st.st_size);
+    return -1;
+  }
+  track->mapping = mapping;
+  track->mapping_length = st.st_size;
+  return 0;
+}
+
+void
+  webvtt_binary_close(webvtt_binary_track *track)
+{
+  if (track && track->mapping) {
+    munmap(track->mapping, track->mapping_length);
+    track->mapping = NULL;
+    track->mapping_length = 0;
+  }
+}
+
+unsigned
+  webvtt_binary_cue_count(const webvtt_binary_track *track)
+{
+  return track->header->cue_count;
+}
+
+webvtt_timebase
+  webvtt_binary_timebase(const webvtt_binary_track *track)
+{
+  webvtt_timebase timebase;
+  timebase.num = track->header->timebase_num;
+  timebase.den = track->header->timebase_den;
+  return timebase;
+}
+
+int
+  webvtt_binary_get_cue(const webvtt_binary_track *track, unsigned i,
+                        webvtt_cue_view *view)
+{
+  const webvtt_binary_cue *cue;
+
+  if (i >= track->header->cue_count)
+    return -1;
+  cue = track->cues + i;
+
+  view->start = cue->start;
+  view->end = cue->end;
+  view->text = track->pool + cue->text_offset;
+  view->text_length = cue->text_length;
+  view->cueID = cue->id_offset == WEBVTT_BINARY_NONE ?
+    NULL : track->pool + cue->id_offset;
+  view->cueID_length = cue->id_length;
+  view->settings = cue->settings_offset == WEBVTT_BINARY_NONE ?
+    NULL : track->pool + cue->settings_offset;
+  view->settings_length = cue->settings_length;
+  view->pauseOnExit = (cue->flags & WEBVTT_BINARY_PAUSE_ON_EXIT) != 0;
+  view->snapToLine = (cue->flags & WEBVTT_BINARY_SNAP_TO_LINE) != 0;
+  view->lineAuto = (cue->flags & WEBVTT_BINARY_LINE_AUTO) != 0;
+  view->vertical = (enum webvtt_vertical)cue->vertical;
+  view->align = (enum webvtt_align)cue->align;
+  view->line = cue->line;
+  view->position = cue->position;
+  view->size = cue->size;
+  view->region = cue->region;
+  return 0;
+}
+
+unsigned
+  webvtt_binary_active_cues(const webvtt_binary_track *track,
+                            int64_t t, unsigned *out, unsigned max)
+{
+  const webvtt_binary_cue *cues = track->cues;
+  uint32_t count = track->header->cue_count;
+  uint32_t lo, hi, mid, first, last, i, n;
+  unsigned found = 0;
+
+  if (track->order == NULL) {
+    for (i = 0; i < count; i++) {
+      if (cues[i].start <= t && t < cues[i].end) {
+        if (found < max)
+          out[found] = i;
+        found++;
+      }
+    }
+    return found;
+  }
+
+  /* cues starting at or before t: order[0, last) */
+  lo = 0;
+  hi = count;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (cues[track->order[mid]].start <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  last = lo;
+
+  /* max_end never decreases, skip the prefix that ended before t */
+  lo = 0;
+  hi = last;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (track->max_end[mid] <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  first = lo;
+
+  for (i = first; i < last; i++) {
+    n = track->order[i];
+    if (t < cues[n].end) {
+      if (found < max)
+        out[found] = n;
+      found++;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,134 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_BINARY_H_
+#define _WEBVTT_BINARY_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "webvtt.h"
+
+  /* precompiled tracks. a parsed cue list is compiled once into a
+  flat blob which can be mapped straight back into memory:
+
+    header | cue table | string pool | interval index (optional)
+
+  every cue is a fixed size record, strings live in the pool and are
+  referenced by offset. all integers are in host byte order, a blob
+  written on a machine of the other endianness is rejected */
+
+#define WEBVTT_BINARY_MAGIC "WVTB"
+#define WEBVTT_BINARY_VERSION 2
+
+  /* compile flags */
+#define WEBVTT_BINARY_INDEX 0x1 /* build the interval index */
+
+  /* marks an absent string */
+#define WEBVTT_BINARY_NONE 0xffffffffu
+
+  typedef struct webvtt_binary_header webvtt_binary_header;
+  struct webvtt_binary_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t byte_order;      /** 0x01020304 as written */
+    uint32_t cue_count;
+    uint32_t cue_stride;      /** sizeof(webvtt_binary_cue) */
+    uint32_t timebase_num;    /** timestamps are in ticks of num/den s */
+    uint32_t timebase_den;
+    uint32_t reserved;
+    uint64_t cue_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    uint64_t index_offset;    /** 0 when there is no index */
+    uint64_t total_size;
+  };
+
+  typedef struct webvtt_binary_cue webvtt_binary_cue;
+  struct webvtt_binary_cue {
+    int64_t start, end;       /** timestamps in ticks */
+    uint32_t text_offset, text_length;
+    uint32_t id_offset, id_length;
+    uint32_t settings_offset, settings_length;
+    int32_t line;
+    int16_t position;
+    int16_t size;
+    uint8_t vertical;         /** enum webvtt_vertical */
+    uint8_t align;            /** enum webvtt_align */
+    uint8_t flags;            /** WEBVTT_BINARY_PAUSE_ON_EXIT, ... */
+    uint8_t reserved;
+    uint16_t region;          /** index + 1 in the header of the track
+                                  compiled, 0 for none */
+    uint8_t reserved2[2];
+  };
+
+#define WEBVTT_BINARY_PAUSE_ON_EXIT 0x1
+#define WEBVTT_BINARY_SNAP_TO_LINE 0x2
+#define WEBVTT_BINARY_LINE_AUTO 0x4
+
+  /* a loaded track. this is only a handful of pointers into the blob,
+  callers usually keep it on the stack */
+  typedef struct webvtt_binary_track webvtt_binary_track;
+  struct webvtt_binary_track {
+    const webvtt_binary_header *header;
+    const webvtt_binary_cue *cues;
+    const char *pool;
+    const int64_t *max_end;   /** index: running max of end, by start */
+    const uint32_t *order;    /** index: cue numbers sorted by start */
+    void *mapping;            /** set when the blob was mmap()ed */
+    size_t mapping_length;
+  };
+
+  /* compile a cue list whose timestamps are in the given timebase.
+  the blob is malloc()ed and returned through out; returns 0 on success
+  and -1 on failure */
+  int webvtt_binary_compile(const webvtt_cue *head, webvtt_timebase timebase,
+                            unsigned flags, void **out, size_t *out_length);
+
+  /* compile a cue list into a file */
+  int webvtt_binary_write(const webvtt_cue *head, webvtt_timebase timebase,
+                          unsigned flags, const char *filename);
+
+  /* validate a blob already in memory and point a track at it. every
+  offset, string terminator and the whole index are checked, in one
+  pass, so a blob from anywhere is rejected rather than misread. the
+  blob is not copied and must outlive the track */
+  int webvtt_binary_load(webvtt_binary_track *track,
+                         const void *data, size_t length);
+
+  /* map a compiled file read-only and load it */
+  int webvtt_binary_open(webvtt_binary_track *track, const char *filename);
+
+  /* unmap a track opened with webvtt_binary_open */
+  void webvtt_binary_close(webvtt_binary_track *track);
+
+  unsigned webvtt_binary_cue_count(const webvtt_binary_track *track);
+
+  webvtt_timebase webvtt_binary_timebase(const webvtt_binary_track *track);
+
+  /* fill a view for cue number i, strings point into the pool */
+  int webvtt_binary_get_cue(const webvtt_binary_track *track, unsigned i,
+                            webvtt_cue_view *view);
+
+  /* store the numbers of the cues active at time t (start <= t < end)
+  into out, in start order. returns how many cues are active, which may
+  be more than max; only the first max are stored */
+  unsigned webvtt_binary_active_cues(const webvtt_binary_track *track,
+                                     int64_t t, unsigned *out, unsigned max);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_BINARY_H_ */
@@ -0,0 +1,68 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "webvtt_buffer.h"
+
+#define INITIAL_CAPACITY 4096
+
+void
+  webvtt_buffer_init(webvtt_buffer *buffer)
+{
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->capacity = 0;
+}
+
+void
+  webvtt_buffer_free(webvtt_buffer *buffer)
+{
+  free(buffer->data);
+  webvtt_buffer_init(buffer);
+}
+
+int
+  webvtt_buffer_reserve(webvtt_buffer *buffer, size_t more)
+{
+  size_t capacity = buffer->capacity ? buffer->capacity : INITIAL_CAPACITY;
+  char *data;
+
+  if (buffer->capacity - buffer->length >= more)
+    return 0;
+  while (capacity - buffer->length < more)
+    capacity *= 2;
+  data = (char*)realloc(buffer->data, capacity);
+  if (data == NULL)
+    return -1;
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 0;
+}
+
+int
+  webvtt_buffer_flush(webvtt_buffer *buffer, int fd)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < buffer->length) {
+    n = write(fd, buffer->data + done, buffer->length - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    done += n;
+  }
+  buffer->length = 0;
+  return 0;
+}
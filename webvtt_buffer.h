@@ -0,0 +1,53 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_BUFFER_H_
+#define _WEBVTT_BUFFER_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+  /* growable output buffer shared by the writers */
+  typedef struct webvtt_buffer webvtt_buffer;
+  struct webvtt_buffer {
+    char *data;
+    size_t length, capacity;
+  };
+
+  void webvtt_buffer_init(webvtt_buffer *buffer);
+
+  void webvtt_buffer_free(webvtt_buffer *buffer);
+
+  /* make room for at least more bytes past length. returns -1 when out
+  of memory, the buffer is untouched then */
+  int webvtt_buffer_reserve(webvtt_buffer *buffer, size_t more);
+
+  /* write the contents to a file descriptor */
+  int webvtt_buffer_flush(webvtt_buffer *buffer, int fd);
+
+  static inline int webvtt_buffer_append(webvtt_buffer *buffer,
+                                         const char *data, size_t length)
+  {
+    if (buffer->capacity - buffer->length < length &&
+        webvtt_buffer_reserve(buffer, length) < 0)
+      return -1;
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+  }
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_BUFFER_H_ */
@@ -0,0 +1,376 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "webvtt_cache.h"
+#include "webvtt_epoch.h"
+#include "webvtt_pool.h"
+#include "webvtt_stream.h"
+
+/* fixed, so lookups never race a resize */
+#define BUCKETS 256
+
+typedef struct cache_key cache_key;
+struct cache_key {
+  uint64_t hash;            /* of the content, or of the path and identity */
+  uint64_t size;
+  int64_t mtime;            /* nanoseconds, files only */
+  const char *path;         /* NULL for buffers */
+  const char *data;         /* the content of a buffer, size bytes */
+  enum webvtt_format format;
+};
+
+struct webvtt_cached {
+  webvtt_retired retired;   /* first, evictions retire the entry */
+  webvtt_cached *next;      /* in its bucket */
+  cache_key key;
+  webvtt_store *store;
+  webvtt_header *header;    /* NULL when the track had none */
+  size_t bytes;
+  unsigned long refs;
+  unsigned long last_used;
+  char copy[];              /* of the key's path, or of a buffer's data */
+};
+
+struct webvtt_cache {
+  webvtt_cached *buckets[BUCKETS];
+  webvtt_epoch epoch;
+  pthread_mutex_t lock;     /* inserts and evictions */
+  size_t max_bytes, bytes;
+  unsigned entries;
+  unsigned long clock;      /* ticks on every use, for the LRU order */
+  unsigned long hits, misses, evictions;
+};
+
+static uint64_t rotl(uint64_t x, int r) {
+  return x << r | x >> (64 - r);
+}
+
+/* final mix of MurmurHash3 */
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  return h ^ h >> 33;
+}
+
+#define K1 0x9e3779b97f4a7c15ULL
+#define K2 0xc2b2ae3d27d4eb4fULL
+
+/* four independent lanes of 8 bytes, so the multiplies overlap */
+static uint64_t hash_bytes(const char *s, size_t length, uint64_t seed) {
+  uint64_t lane[4], w, h;
+  size_t i = 0;
+  int j;
+
+  for (j = 0; j < 4; j++)
+    lane[j] = seed + (uint64_t)j * K1;
+  for (; i + 32 <= length; i += 32) {
+    for (j = 0; j < 4; j++) {
+      memcpy(&w, s + i + 8 * j, 8);
+      lane[j] = rotl(lane[j] ^ w * K2, 31) * K1;
+    }
+  }
+  h = length * K1;
+  for (j = 0; j < 4; j++)
+    h = rotl(h ^ lane[j], 27) * K2;
+  for (; i + 8 <= length; i += 8) {
+    memcpy(&w, s + i, 8);
+    h = rotl(h ^ w * K2, 31) * K1;
+  }
+  w = 0;
+  memcpy(&w, s + i, length - i);
+  h = rotl(h ^ w * K2, 31) * K1;
+  return mix(h);
+}
+
+/* the hash only narrows the search. the content of buffers is compared
+too, as inputs that collide are easy to make for an unkeyed hash */
+static int same_key(const cache_key *a, const cache_key *b) {
+  if (a->hash != b->hash || a->size != b->size || a->format != b->format ||
+      a->mtime != b->mtime || (a->path == NULL) != (b->path == NULL))
+    return 0;
+  if (a->path)
+    return strcmp(a->path, b->path) == 0;
+  return a->size == 0 || memcmp(a->data, b->data, a->size) == 0;
+}
+
+webvtt_cache *
+  webvtt_cache_new(size_t max_bytes)
+{
+  webvtt_cache *cache = (webvtt_cache*)calloc(1, sizeof(*cache));
+
+  if (cache == NULL)
+    return NULL;
+  if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+    free(cache);
+    return NULL;
+  }
+  webvtt_epoch_init(&cache->epoch);
+  cache->max_bytes = max_bytes;
+  return cache;
+}
+
+void
+  webvtt_cached_release(webvtt_cached *cached)
+{
+  if (cached && __atomic_sub_fetch(&cached->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    webvtt_store_free(cached->store);
+    webvtt_header_free(cached->header);
+    free(cached);
+  }
+}
+
+/* what retiring an entry hands over is the cache's reference */
+static void release_retired(webvtt_retired *retired) {
+  webvtt_cached_release((webvtt_cached*)retired);
+}
+
+void
+  webvtt_cache_free(webvtt_cache *cache)
+{
+  webvtt_cached *cached, *next;
+  unsigned i;
+
+  if (cache == NULL)
+    return;
+  for (i = 0; i < BUCKETS; i++) {
+    for (cached = cache->buckets[i]; cached != NULL; cached = next) {
+      next = cached->next;
+      webvtt_cached_release(cached);
+    }
+  }
+  webvtt_epoch_destroy(&cache->epoch);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+const webvtt_store *
+  webvtt_cached_store(const webvtt_cached *cached)
+{
+  return cached->store;
+}
+
+const webvtt_header *
+  webvtt_cached_header(const webvtt_cached *cached)
+{
+  return cached->header;
+}
+
+static void touch(webvtt_cache *cache, webvtt_cached *cached) {
+  unsigned long now = __atomic_add_fetch(&cache->clock, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&cached->last_used, now, __ATOMIC_RELAXED);
+}
+
+/* the read path: no lock, only an epoch section around the walk */
+static webvtt_cached *lookup(webvtt_cache *cache, const cache_key *key) {
+  webvtt_cached *cached;
+  unsigned slot = webvtt_epoch_enter(&cache->epoch);
+
+  cached = __atomic_load_n(&cache->buckets[key->hash % BUCKETS],
+                           __ATOMIC_ACQUIRE);
+  for (; cached != NULL;
+       cached = __atomic_load_n(&cached->next, __ATOMIC_ACQUIRE)) {
+    if (same_key(&cached->key, key)) {
+      /* the cache's own reference is only dropped after every section
+      that could see the entry has ended, so refs is not 0 here */
+      __atomic_add_fetch(&cached->refs, 1, __ATOMIC_RELAXED);
+      touch(cache, cached);
+      break;
+    }
+  }
+  webvtt_epoch_leave(&cache->epoch, slot);
+  __atomic_add_fetch(cached ? &cache->hits : &cache->misses, 1,
+                     __ATOMIC_RELAXED);
+  return cached;
+}
+
+/* unlink the least recently used entry other than keep */
+static void evict_one(webvtt_cache *cache, const webvtt_cached *keep) {
+  webvtt_cached **link, **oldest = NULL, *victim;
+  unsigned long oldest_use = 0, use;
+  unsigned i;
+
+  for (i = 0; i < BUCKETS; i++) {
+    for (link = &cache->buckets[i]; *link != NULL; link = &(*link)->next) {
+      use = __atomic_load_n(&(*link)->last_used, __ATOMIC_RELAXED);
+      if (*link != keep && (oldest == NULL || use < oldest_use)) {
+        oldest = link;
+        oldest_use = use;
+      }
+    }
+  }
+  if (oldest == NULL)
+    return;
+  victim = *oldest;
+  __atomic_store_n(oldest, victim->next, __ATOMIC_RELEASE);
+  cache->bytes -= victim->bytes;
+  cache->entries--;
+  cache->evictions++;
+  webvtt_epoch_retire(&cache->epoch, &victim->retired);
+}
+
+/* publish a freshly parsed entry, or the one another thread published
+for the same key meanwhile. the caller's reference goes to the result */
+static webvtt_cached *insert(webvtt_cache *cache, webvtt_cached *fresh) {
+  webvtt_cached **bucket = &cache->buckets[fresh->key.hash % BUCKETS];
+  webvtt_cached *cached;
+
+  pthread_mutex_lock(&cache->lock);
+  for (cached = *bucket; cached != NULL; cached = cached->next) {
+    if (same_key(&cached->key, &fresh->key)) {
+      __atomic_add_fetch(&cached->refs, 1, __ATOMIC_RELAXED);
+      touch(cache, cached);
+      pthread_mutex_unlock(&cache->lock);
+      webvtt_cached_release(fresh);
+      return cached;
+    }
+  }
+  if (fresh->bytes <= cache->max_bytes) {
+    fresh->refs++;
+    touch(cache, fresh);
+    fresh->next = *bucket;
+    __atomic_store_n(bucket, fresh, __ATOMIC_RELEASE);
+    cache->bytes += fresh->bytes;
+    cache->entries++;
+    while (cache->bytes > cache->max_bytes)
+      evict_one(cache, fresh);
+  }
+  webvtt_epoch_collect(&cache->epoch);
+  pthread_mutex_unlock(&cache->lock);
+  return fresh;
+}
+
+/* parse and pack, the key's path or buffer is copied into the entry.
+the input is streamed, so a file of any size is parsed whole, and input
+that is not a track fails the one call instead of ending the process */
+static webvtt_cached *parse(const cache_key *key, const char *buffer,
+                            long length) {
+  size_t copy_length = key->path ? strlen(key->path) + 1 : key->size;
+  webvtt_cached *cached;
+  webvtt_parser *ctx;
+  webvtt_stream *stream = NULL;
+  webvtt_cue *head = NULL, *next;
+  int fd, r = -1;
+
+  cached = (webvtt_cached*)malloc(sizeof(*cached) + copy_length);
+  ctx = webvtt_parse_acquire();
+  if (cached == NULL || ctx == NULL ||
+      (stream = webvtt_stream_new(ctx)) == NULL) {
+    free(cached);
+    webvtt_parse_release(ctx);
+    return NULL;
+  }
+  webvtt_parse_set_format(ctx, key->format);
+  if (key->path) {
+    fd = open(key->path, O_RDONLY);
+    if (fd >= 0) {
+      r = webvtt_stream_read(stream, fd, 0);
+      close(fd);
+    }
+  } else if (webvtt_stream_feed(stream, buffer, length) == 0) {
+    r = webvtt_stream_finish(stream);
+  }
+  if (r == 0)
+    head = webvtt_stream_take(stream);
+  webvtt_stream_free(stream);
+  cached->header = webvtt_parse_take_header(ctx);
+  webvtt_parse_release(ctx);
+
+  cached->store = r < 0 ? NULL : webvtt_store_new(head, webvtt_timebase_ms);
+  for (; head != NULL; head = next) {
+    next = head->next;
+    webvtt_cue_free(head);
+  }
+  if (cached->store == NULL) {
+    webvtt_header_free(cached->header);
+    free(cached);
+    return NULL;
+  }
+  cached->retired.release = release_retired;
+  cached->next = NULL;
+  cached->key = *key;
+  if (key->path) {
+    memcpy(cached->copy, key->path, copy_length);
+    cached->key.path = cached->copy;
+  } else {
+    if (copy_length)
+      memcpy(cached->copy, key->data, copy_length);
+    cached->key.data = cached->copy;
+  }
+  cached->bytes = webvtt_store_size(cached->store) + sizeof(*cached) +
+    copy_length;
+  cached->refs = 1;
+  cached->last_used = 0;
+  return cached;
+}
+
+static webvtt_cached *find_or_parse(webvtt_cache *cache, const cache_key *key,
+                                    const char *buffer, long length) {
+  webvtt_cached *cached = lookup(cache, key);
+
+  if (cached)
+    return cached;
+  cached = parse(key, buffer, length);
+  return cached ? insert(cache, cached) : NULL;
+}
+
+webvtt_cached *
+  webvtt_cache_parse_buffer(webvtt_cache *cache, const char *buffer,
+                            long length, enum webvtt_format format)
+{
+  cache_key key;
+
+  key.hash = hash_bytes(buffer, length, format);
+  key.size = length;
+  key.mtime = 0;
+  key.path = NULL;
+  key.data = buffer;
+  key.format = format;
+  return find_or_parse(cache, &key, buffer, length);
+}
+
+webvtt_cached *
+  webvtt_cache_parse_filename(webvtt_cache *cache, const char *filename,
+                              enum webvtt_format format)
+{
+  struct stat st;
+  cache_key key;
+
+  if (stat(filename, &st) != 0)
+    return NULL;
+  key.size = st.st_size;
+  key.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  key.hash = hash_bytes(filename, strlen(filename), format) ^
+    mix(key.size ^ mix(key.mtime));
+  key.path = filename;
+  key.data = NULL;
+  key.format = format;
+  return find_or_parse(cache, &key, NULL, 0);
+}
+
+void
+  webvtt_cache_stats_get(webvtt_cache *cache, webvtt_cache_stats *stats)
+{
+  stats->hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+  stats->misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+  pthread_mutex_lock(&cache->lock);
+  stats->evictions = cache->evictions;
+  stats->entries = cache->entries;
+  stats->bytes = cache->bytes;
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,80 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_CACHE_H_
+#define _WEBVTT_CACHE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "webvtt.h"
+#include "webvtt_store.h"
+
+  /* in-process cache of parsed tracks, shared by every thread. buffers
+  are keyed by a 64 bit hash of their content and compared byte for byte
+  on a hit, so an entry keeps a copy of its buffer, which counts toward
+  the budget. files are keyed by path, size and modification time, so a
+  hit reads nothing. results are immutable compressed stores handed out
+  with a reference count. lookups take no lock; inserts and evictions
+  are serialized and free entries only once no lookup can still be
+  looking at them. the least recently used entries are evicted to keep
+  the stores under a byte budget */
+  typedef struct webvtt_cache webvtt_cache;
+
+  /* a shared parsed track */
+  typedef struct webvtt_cached webvtt_cached;
+
+  typedef struct webvtt_cache_stats webvtt_cache_stats;
+  struct webvtt_cache_stats {
+    unsigned long hits, misses;
+    unsigned long evictions;
+    unsigned entries;
+    size_t bytes;             /** held by the stores and entries cached */
+  };
+
+  /* NULL when out of memory */
+  webvtt_cache *webvtt_cache_new(size_t max_bytes);
+
+  /* no thread may be using the cache any more. results still held stay
+  valid until they are released */
+  void webvtt_cache_free(webvtt_cache *cache);
+
+  /* the cues of a file in the given format, timestamps in milliseconds.
+  parses on a miss, the whole file whatever its size, within the
+  parser's default limits. returns NULL when the file can't be read,
+  is not a track of that format, or out of memory; malformed input
+  never ends the process. a track larger than the budget is returned
+  but not kept */
+  webvtt_cached *webvtt_cache_parse_filename(webvtt_cache *cache,
+                                             const char *filename,
+                                             enum webvtt_format format);
+
+  webvtt_cached *webvtt_cache_parse_buffer(webvtt_cache *cache,
+                                           const char *buffer, long length,
+                                           enum webvtt_format format);
+
+  const webvtt_store *webvtt_cached_store(const webvtt_cached *cached);
+
+  /* the STYLE and REGION blocks the regions of the store's cues index
+  into, NULL when the track had none */
+  const webvtt_header *webvtt_cached_header(const webvtt_cached *cached);
+
+  /* drop a reference returned by the parse functions */
+  void webvtt_cached_release(webvtt_cached *cached);
+
+  void webvtt_cache_stats_get(webvtt_cache *cache, webvtt_cache_stats *stats);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_CACHE_H_ */
@@ -0,0 +1,153 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+
+#include "webvtt_coalesce.h"
+
+/* same text and same layout, the raw settings line may be spelt
+differently */
+static int same_cue(const webvtt_cue_view *a, const webvtt_cue_view *b) {
+  return a->text_length == b->text_length &&
+    a->vertical == b->vertical && a->align == b->align &&
+    a->lineAuto == b->lineAuto && a->snapToLine == b->snapToLine &&
+    a->line == b->line && a->position == b->position &&
+    a->size == b->size && a->pauseOnExit == b->pauseOnExit &&
+    a->region == b->region && memcmp(a->text, b->text, a->text_length) == 0;
+}
+
+static int folds(const webvtt_cue_view *earlier, const webvtt_cue_view *later,
+                 int64_t gap) {
+  return later->start <= earlier->end + gap && same_cue(earlier, later);
+}
+
+static void count(webvtt_coalesce_stats *stats, const webvtt_cue_view *view) {
+  stats->cues++;
+  stats->bytes += view->text_length + view->cueID_length +
+    view->settings_length;
+}
+
+unsigned
+  webvtt_track_coalesce(webvtt_track *track, int64_t gap,
+                        webvtt_coalesce_stats *stats)
+{
+  int64_t *start = track->start, *end = track->end;
+  webvtt_cue **cues = track->cues;
+  webvtt_cue_view kept, view;
+  unsigned i, k, removed;
+
+  if (track->count == 0)
+    return 0;
+  webvtt_cue_view_of(cues[0], &kept);
+  kept.start = start[0];
+  kept.end = end[0];
+  for (i = k = 1; i < track->count; i++) {
+    webvtt_cue_view_of(cues[i], &view);
+    view.start = start[i];
+    view.end = end[i];
+    if (folds(&kept, &view, gap)) {
+      if (end[i] > end[k - 1])
+        kept.end = end[k - 1] = end[i];
+      if (stats)
+        count(stats, &view);
+      webvtt_cue_free(cues[i]);
+      continue;
+    }
+    start[k] = start[i];
+    end[k] = end[i];
+    cues[k++] = cues[i];
+    kept = view;
+  }
+  removed = track->count - k;
+  track->count = k;
+  return removed;
+}
+
+/* copy the strings of view into one buffer and point view at them */
+static int hold(webvtt_buffer *copy, webvtt_cue_view *view) {
+  copy->length = 0;
+  if (webvtt_buffer_reserve(copy, view->text_length + view->cueID_length +
+                            view->settings_length + 1) < 0)
+    return -1;
+  webvtt_buffer_append(copy, view->text, view->text_length);
+  view->text = copy->data;
+  if (view->cueID) {
+    webvtt_buffer_append(copy, view->cueID, view->cueID_length);
+    view->cueID = copy->data + view->text_length;
+  }
+  if (view->settings) {
+    webvtt_buffer_append(copy, view->settings, view->settings_length);
+    view->settings = copy->data + copy->length - view->settings_length;
+  }
+  return 0;
+}
+
+static int coalesce_next(webvtt_cue_source *base, webvtt_cue_view *view) {
+  webvtt_coalesce_source *source = (webvtt_coalesce_source*)base;
+  webvtt_cue_source *inner = source->inner;
+  webvtt_cue_view next;
+  int r;
+
+  if (!source->has_pending) {
+    r = inner->next(inner, &source->pending);
+    if (r <= 0)
+      return r;
+    if (hold(&source->copies[source->current], &source->pending) < 0)
+      return -1;
+    source->has_pending = 1;
+  }
+
+  for (;;) {
+    r = inner->next(inner, &next);
+    if (r < 0)
+      return -1;
+    if (r == 0) {
+      source->has_pending = 0;
+      break;
+    }
+    if (!folds(&source->pending, &next, source->gap)) {
+      /* the output keeps the copy it points at until the next call,
+      the new pending cue goes into the other one */
+      if (hold(&source->copies[source->current ^ 1], &next) < 0)
+        return -1;
+      *view = source->pending;
+      source->pending = next;
+      source->current ^= 1;
+      return 1;
+    }
+    if (next.end > source->pending.end)
+      source->pending.end = next.end;
+    count(&source->stats, &next);
+  }
+  *view = source->pending;
+  return 1;
+}
+
+void
+  webvtt_coalesce_source_init(webvtt_coalesce_source *source,
+                              webvtt_cue_source *inner, int64_t gap)
+{
+  source->base.next = coalesce_next;
+  source->base.timebase = inner->timebase;
+  source->inner = inner;
+  source->gap = gap;
+  source->has_pending = 0;
+  source->current = 0;
+  webvtt_buffer_init(&source->copies[0]);
+  webvtt_buffer_init(&source->copies[1]);
+  source->stats.cues = 0;
+  source->stats.bytes = 0;
+}
+
+void
+  webvtt_coalesce_source_free(webvtt_coalesce_source *source)
+{
+  webvtt_buffer_free(&source->copies[0]);
+  webvtt_buffer_free(&source->copies[1]);
+}
@@ -0,0 +1,61 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_COALESCE_H_
+#define _WEBVTT_COALESCE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt_buffer.h"
+#include "webvtt_merge.h"
+#include "webvtt_track.h"
+
+  /* roll-up captions converted from 608 repeat the same cue over and
+  over with adjacent times. a cue is folded into the one before it when
+  both have the same text and layout and it starts no later than gap
+  ticks after the earlier one ends; the earlier cue is then stretched to
+  cover both and keeps its id */
+  typedef struct webvtt_coalesce_stats webvtt_coalesce_stats;
+  struct webvtt_coalesce_stats {
+    unsigned cues;        /** cues folded away */
+    size_t bytes;         /** text, id and settings bytes they held */
+  };
+
+  /* coalesce a track sorted by start time in place, freeing the folded
+  cues. stats, when not NULL, is added to. returns how many cues were
+  removed */
+  unsigned webvtt_track_coalesce(webvtt_track *track, int64_t gap,
+                                 webvtt_coalesce_stats *stats);
+
+  /* the same as a stream: a source that coalesces the cues of another
+  one as they go by. it holds one cue back, so memory does not grow */
+  typedef struct webvtt_coalesce_source webvtt_coalesce_source;
+  struct webvtt_coalesce_source {
+    webvtt_cue_source base;
+    webvtt_cue_source *inner;
+    int64_t gap;
+    webvtt_cue_view pending;
+    int has_pending;
+    unsigned current;           /** which copy holds pending */
+    webvtt_buffer copies[2];    /** strings of pending and of the last output */
+    webvtt_coalesce_stats stats;
+  };
+
+  void webvtt_coalesce_source_init(webvtt_coalesce_source *source,
+                                   webvtt_cue_source *inner, int64_t gap);
+
+  void webvtt_coalesce_source_free(webvtt_coalesce_source *source);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_COALESCE_H_ */
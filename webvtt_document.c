@@ -0,0 +1,343 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_document.h"
+#include "webvtt_buffer.h"
+#include "webvtt_utf8.h"
+
+/* a cue and its block, the text from offset up to the end of its last
+line. blocks holding no cue are not kept */
+typedef struct block block;
+struct block {
+  unsigned offset, length;
+  webvtt_cue *cue;
+};
+
+typedef struct block_list block_list;
+struct block_list {
+  block *blocks;
+  unsigned count, capacity;
+};
+
+struct webvtt_document {
+  webvtt_buffer text;
+  block_list cues;
+  /* ctx has parsed the whole text and holds its header. spare takes a
+  full parse, which only replaces ctx once it has succeeded */
+  webvtt_parser *ctx, *spare;
+  block_list parsed;        /* new blocks of an edit before they go in */
+  webvtt_buffer window;     /* the text they are parsed from */
+};
+
+static int list_reserve(block_list *list, unsigned more) {
+  unsigned capacity = list->capacity ? list->capacity : 16;
+  block *blocks;
+
+  if (list->capacity - list->count >= more)
+    return 0;
+  while (capacity - list->count < more)
+    capacity *= 2;
+  blocks = (block*)realloc(list->blocks, capacity * sizeof(block));
+  if (blocks == NULL)
+    return -1;
+  list->blocks = blocks;
+  list->capacity = capacity;
+  return 0;
+}
+
+static void list_clear(block_list *list) {
+  unsigned i;
+  for (i = 0; i < list->count; i++)
+    webvtt_cue_free(list->blocks[i].cue);
+  list->count = 0;
+}
+
+static webvtt_parser *new_parser(webvtt_timebase timebase,
+                                 webvtt_atoms *atoms) {
+  webvtt_parser *ctx = webvtt_parse_new();
+  if (ctx && webvtt_parse_set_timebase(ctx, timebase) < 0) {
+    webvtt_parse_free(ctx);
+    return NULL;
+  }
+  if (ctx)
+    webvtt_parse_set_atoms(ctx, atoms);
+  return ctx;
+}
+
+webvtt_document *
+  webvtt_document_new(webvtt_timebase timebase, webvtt_atoms *atoms)
+{
+  webvtt_document *doc = (webvtt_document*)calloc(1, sizeof(*doc));
+
+  if (doc == NULL)
+    return NULL;
+  webvtt_buffer_init(&doc->text);
+  webvtt_buffer_init(&doc->window);
+  if (webvtt_buffer_reserve(&doc->text, 1) < 0 ||
+      webvtt_buffer_reserve(&doc->window, 1) < 0) {
+    webvtt_document_free(doc);
+    return NULL;
+  }
+  doc->ctx = new_parser(timebase, atoms);
+  doc->spare = new_parser(timebase, atoms);
+  if (doc->ctx == NULL || doc->spare == NULL) {
+    webvtt_document_free(doc);
+    return NULL;
+  }
+  return doc;
+}
+
+void
+  webvtt_document_free(webvtt_document *doc)
+{
+  if (doc) {
+    list_clear(&doc->cues);
+    free(doc->cues.blocks);
+    free(doc->parsed.blocks);
+    webvtt_buffer_free(&doc->text);
+    webvtt_buffer_free(&doc->window);
+    webvtt_parse_free(doc->ctx);
+    webvtt_parse_free(doc->spare);
+    free(doc);
+  }
+}
+
+/* parse the blocks of s into doc->parsed, their offsets counted from
+base. returns -1 when out of memory, leaving parsed empty */
+static int parse_blocks(webvtt_document *doc, webvtt_parser *ctx,
+                        const char *s, unsigned length, unsigned base) {
+  unsigned start = 0, end;
+  webvtt_cue *cue;
+  block *b;
+
+  doc->parsed.count = 0;
+  for (;;) {
+    end = webvtt_next_block(s, length, &start);
+    if (start == length)
+      return 0;
+    if (webvtt_parse_block(ctx, s + start, end - start, &cue) < 0) {
+      /* in the signature block that only means this is no WebVTT */
+      if (ctx == doc->spare && doc->parsed.count == 0 && start == 0)
+        return 0;
+      break;
+    }
+    if (cue) {
+      if (list_reserve(&doc->parsed, 1) < 0) {
+        webvtt_cue_free(cue);
+        break;
+      }
+      b = doc->parsed.blocks + doc->parsed.count++;
+      b->offset = base + start;
+      b->length = end - start;
+      b->cue = cue;
+    }
+    start = end;
+  }
+  list_clear(&doc->parsed);
+  return -1;
+}
+
+/* parse the whole text with the spare context, then make it current */
+static int parse_all(webvtt_document *doc, const char *s, unsigned length) {
+  webvtt_parser *ctx = doc->spare;
+  block_list list;
+
+  webvtt_parse_reset(ctx);
+  if (parse_blocks(doc, ctx, s, length, 0) < 0)
+    return -1;
+  list = doc->cues;
+  doc->cues = doc->parsed;
+  doc->parsed = list;
+  list_clear(&doc->parsed);
+  doc->spare = doc->ctx;
+  doc->ctx = ctx;
+  return 0;
+}
+
+int
+  webvtt_document_load(webvtt_document *doc, const char *text,
+                       unsigned length)
+{
+  webvtt_buffer fixed;
+  int r;
+
+  webvtt_buffer_init(&fixed);
+  r = webvtt_to_utf8(text, length, &fixed);
+  if (r == 1) {
+    text = fixed.data;
+    length = fixed.length;
+  }
+  if (r < 0 || parse_all(doc, text, length) < 0) {
+    webvtt_buffer_free(&fixed);
+    return -1;
+  }
+  doc->text.length = 0;
+  r = webvtt_buffer_append(&doc->text, text, length);
+  webvtt_buffer_free(&fixed);
+  if (r < 0) {
+    /* the cues are already those of the new text */
+    list_clear(&doc->cues);
+    return -1;
+  }
+  return 0;
+}
+
+/* the first cue whose block starts after offset */
+static unsigned cue_after(const block_list *list, unsigned offset) {
+  unsigned lo = 0, hi = list->count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (list->blocks[mid].offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* whether a whole blank line lies between from and to, which keeps
+what is after it out of anything an edit ending at from does */
+static int blank_line_between(const char *s, unsigned from, unsigned to) {
+  for (;;) {
+    while (from < to && !isNewline(s[from]))
+      from++;
+    if (from == to)
+      return 0;
+    from += (s[from] == '\r' && from + 1 < to && s[from + 1] == '\n') ? 2 : 1;
+    while (from < to && isASpace(s[from]))
+      from++;
+    if (from < to && isNewline(s[from]))
+      return 1;
+  }
+}
+
+int
+  webvtt_document_edit(webvtt_document *doc, unsigned offset,
+                       unsigned deleted, const char *inserted,
+                       unsigned inserted_length,
+                       webvtt_document_change *change)
+{
+  char *s;
+  unsigned length = doc->text.length, end, first, last, from, to, i;
+  webvtt_document_change dummy;
+  long delta = (long)inserted_length - (long)deleted;
+
+  if (change == NULL)
+    change = &dummy;
+  if (offset > length || deleted > length - offset)
+    return -1;
+  if (inserted_length == 0)
+    inserted = "";
+  end = offset + deleted;
+  /* room for the new text up front, the edit cannot fail half way */
+  if (webvtt_buffer_reserve(&doc->text, inserted_length) < 0)
+    return -1;
+  s = doc->text.data;
+
+  /* the blocks touched, from the last one starting at or before the
+  edit to the first one with a blank line between it and the edit */
+  first = cue_after(&doc->cues, offset);
+  last = cue_after(&doc->cues, end);
+  while (last < doc->cues.count &&
+         !blank_line_between(s, end, doc->cues.blocks[last].offset))
+    last++;
+
+  if (first <= 1) {
+    /* the header or the first cue */
+    doc->window.length = 0;
+    if (webvtt_buffer_append(&doc->window, s, offset) < 0 ||
+        webvtt_buffer_append(&doc->window, inserted, inserted_length) < 0 ||
+        webvtt_buffer_append(&doc->window, s + end, length - end) < 0)
+      return -1;
+    change->first = 0;
+    change->removed = doc->cues.count;
+    if (parse_all(doc, doc->window.data, doc->window.length) < 0)
+      return -1;
+    change->inserted = doc->cues.count;
+  } else {
+    first--;
+    from = doc->cues.blocks[first].offset;
+    to = last < doc->cues.count ? doc->cues.blocks[last].offset : length;
+
+    /* the window as it will be, parsed on the side so that running out
+    of memory leaves the document as it was */
+    doc->window.length = 0;
+    if (webvtt_buffer_append(&doc->window, s + from, offset - from) < 0 ||
+        webvtt_buffer_append(&doc->window, inserted, inserted_length) < 0 ||
+        webvtt_buffer_append(&doc->window, s + end, to - end) < 0)
+      return -1;
+    if (parse_blocks(doc, doc->ctx, doc->window.data, doc->window.length,
+                     from) < 0)
+      return -1;
+    if (list_reserve(&doc->cues, doc->parsed.count) < 0) {
+      list_clear(&doc->parsed);
+      return -1;
+    }
+
+    for (i = first; i < last; i++)
+      webvtt_cue_free(doc->cues.blocks[i].cue);
+    memmove(doc->cues.blocks + first + doc->parsed.count,
+            doc->cues.blocks + last,
+            (doc->cues.count - last) * sizeof(block));
+    memcpy(doc->cues.blocks + first, doc->parsed.blocks,
+           doc->parsed.count * sizeof(block));
+    doc->cues.count += doc->parsed.count - (last - first);
+    for (i = first + doc->parsed.count; i < doc->cues.count; i++)
+      doc->cues.blocks[i].offset += delta;
+
+    change->first = first;
+    change->removed = last - first;
+    change->inserted = doc->parsed.count;
+    doc->parsed.count = 0;
+  }
+
+  memmove(s + offset + inserted_length, s + end, length - end);
+  memcpy(s + offset, inserted, inserted_length);
+  doc->text.length = length + delta;
+  return 0;
+}
+
+const char *
+  webvtt_document_text(const webvtt_document *doc, unsigned *length)
+{
+  *length = doc->text.length;
+  return doc->text.data;
+}
+
+unsigned
+  webvtt_document_cue_count(const webvtt_document *doc)
+{
+  return doc->cues.count;
+}
+
+const webvtt_cue *
+  webvtt_document_cue(const webvtt_document *doc, unsigned index,
+                      unsigned *offset, unsigned *length)
+{
+  const block *b;
+
+  if (index >= doc->cues.count)
+    return NULL;
+  b = doc->cues.blocks + index;
+  if (offset)
+    *offset = b->offset;
+  if (length)
+    *length = b->length;
+  return b->cue;
+}
+
+const webvtt_header *
+  webvtt_document_header(const webvtt_document *doc)
+{
+  return webvtt_parse_header(doc->ctx);
+}
@@ -0,0 +1,81 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_DOCUMENT_H_
+#define _WEBVTT_DOCUMENT_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+
+  /* a file being edited: its text and the cues parsed from it. an edit
+  replaces a byte range and parses again only the blocks it touched,
+  widened to the blank lines around them, so a keystroke costs about
+  one cue however long the file is. edits in the header or the first
+  cue parse the whole file again, everything after them depends on it */
+
+  typedef struct webvtt_document webvtt_document;
+
+  /* what an edit did to the cues: from first on, removed of them were
+  replaced by inserted new ones. the cues after moved, their text
+  offsets shifted by the change in length */
+  typedef struct webvtt_document_change webvtt_document_change;
+  struct webvtt_document_change {
+    unsigned first;
+    unsigned removed;
+    unsigned inserted;
+  };
+
+  /* an empty document. cue timestamps are in ticks of timebase, ids
+  and settings are interned in atoms unless it is NULL. NULL when out
+  of memory or when timebase has a zero in it */
+  webvtt_document *webvtt_document_new(webvtt_timebase timebase,
+                                       webvtt_atoms *atoms);
+
+  void webvtt_document_free(webvtt_document *doc);
+
+  /* replace the whole text. UTF-16 and ill formed UTF-8 are converted
+  first; offsets from then on are into the converted text. text that
+  is not WebVTT is kept but holds no cues. returns -1 when out of
+  memory, the document is untouched then */
+  int webvtt_document_load(webvtt_document *doc, const char *text,
+                           unsigned length);
+
+  /* replace deleted bytes at offset with inserted ones, which must be
+  UTF-8, and tell in change, which may be NULL, what became of the
+  cues. returns -1 when the range is not in the text or when out of
+  memory, the document is untouched then */
+  int webvtt_document_edit(webvtt_document *doc, unsigned offset,
+                           unsigned deleted, const char *inserted,
+                           unsigned inserted_length,
+                           webvtt_document_change *change);
+
+  /* the current text, not NUL terminated */
+  const char *webvtt_document_text(const webvtt_document *doc,
+                                   unsigned *length);
+
+  unsigned webvtt_document_cue_count(const webvtt_document *doc);
+
+  /* a cue and where its block is in the text, offset and length may be
+  NULL. valid until the next edit or load */
+  const webvtt_cue *webvtt_document_cue(const webvtt_document *doc,
+                                        unsigned index, unsigned *offset,
+                                        unsigned *length);
+
+  /* the STYLE and REGION blocks, which the cue regions index into,
+  NULL when there are none */
+  const webvtt_header *webvtt_document_header(const webvtt_document *doc);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_DOCUMENT_H_ */
@@ -0,0 +1,98 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stddef.h>
+
+#include "webvtt_epoch.h"
+
+/* readers count themselves under the parity of the epoch they saw.
+the epoch only moves from e to e + 1 once no reader of e - 1 is left,
+so at any time readers are in the current epoch or the one before.
+what was retired in e - 1 can go when the readers of e - 1 are gone:
+a reader of e could not have found it any more */
+
+void
+  webvtt_epoch_init(webvtt_epoch *epoch)
+{
+  epoch->epoch = 0;
+  epoch->readers[0] = 0;
+  epoch->readers[1] = 0;
+  epoch->limbo[0] = NULL;
+  epoch->limbo[1] = NULL;
+}
+
+static void release_list(webvtt_retired *object) {
+  webvtt_retired *next;
+
+  for (; object != NULL; object = next) {
+    next = object->next;
+    object->release(object);
+  }
+}
+
+void
+  webvtt_epoch_destroy(webvtt_epoch *epoch)
+{
+  release_list(epoch->limbo[0]);
+  release_list(epoch->limbo[1]);
+  epoch->limbo[0] = NULL;
+  epoch->limbo[1] = NULL;
+}
+
+unsigned
+  webvtt_epoch_enter(webvtt_epoch *epoch)
+{
+  unsigned long e;
+  unsigned slot;
+
+  for (;;) {
+    e = __atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST);
+    slot = (unsigned)(e & 1);
+    __atomic_add_fetch(&epoch->readers[slot], 1, __ATOMIC_SEQ_CST);
+    /* the epoch moved on before we were counted, a writer may already
+    have decided that nobody is left in it */
+    if (__atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST) == e)
+      return slot;
+    __atomic_sub_fetch(&epoch->readers[slot], 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+void
+  webvtt_epoch_leave(webvtt_epoch *epoch, unsigned slot)
+{
+  __atomic_sub_fetch(&epoch->readers[slot], 1, __ATOMIC_RELEASE);
+}
+
+void
+  webvtt_epoch_collect(webvtt_epoch *epoch)
+{
+  unsigned long e = __atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST);
+  unsigned previous = (unsigned)((e + 1) & 1);
+  webvtt_retired *ready;
+
+  if (__atomic_load_n(&epoch->readers[previous], __ATOMIC_ACQUIRE) != 0)
+    return;
+  /* every reader of e - 1 has left: its retirements can go, and the
+  epoch can advance, which reuses the parity of e - 1 */
+  ready = epoch->limbo[previous];
+  epoch->limbo[previous] = NULL;
+  __atomic_store_n(&epoch->epoch, e + 1, __ATOMIC_SEQ_CST);
+  release_list(ready);
+}
+
+void
+  webvtt_epoch_retire(webvtt_epoch *epoch, webvtt_retired *object)
+{
+  unsigned slot = (unsigned)(__atomic_load_n(&epoch->epoch,
+                                             __ATOMIC_RELAXED) & 1);
+
+  object->next = epoch->limbo[slot];
+  epoch->limbo[slot] = object;
+  webvtt_epoch_collect(epoch);
+}
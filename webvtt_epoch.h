@@ -0,0 +1,58 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_EPOCH_H_
+#define _WEBVTT_EPOCH_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+  /* epoch based reclamation for structures read without locks. readers
+  bracket their accesses with enter and leave, which never block. a
+  writer unlinks an object so no new reader can reach it, then retires
+  it; it is released once every reader that could still see it has
+  left. writers must be serialized by the caller */
+
+  /* embedded in every object that gets retired */
+  typedef struct webvtt_retired webvtt_retired;
+  struct webvtt_retired {
+    webvtt_retired *next;
+    void (*release)(webvtt_retired *object);
+  };
+
+  typedef struct webvtt_epoch webvtt_epoch;
+  struct webvtt_epoch {
+    unsigned long epoch;
+    unsigned long readers[2];   /** by parity of the epoch entered */
+    webvtt_retired *limbo[2];   /** by parity of the epoch retired in */
+  };
+
+  void webvtt_epoch_init(webvtt_epoch *epoch);
+
+  /* release everything retired. there must be no readers left */
+  void webvtt_epoch_destroy(webvtt_epoch *epoch);
+
+  /* start a read side section, pass what it returns to leave */
+  unsigned webvtt_epoch_enter(webvtt_epoch *epoch);
+
+  void webvtt_epoch_leave(webvtt_epoch *epoch, unsigned slot);
+
+  /* hand over an object no reader can reach any more, and release what
+  has become safe to release */
+  void webvtt_epoch_retire(webvtt_epoch *epoch, webvtt_retired *object);
+
+  /* release what has become safe to release, without retiring more */
+  void webvtt_epoch_collect(webvtt_epoch *epoch);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_EPOCH_H_ */
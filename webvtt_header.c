@@ -0,0 +1,268 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_header.h"
+
+#define INITIAL_CAPACITY 4
+
+webvtt_header *
+  webvtt_header_new(webvtt_atoms *atoms)
+{
+  webvtt_header *header = (webvtt_header*)calloc(1, sizeof(*header));
+
+  if (header == NULL)
+    return NULL;
+  header->atoms = atoms;
+  if (atoms == NULL) {
+    header->atoms = webvtt_atoms_new();
+    header->own_atoms = 1;
+    if (header->atoms == NULL) {
+      free(header);
+      return NULL;
+    }
+  }
+  webvtt_arena_init(&header->arena);
+  return header;
+}
+
+void
+  webvtt_header_free(webvtt_header *header)
+{
+  if (header) {
+    free(header->regions);
+    free(header->styles);
+    free(header->by_atom);
+    if (header->own_atoms)
+      webvtt_atoms_free(header->atoms);
+    webvtt_arena_free(&header->arena);
+    free(header);
+  }
+}
+
+static int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/* a whole number percentage, any fraction is dropped. returns -1 when
+s is not a percentage between 0 and 100 */
+static int parse_percent(const char *s, const char *end, short *out) {
+  int value = 0, digits = 0;
+
+  while (s < end && *s >= '0' && *s <= '9') {
+    if (value <= 100)
+      value = value * 10 + (*s - '0');
+    s++;
+    digits++;
+  }
+  if (s < end && *s == '.') {
+    s++;
+    while (s < end && *s >= '0' && *s <= '9')
+      s++;
+  }
+  if (!digits || s + 1 != end || *s != '%' || value > 100)
+    return -1;
+  *out = (short)value;
+  return 0;
+}
+
+/* x%,y% */
+static int parse_anchor(const char *s, const char *end, short *x, short *y) {
+  const char *comma = (const char*)memchr(s, ',', end - s);
+  short a, b;
+
+  if (comma == NULL || parse_percent(s, comma, &a) < 0 ||
+      parse_percent(comma + 1, end, &b) < 0)
+    return -1;
+  *x = a;
+  *y = b;
+  return 0;
+}
+
+static int parse_count(const char *s, const char *end, short *out) {
+  int value = 0;
+
+  if (s == end)
+    return -1;
+  for (; s < end; s++) {
+    if (*s < '0' || *s > '9')
+      return -1;
+    if (value <= 32767)
+      value = value * 10 + (*s - '0');
+  }
+  if (value > 32767)
+    return -1;
+  *out = (short)value;
+  return 0;
+}
+
+/* ids may not contain "-->" */
+static int has_arrow(const char *s, const char *end) {
+  for (; end - s >= 3; s++) {
+    if (s[0] == '-' && s[1] == '-' && s[2] == '>')
+      return 1;
+  }
+  return 0;
+}
+
+static int is_name(const char *name, const char *s, const char *end) {
+  size_t n = strlen(name);
+  return (size_t)(end - s) == n && memcmp(name, s, n) == 0;
+}
+
+/* remember which region an atom names, growing the map as needed */
+static int map_region(webvtt_header *header, webvtt_atom atom,
+                      unsigned index) {
+  unsigned short *by_atom;
+  unsigned size;
+
+  if (atom >= header->by_atom_size) {
+    size = header->by_atom_size ? header->by_atom_size : 16;
+    while (size <= atom)
+      size *= 2;
+    by_atom = (unsigned short*)realloc(header->by_atom,
+                                       size * sizeof(*by_atom));
+    if (by_atom == NULL)
+      return -1;
+    memset(by_atom + header->by_atom_size, 0,
+           (size - header->by_atom_size) * sizeof(*by_atom));
+    header->by_atom = by_atom;
+    header->by_atom_size = size;
+  }
+  header->by_atom[atom] = (unsigned short)(index + 1);
+  return 0;
+}
+
+int
+  webvtt_header_add_region(webvtt_header *header, const char *settings,
+                           unsigned length)
+{
+  const char *p = settings, *end = settings + length, *word, *colon;
+  webvtt_region region, *regions;
+  unsigned capacity, index;
+
+  region.id = WEBVTT_NO_ATOM;
+  region.width = 100;
+  region.lines = 3;
+  region.region_anchor_x = 0;
+  region.region_anchor_y = 100;
+  region.viewport_anchor_x = 0;
+  region.viewport_anchor_y = 100;
+  region.scroll = WEBVTT_SCROLL_NONE;
+
+  /* name:value words, anything unknown or malformed is ignored */
+  while (p < end) {
+    while (p < end && is_space(*p))
+      p++;
+    word = p;
+    while (p < end && !is_space(*p))
+      p++;
+    colon = (const char*)memchr(word, ':', p - word);
+    if (colon == NULL || colon == word || colon + 1 == p)
+      continue;
+    if (is_name("id", word, colon)) {
+      if (!has_arrow(colon + 1, p)) {
+        region.id = webvtt_atom_intern(header->atoms, colon + 1,
+                                       p - colon - 1);
+        if (region.id == WEBVTT_NO_ATOM)
+          return -1;
+      }
+    } else if (is_name("width", word, colon)) {
+      parse_percent(colon + 1, p, &region.width);
+    } else if (is_name("lines", word, colon)) {
+      parse_count(colon + 1, p, &region.lines);
+    } else if (is_name("regionanchor", word, colon)) {
+      parse_anchor(colon + 1, p, &region.region_anchor_x,
+                   &region.region_anchor_y);
+    } else if (is_name("viewportanchor", word, colon)) {
+      parse_anchor(colon + 1, p, &region.viewport_anchor_x,
+                   &region.viewport_anchor_y);
+    } else if (is_name("scroll", word, colon)) {
+      if (is_name("up", colon + 1, p))
+        region.scroll = WEBVTT_SCROLL_UP;
+    }
+  }
+  if (region.id == WEBVTT_NO_ATOM)
+    return 0;
+
+  if (region.id < header->by_atom_size && header->by_atom[region.id]) {
+    header->regions[header->by_atom[region.id] - 1] = region;
+    return 0;
+  }
+  if (header->region_count == header->region_capacity) {
+    capacity = header->region_capacity ? header->region_capacity * 2 :
+      INITIAL_CAPACITY;
+    regions = (webvtt_region*)realloc(header->regions,
+                                      capacity * sizeof(*regions));
+    if (regions == NULL)
+      return -1;
+    header->regions = regions;
+    header->region_capacity = capacity;
+  }
+  index = header->region_count;
+  if (index >= 65535 || map_region(header, region.id, index) < 0)
+    return -1;
+  header->regions[index] = region;
+  header->region_count++;
+  return 0;
+}
+
+int
+  webvtt_header_add_style(webvtt_header *header, const char *text,
+                          unsigned length)
+{
+  webvtt_style *styles;
+  unsigned capacity;
+  char *copy;
+
+  if (header->style_count == header->style_capacity) {
+    capacity = header->style_capacity ? header->style_capacity * 2 :
+      INITIAL_CAPACITY;
+    styles = (webvtt_style*)realloc(header->styles,
+                                    capacity * sizeof(*styles));
+    if (styles == NULL)
+      return -1;
+    header->styles = styles;
+    header->style_capacity = capacity;
+  }
+  copy = webvtt_arena_strndup(&header->arena, text, length);
+  if (copy == NULL)
+    return -1;
+  header->styles[header->style_count].text = copy;
+  header->styles[header->style_count].length = length;
+  header->style_count++;
+  return 0;
+}
+
+const char *
+  webvtt_header_region_id(const webvtt_header *header, unsigned region,
+                          unsigned *length)
+{
+  if (header == NULL || region == 0 || region > header->region_count)
+    return NULL;
+  return webvtt_atom_string(header->atoms, header->regions[region - 1].id,
+                            length);
+}
+
+int
+  webvtt_header_find_region(const webvtt_header *header, const char *id,
+                            unsigned length)
+{
+  webvtt_atom atom;
+
+  if (id == NULL || header->by_atom_size == 0)
+    return -1;
+  atom = webvtt_atom_find(header->atoms, id, length);
+  if (atom == WEBVTT_NO_ATOM || atom >= header->by_atom_size ||
+      header->by_atom[atom] == 0)
+    return -1;
+  return header->by_atom[atom] - 1;
+}
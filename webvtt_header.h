@@ -0,0 +1,92 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_HEADER_H_
+#define _WEBVTT_HEADER_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt_arena.h"
+#include "webvtt_atoms.h"
+
+  enum webvtt_scroll {
+    WEBVTT_SCROLL_NONE = 0,
+    WEBVTT_SCROLL_UP
+  };
+
+  /* a REGION block. percentages are whole numbers, like the cue
+  settings */
+  typedef struct webvtt_region webvtt_region;
+  struct webvtt_region {
+    webvtt_atom id;
+    short width;              /** percentage of the viewport */
+    short lines;
+    short region_anchor_x;    /** percentages of the region */
+    short region_anchor_y;
+    short viewport_anchor_x;  /** percentages of the viewport */
+    short viewport_anchor_y;
+    unsigned char scroll;     /** enum webvtt_scroll */
+  };
+
+  /* a STYLE block, the css text as written */
+  typedef struct webvtt_style webvtt_style;
+  struct webvtt_style {
+    const char *text;
+    unsigned length;
+  };
+
+  /* everything a file declares before its first cue. cues refer to
+  their region by index, so nothing on the draw path looks a region up
+  by name */
+  typedef struct webvtt_header webvtt_header;
+  struct webvtt_header {
+    webvtt_region *regions;
+    unsigned region_count, region_capacity;
+    webvtt_style *styles;
+    unsigned style_count, style_capacity;
+    webvtt_atoms *atoms;        /** region ids are interned here */
+    int own_atoms;
+    unsigned short *by_atom;    /** region index + 1 for each atom */
+    unsigned by_atom_size;
+    webvtt_arena arena;         /** style text */
+  };
+
+  /* an empty header interning region ids in atoms, which must outlive
+  it, or in a table of its own when atoms is NULL */
+  webvtt_header *webvtt_header_new(webvtt_atoms *atoms);
+
+  void webvtt_header_free(webvtt_header *header);
+
+  /* add a region from the settings of a REGION block. a region without
+  an id cannot be referred to and is dropped; a later region with the
+  same id replaces the earlier one. returns -1 when out of memory */
+  int webvtt_header_add_region(webvtt_header *header, const char *settings,
+                               unsigned length);
+
+  /* keep a copy of a STYLE block. returns -1 when out of memory */
+  int webvtt_header_add_style(webvtt_header *header, const char *text,
+                              unsigned length);
+
+  /* the id of a cue's region, given as the cue holds it: the region
+  index + 1, 0 for none. NULL when there is no such region, header
+  may be NULL too. length may be NULL */
+  const char *webvtt_header_region_id(const webvtt_header *header,
+                                      unsigned region, unsigned *length);
+
+  /* the index of the region with the given id, -1 when there is none */
+  int webvtt_header_find_region(const webvtt_header *header,
+                                const char *id, unsigned length);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_HEADER_H_ */
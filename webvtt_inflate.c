@@ -0,0 +1,219 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef WEBVTT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "webvtt_inflate.h"
+
+/* compressed bytes read at a time */
+#define IN_SIZE (64 * 1024)
+
+typedef struct inflater inflater;
+struct inflater {
+  int fd;
+  unsigned char in[IN_SIZE];
+  size_t in_pos, in_length; /* read and not yet decompressed */
+  int eof;
+  z_stream z;
+  int finished;             /* a gzip member has ended */
+#ifdef WEBVTT_HAVE_ZSTD
+  ZSTD_DStream *zstd;
+  size_t hint;              /* 0 once a zstd frame is complete */
+#endif
+};
+
+enum webvtt_compression
+  webvtt_detect_compression(const char *s, size_t length)
+{
+  const unsigned char *u = (const unsigned char*)s;
+
+  if (length >= 2 && u[0] == 0x1f && u[1] == 0x8b)
+    return WEBVTT_COMPRESSION_GZIP;
+  if (length >= 4 && u[0] == 0x28 && u[1] == 0xb5 && u[2] == 0x2f &&
+      u[3] == 0xfd)
+    return WEBVTT_COMPRESSION_ZSTD;
+  return WEBVTT_COMPRESSION_NONE;
+}
+
+int
+  webvtt_compression_supported(enum webvtt_compression compression)
+{
+#ifndef WEBVTT_HAVE_ZSTD
+  if (compression == WEBVTT_COMPRESSION_ZSTD)
+    return 0;
+#endif
+  return 1;
+}
+
+/* read more once everything read has been used, until the end */
+static int refill(inflater *f) {
+  ssize_t n;
+
+  if (f->in_pos < f->in_length || f->eof)
+    return 0;
+  do {
+    n = read(f->fd, f->in, IN_SIZE);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0)
+    return -1;
+  f->in_pos = 0;
+  f->in_length = n;
+  f->eof = n == 0;
+  return 0;
+}
+
+/* read until the magic numbers can be told apart, however short the
+reads a pipe gives, or until the end */
+static int sniff(inflater *f) {
+  ssize_t n;
+
+  while (f->in_length < 4 && !f->eof) {
+    do {
+      n = read(f->fd, f->in + f->in_length, IN_SIZE - f->in_length);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      return -1;
+    f->in_length += n;
+    f->eof = n == 0;
+  }
+  return 0;
+}
+
+static ssize_t fill_plain(void *data, char *buf, size_t size) {
+  inflater *f = (inflater*)data;
+  size_t done = 0, n;
+
+  while (done < size) {
+    if (refill(f) < 0)
+      return -1;
+    if (f->in_pos == f->in_length)
+      break;
+    n = f->in_length - f->in_pos;
+    if (n > size - done)
+      n = size - done;
+    memcpy(buf + done, f->in + f->in_pos, n);
+    f->in_pos += n;
+    done += n;
+  }
+  return done;
+}
+
+/* gzip members one after another, as gzip itself writes appended
+files, decompress to their concatenation */
+static ssize_t fill_gzip(void *data, char *buf, size_t size) {
+  inflater *f = (inflater*)data;
+  z_stream *z = &f->z;
+  int r;
+
+  z->next_out = (Bytef*)buf;
+  z->avail_out = size;
+  while (z->avail_out > 0) {
+    if (refill(f) < 0)
+      return -1;
+    if (f->finished) {
+      if (f->in_pos == f->in_length)
+        break;
+      if (inflateReset(z) != Z_OK)
+        return -1;
+      f->finished = 0;
+    }
+    z->next_in = f->in + f->in_pos;
+    z->avail_in = f->in_length - f->in_pos;
+    r = inflate(z, Z_NO_FLUSH);
+    f->in_pos = f->in_length - z->avail_in;
+    if (r == Z_STREAM_END)
+      f->finished = 1;
+    else if (r == Z_BUF_ERROR && f->eof)
+      return -1;            /* cut short */
+    else if (r != Z_OK && r != Z_BUF_ERROR)
+      return -1;
+  }
+  return size - z->avail_out;
+}
+
+#ifdef WEBVTT_HAVE_ZSTD
+static ssize_t fill_zstd(void *data, char *buf, size_t size) {
+  inflater *f = (inflater*)data;
+  ZSTD_outBuffer out = { buf, size, 0 };
+  ZSTD_inBuffer in;
+  size_t before, r;
+
+  while (out.pos < out.size) {
+    if (refill(f) < 0)
+      return -1;
+    if (f->in_pos == f->in_length && f->hint == 0)
+      break;
+    in.src = f->in + f->in_pos;
+    in.size = f->in_length - f->in_pos;
+    in.pos = 0;
+    before = out.pos;
+    r = ZSTD_decompressStream(f->zstd, &out, &in);
+    if (ZSTD_isError(r))
+      return -1;
+    f->in_pos += in.pos;
+    f->hint = r;
+    if (f->eof && in.pos == 0 && out.pos == before)
+      return -1;            /* cut short */
+  }
+  return out.pos;
+}
+#endif
+
+int
+  webvtt_stream_read_compressed(webvtt_stream *stream, int fd, int overlap)
+{
+  inflater *f = (inflater*)calloc(1, sizeof(*f));
+  webvtt_stream_source fill = fill_plain;
+  int result = -1;
+
+  if (f == NULL)
+    return -1;
+  f->fd = fd;
+  if (sniff(f) < 0)
+    goto done;
+  switch (webvtt_detect_compression((const char*)f->in, f->in_length)) {
+  case WEBVTT_COMPRESSION_GZIP:
+    /* 16 + the largest window: gzip framing only */
+    if (inflateInit2(&f->z, 16 + MAX_WBITS) != Z_OK)
+      goto done;
+    fill = fill_gzip;
+    break;
+  case WEBVTT_COMPRESSION_ZSTD:
+#ifdef WEBVTT_HAVE_ZSTD
+    f->zstd = ZSTD_createDStream();
+    if (f->zstd == NULL || ZSTD_isError(ZSTD_initDStream(f->zstd)))
+      goto done;
+    f->hint = 1;
+    fill = fill_zstd;
+    break;
+#else
+    errno = ENOTSUP;
+    goto done;
+#endif
+  default:
+    break;
+  }
+  result = webvtt_stream_pull(stream, fill, f, overlap);
+
+done:
+  if (fill == fill_gzip)
+    inflateEnd(&f->z);
+#ifdef WEBVTT_HAVE_ZSTD
+  ZSTD_freeDStream(f->zstd);
+#endif
+  free(f);
+  return result;
+}
@@ -0,0 +1,51 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_INFLATE_H_
+#define _WEBVTT_INFLATE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "webvtt_stream.h"
+
+  /* compressed input, decompressed a buffer at a time straight into a
+  stream: neither the whole file nor a temporary copy of it is ever
+  made. gzip needs zlib; zstd is only there when built with
+  WEBVTT_HAVE_ZSTD and libzstd */
+
+  enum webvtt_compression {
+    WEBVTT_COMPRESSION_NONE = 0,
+    WEBVTT_COMPRESSION_GZIP,
+    WEBVTT_COMPRESSION_ZSTD
+  };
+
+  /* from the magic number at the start of s */
+  enum webvtt_compression webvtt_detect_compression(const char *s,
+                                                    size_t length);
+
+  /* whether this build can decompress the format */
+  int webvtt_compression_supported(enum webvtt_compression compression);
+
+  /* feed what is read from fd to stream, decompressed when it starts
+  with a gzip or zstd magic number and as it is otherwise. fd may be a
+  pipe or socket. with overlap, reading and decompressing run on a
+  second thread while the stream parses. returns -1 on a read error,
+  corrupt or truncated data, a format not built in, or a failed feed */
+  int webvtt_stream_read_compressed(webvtt_stream *stream, int fd,
+                                    int overlap);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_INFLATE_H_ */
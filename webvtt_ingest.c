@@ -0,0 +1,592 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "webvtt_ingest.h"
+#include "webvtt_pool.h"
+#include "webvtt_stream.h"
+
+/* the fallback is also taken at run time when the kernel says no,
+WEBVTT_NO_IO_URING leaves io_uring out of the build */
+#if defined(__linux__) && !defined(WEBVTT_NO_IO_URING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#if defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+/* files being opened or read at once */
+#define MAX_INFLIGHT 64
+/* files read and waiting for a parser, and the bytes of the files read
+or being read, which bound the memory held when reading outruns
+parsing. a file larger than that is still read, on its own */
+#define MAX_QUEUED 256
+#define MAX_HELD (64 * 1024 * 1024)
+/* a file is handed to its stream a piece at a time, so the stream
+holds a block of it at most and not a second copy */
+#define FEED_SIZE (64 * 1024)
+
+typedef struct job job;
+struct job {
+  unsigned index;
+  int fd;
+  int error;
+  int done;                 /* read, or failed */
+  unsigned pending;         /* of open and statx, still to complete */
+  char *data;
+  size_t length, capacity;  /* a read that fills it was not the last */
+  job *next;                /* in the parse queue */
+#if HAVE_IO_URING
+  struct statx stx;
+#endif
+};
+
+typedef struct batch batch;
+struct batch {
+  const char *const *filenames;
+  const webvtt_ingest_options *options;
+  webvtt_ingest_result *results;
+  job *jobs;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;     /* a job was queued, or the end */
+  pthread_cond_t room;      /* a job left the queue */
+  job *head, *tail;
+  unsigned queued;
+  size_t held;              /* bytes of file buffers, atomic */
+  int finished;             /* nothing more will be queued */
+};
+
+void
+  webvtt_ingest_options_init(webvtt_ingest_options *options)
+{
+  options->workers = 0;
+  options->timebase = webvtt_timebase_ms;
+  options->atoms = NULL;
+  options->format = WEBVTT_FORMAT_VTT;
+  webvtt_limits_init(&options->limits);
+}
+
+/* a file buffer is given back. with free_data 0 the memory is not
+freed, only no longer counted */
+static void release_data(batch *b, job *j, int free_data) {
+  if (free_data)
+    free(j->data);
+  j->data = NULL;
+  pthread_mutex_lock(&b->lock);
+  __atomic_sub_fetch(&b->held, j->capacity, __ATOMIC_RELAXED);
+  pthread_cond_signal(&b->room);
+  pthread_mutex_unlock(&b->lock);
+  j->capacity = 0;
+}
+
+static void fail_job(batch *b, job *j, int error) {
+  webvtt_ingest_result *result = b->results + j->index;
+
+  release_data(b, j, 1);
+  j->done = 1;
+  result->error = error;
+  result->cues = NULL;
+  result->header = NULL;
+}
+
+static void queue_job(batch *b, job *j) {
+  j->done = 1;
+  pthread_mutex_lock(&b->lock);
+  j->next = NULL;
+  if (b->tail)
+    b->tail->next = j;
+  else
+    b->head = j;
+  b->tail = j;
+  b->queued++;
+  pthread_cond_signal(&b->ready);
+  pthread_mutex_unlock(&b->lock);
+}
+
+/* whether another file may be read, waiting for the parsers when there
+is nothing else to do */
+static int has_room(batch *b, int wait) {
+  int room;
+
+  pthread_mutex_lock(&b->lock);
+  while (wait && (b->queued >= MAX_QUEUED ||
+                  __atomic_load_n(&b->held, __ATOMIC_RELAXED) >= MAX_HELD))
+    pthread_cond_wait(&b->room, &b->lock);
+  room = b->queued < MAX_QUEUED &&
+    __atomic_load_n(&b->held, __ATOMIC_RELAXED) < MAX_HELD;
+  pthread_mutex_unlock(&b->lock);
+  return room;
+}
+
+/* room for size bytes and the one past them that shows the end */
+static int size_job(batch *b, job *j, size_t size) {
+  j->length = 0;
+  j->data = (char*)malloc(size + 1);
+  if (j->data == NULL)
+    return -1;
+  j->capacity = size + 1;
+  __atomic_add_fetch(&b->held, j->capacity, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/* after a read that filled the buffer the file has grown */
+static int grow_job(batch *b, job *j) {
+  size_t capacity = j->capacity * 2;
+  char *data = (char*)realloc(j->data, capacity);
+
+  if (data == NULL)
+    return -1;
+  __atomic_add_fetch(&b->held, capacity - j->capacity, __ATOMIC_RELAXED);
+  j->data = data;
+  j->capacity = capacity;
+  return 0;
+}
+
+static void parse_job(batch *b, job *j) {
+  const webvtt_ingest_options *options = b->options;
+  webvtt_ingest_result *result = b->results + j->index;
+  webvtt_parser *ctx = webvtt_parse_acquire();
+  webvtt_stream *stream = NULL;
+  size_t done, n;
+  int r = 0;
+
+  if (ctx == NULL || (stream = webvtt_stream_new(ctx)) == NULL) {
+    webvtt_parse_release(ctx);
+    fail_job(b, j, ENOMEM);
+    return;
+  }
+  webvtt_parse_set_timebase(ctx, options->timebase);
+  webvtt_parse_set_atoms(ctx, options->atoms);
+  webvtt_parse_set_format(ctx, options->format);
+  webvtt_parse_set_limits(ctx, &options->limits);
+  for (done = 0; r == 0 && done < j->length; done += n) {
+    n = j->length - done < FEED_SIZE ? j->length - done : FEED_SIZE;
+    r = webvtt_stream_feed(stream, j->data + done, n);
+  }
+  if (r < 0 || webvtt_stream_finish(stream) < 0) {
+    result->error = EINVAL;
+    result->cues = NULL;
+    result->header = NULL;
+  } else {
+    result->error = 0;
+    result->cues = webvtt_stream_take(stream);
+    result->header = webvtt_parse_take_header(ctx);
+  }
+  webvtt_stream_free(stream);
+  webvtt_parse_release(ctx);
+  release_data(b, j, 1);
+}
+
+static void *parse_files(void *arg) {
+  batch *b = (batch*)arg;
+  job *j;
+
+  for (;;) {
+    pthread_mutex_lock(&b->lock);
+    while (b->head == NULL && !b->finished)
+      pthread_cond_wait(&b->ready, &b->lock);
+    j = b->head;
+    if (j == NULL) {
+      pthread_mutex_unlock(&b->lock);
+      break;
+    }
+    b->head = j->next;
+    if (b->head == NULL)
+      b->tail = NULL;
+    b->queued--;
+    pthread_cond_signal(&b->room);
+    pthread_mutex_unlock(&b->lock);
+    parse_job(b, j);
+  }
+  return NULL;
+}
+
+/* one file at a time with plain system calls */
+static void read_files(batch *b, unsigned first, unsigned count) {
+  struct stat st;
+  unsigned i;
+  ssize_t n;
+  job *j;
+
+  for (i = first; i < count; i++) {
+    j = b->jobs + i;
+    has_room(b, 1);
+    j->fd = open(b->filenames[i], O_RDONLY | O_CLOEXEC);
+    if (j->fd < 0) {
+      fail_job(b, j, errno);
+      continue;
+    }
+    if (fstat(j->fd, &st) < 0 || size_job(b, j, st.st_size) < 0) {
+      fail_job(b, j, errno);
+      close(j->fd);
+      continue;
+    }
+    for (;;) {
+      n = read(j->fd, j->data + j->length, j->capacity - j->length);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      j->length += n;
+      if (j->length == j->capacity && grow_job(b, j) < 0) {
+        n = -1;
+        errno = ENOMEM;
+        break;
+      }
+    }
+    if (n < 0)
+      fail_job(b, j, errno);
+    else
+      queue_job(b, j);
+    close(j->fd);
+  }
+}
+
+#if HAVE_IO_URING
+
+#define RING_ENTRIES 256
+
+enum { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE };
+
+/* an io_uring set up by hand, the kernel interface is small enough
+not to need a library for */
+typedef struct ring ring;
+struct ring {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_size, cq_size, sqes_size;
+  unsigned entries;
+  unsigned to_submit;
+};
+
+static void ring_free(ring *r) {
+  if (r->sqes)
+    munmap(r->sqes, r->sqes_size);
+  if (r->cq_map && r->cq_map != r->sq_map)
+    munmap(r->cq_map, r->cq_size);
+  if (r->sq_map)
+    munmap(r->sq_map, r->sq_size);
+  close(r->fd);
+}
+
+/* whether the kernel has every operation used */
+static int ring_supports(ring *r) {
+  static const int ops[] = { IORING_OP_OPENAT, IORING_OP_STATX,
+                             IORING_OP_READ, IORING_OP_CLOSE };
+  struct io_uring_probe *probe;
+  unsigned i;
+  int ok;
+
+  probe = (struct io_uring_probe*)calloc(1, sizeof(*probe) +
+                                         256 * sizeof(probe->ops[0]));
+  if (probe == NULL)
+    return 0;
+  ok = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE,
+               probe, 256) == 0;
+  for (i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); i++)
+    ok = ops[i] <= probe->last_op &&
+      (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  return ok;
+}
+
+static int ring_init(ring *r) {
+  struct io_uring_params p;
+  char *sq, *cq;
+
+  memset(r, 0, sizeof(*r));
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+  if (r->fd < 0)
+    return -1;
+  r->entries = p.sq_entries;
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_size > r->sq_size)
+      r->sq_size = r->cq_size;
+    r->cq_size = r->sq_size;
+  }
+  r->sq_map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_map == MAP_FAILED) {
+    r->sq_map = NULL;
+    goto fail;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_map = r->sq_map;
+  } else {
+    r->cq_map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED) {
+      r->cq_map = NULL;
+      goto fail;
+    }
+  }
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_size,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, r->fd,
+                                       IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    r->sqes = NULL;
+    goto fail;
+  }
+  sq = (char*)r->sq_map;
+  cq = (char*)r->cq_map;
+  r->sq_head = (unsigned*)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned*)(sq + p.sq_off.array);
+  r->cq_head = (unsigned*)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  if (!ring_supports(r))
+    goto fail;
+  return 0;
+
+fail:
+  ring_free(r);
+  return -1;
+}
+
+/* the next free submission, which the callers never run out of: no
+more than three per file are in flight */
+static struct io_uring_sqe *ring_sqe(ring *r, unsigned op, job *j,
+                                     batch *b) {
+  unsigned tail = *r->sq_tail, index = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = r->sqes + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op == OP_OPEN ? IORING_OP_OPENAT :
+    op == OP_STATX ? IORING_OP_STATX :
+    op == OP_READ ? IORING_OP_READ : IORING_OP_CLOSE;
+  sqe->user_data = (uint64_t)(j - b->jobs) << 2 | op;
+  r->sq_array[index] = index;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->to_submit++;
+  return sqe;
+}
+
+static void submit_read(ring *r, job *j, batch *b) {
+  struct io_uring_sqe *sqe = ring_sqe(r, OP_READ, j, b);
+
+  sqe->fd = j->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(j->data + j->length);
+  sqe->len = j->capacity - j->length;
+  sqe->off = j->length;
+}
+
+static void submit_close(ring *r, job *j, batch *b) {
+  ring_sqe(r, OP_CLOSE, j, b)->fd = j->fd;
+}
+
+/* open and statx by name at once, neither waits for the other */
+static void submit_open(ring *r, job *j, batch *b) {
+  const char *name = b->filenames[j->index];
+  struct io_uring_sqe *sqe;
+
+  sqe = ring_sqe(r, OP_OPEN, j, b);
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uint64_t)(uintptr_t)name;
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  sqe = ring_sqe(r, OP_STATX, j, b);
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uint64_t)(uintptr_t)name;
+  sqe->len = STATX_SIZE;
+  sqe->off = (uint64_t)(uintptr_t)&j->stx;
+  j->pending = 2;
+}
+
+/* a completion, returns 1 when its file is done with reading */
+static int complete(ring *r, batch *b, struct io_uring_cqe *cqe,
+                    unsigned *closing) {
+  job *j = b->jobs + (cqe->user_data >> 2);
+  int res = cqe->res;
+
+  switch (cqe->user_data & 3) {
+  case OP_OPEN:
+    if (res < 0)
+      j->error = -res;
+    else
+      j->fd = res;
+    break;
+  case OP_STATX:
+    if (res < 0)
+      j->error = -res;
+    break;
+  case OP_READ:
+    /* a read may come back short of the end, like read(2), only one
+    of nothing is the end */
+    if (res < 0) {
+      j->error = -res;
+    } else if (res > 0) {
+      j->length += res;
+      if (j->length == j->capacity && grow_job(b, j) < 0) {
+        j->error = ENOMEM;
+      } else {
+        submit_read(r, j, b);
+        return 0;
+      }
+    }
+    break;
+  case OP_CLOSE:
+    (*closing)--;
+    return 0;
+  }
+
+  if ((cqe->user_data & 3) != OP_READ) {
+    if (--j->pending)
+      return 0;
+    if (!j->error && size_job(b, j, j->stx.stx_size) < 0)
+      j->error = ENOMEM;
+    if (!j->error) {
+      submit_read(r, j, b);
+      return 0;
+    }
+  }
+  if (j->fd >= 0) {
+    submit_close(r, j, b);
+    (*closing)++;
+  }
+  if (j->error)
+    fail_job(b, j, j->error);
+  else
+    queue_job(b, j);
+  return 1;
+}
+
+/* returns how many files were started, the rest are left for the
+fallback when the ring stops working */
+static unsigned read_files_ring(ring *r, batch *b, unsigned count) {
+  unsigned next = 0, inflight = 0, closing = 0, head, tail, i;
+  int n;
+
+  while (next < count || inflight || closing) {
+    while (next < count && inflight + closing < MAX_INFLIGHT &&
+           has_room(b, inflight == 0 && closing == 0)) {
+      submit_open(r, b->jobs + next++, b);
+      inflight++;
+    }
+    n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      /* the kernel may still write to the buffers of the files in
+      flight, so they are failed but their memory is not freed */
+      for (i = 0; i < next; i++) {
+        if (!b->jobs[i].done) {
+          release_data(b, b->jobs + i, 0);
+          fail_job(b, b->jobs + i, errno);
+        }
+      }
+      break;
+    }
+    r->to_submit -= n;
+    head = *r->cq_head;
+    tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+      inflight -= complete(r, b, r->cqes + (head & *r->cq_mask), &closing);
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return next;
+}
+
+#endif /* HAVE_IO_URING */
+
+int
+  webvtt_ingest(const char *const *filenames, unsigned count,
+                const webvtt_ingest_options *options,
+                webvtt_ingest_result *results)
+{
+  batch b;
+  pthread_t *threads;
+  unsigned workers = options->workers, started, i;
+#if HAVE_IO_URING
+  ring r;
+#endif
+
+  if (options->timebase.num == 0 || options->timebase.den == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? cpus : 1;
+  }
+  if (workers > count)
+    workers = count ? count : 1;
+
+  memset(&b, 0, sizeof(b));
+  b.filenames = filenames;
+  b.options = options;
+  b.results = results;
+  b.jobs = (job*)calloc(count ? count : 1, sizeof(job));
+  threads = (pthread_t*)malloc(workers * sizeof(pthread_t));
+  if (b.jobs == NULL || threads == NULL) {
+    free(b.jobs);
+    free(threads);
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    b.jobs[i].index = i;
+    b.jobs[i].fd = -1;
+  }
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.ready, NULL);
+  pthread_cond_init(&b.room, NULL);
+
+  for (started = 0; started < workers; started++)
+    if (pthread_create(threads + started, NULL, parse_files, &b) != 0)
+      break;
+  if (started) {
+#if HAVE_IO_URING
+    if (ring_init(&r) == 0) {
+      i = read_files_ring(&r, &b, count);
+      ring_free(&r);
+      read_files(&b, i, count);
+    } else {
+      read_files(&b, 0, count);
+    }
+#else
+    read_files(&b, 0, count);
+#endif
+  }
+
+  pthread_mutex_lock(&b.lock);
+  b.finished = 1;
+  pthread_cond_broadcast(&b.ready);
+  pthread_mutex_unlock(&b.lock);
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_cond_destroy(&b.room);
+  pthread_cond_destroy(&b.ready);
+  pthread_mutex_destroy(&b.lock);
+  free(threads);
+  free(b.jobs);
+  return started ? 0 : -1;
+}
@@ -0,0 +1,63 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_INGEST_H_
+#define _WEBVTT_INGEST_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+
+  /* read and parse many local files at once. one thread does all the
+  opening, sizing and reading, through io_uring where the kernel has
+  it, so thousands of small files cost a handful of system calls
+  rather than several each. whole files go to a pool of parser
+  threads as they arrive, reading pausing while too many files or
+  bytes wait for them. without io_uring the same thread falls back to
+  open, fstat and read */
+
+  typedef struct webvtt_ingest_result webvtt_ingest_result;
+  struct webvtt_ingest_result {
+    int error;                /** 0, an errno value from opening or
+                                  reading, or EINVAL when it could not
+                                  be parsed */
+    webvtt_cue *cues;         /** the caller owns them */
+    webvtt_header *header;    /** NULL when the file had none */
+  };
+
+  /* how the files are parsed. atoms must be NULL or the process table,
+  the only one that can be shared by the workers */
+  typedef struct webvtt_ingest_options webvtt_ingest_options;
+  struct webvtt_ingest_options {
+    unsigned workers;         /** parser threads, 0 for one per CPU */
+    webvtt_timebase timebase;
+    webvtt_atoms *atoms;
+    enum webvtt_format format;
+    webvtt_limits limits;     /** what one file may make a worker keep */
+  };
+
+  /* the defaults: a worker per CPU, milliseconds, no atoms, WebVTT and
+  the default limits */
+  void webvtt_ingest_options_init(webvtt_ingest_options *options);
+
+  /* read every file and fill results[i] for filenames[i]. returns 0
+  when every file was dealt with, its result saying how it went, and
+  -1 when the batch could not run at all, the results untouched then.
+  a timebase with a zero in it fails that way */
+  int webvtt_ingest(const char *const *filenames, unsigned count,
+                    const webvtt_ingest_options *options,
+                    webvtt_ingest_result *results);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_INGEST_H_ */
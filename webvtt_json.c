@@ -0,0 +1,447 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "webvtt_json.h"
+#include "cue_text_parser.h"
+
+/* everything of a cue object but the escaped id and text: field names,
+two times of up to 20 digits, the settings and the separators */
+#define OBJECT_MAX 256
+
+/* out is handed to fd once it holds this much */
+#define FLUSH_AT 65536
+
+static const char align_names[][7] = {
+  "middle", "start", "end", "left", "right"
+};
+
+static const char vertical_names[][3] = {
+  "", "rl", "lr"
+};
+
+static const char digit_pairs[] =
+  "0001020304050607080910111213141516171819202122232425262728293031323334"
+  "3536373839404142434445464748495051525354555657585960616263646566676869"
+  "707172737475767778798081828384858687888990919293949596979899";
+
+static char *put_string(char *p, const char *s) {
+  while (*s)
+    *p++ = *s++;
+  return p;
+}
+
+/* two digits per step from the back, then copied to the front */
+static char *put_unsigned(char *p, uint64_t v) {
+  char digits[20], *d = digits + sizeof(digits);
+  size_t n;
+
+  while (v >= 100) {
+    d -= 2;
+    memcpy(d, digit_pairs + 2 * (v % 100), 2);
+    v /= 100;
+  }
+  if (v >= 10) {
+    d -= 2;
+    memcpy(d, digit_pairs + 2 * v, 2);
+  } else {
+    *--d = '0' + (char)v;
+  }
+  n = digits + sizeof(digits) - d;
+  memcpy(p, d, n);
+  return p + n;
+}
+
+static char *put_number(char *p, int64_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return put_unsigned(p, -(uint64_t)v);
+  }
+  return put_unsigned(p, v);
+}
+
+/* seconds with three decimals, the unit of VTTCue times */
+static char *put_seconds(char *p, int64_t ms) {
+  uint64_t v = ms < 0 ? -(uint64_t)ms : (uint64_t)ms;
+  unsigned rest = (unsigned)(v % 1000);
+
+  if (ms < 0)
+    *p++ = '-';
+  p = put_unsigned(p, v / 1000);
+  *p++ = '.';
+  *p++ = '0' + rest / 100;
+  memcpy(p, digit_pairs + 2 * (rest % 100), 2);
+  return p + 2;
+}
+
+/* bytes from s on that can be copied as they are, i.e. up to the
+first quote, backslash or control character. 16 bytes at a time with
+SSE2, 8 at a time in a general purpose register otherwise */
+static size_t plain_prefix(const unsigned char *s, size_t length) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  __m128i v, hit;
+  int mask;
+
+  for (; i + 16 <= length; i += 16) {
+    v = _mm_loadu_si128((const __m128i*)(s + i));
+    hit = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+    /* unsigned v <= 0x1f */
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+    mask = _mm_movemask_epi8(hit);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#else
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  uint64_t x, q, b;
+
+  for (; i + 8 <= length; i += 8) {
+    memcpy(&x, s + i, 8);
+    q = x ^ (ones * '"');
+    b = x ^ (ones * '\\');
+    if ((((x - ones * 0x20) & ~x) | ((q - ones) & ~q) | ((b - ones) & ~b)) &
+        highs)
+      break;
+  }
+#endif
+  while (i < length && s[i] >= 0x20 && s[i] != '"' && s[i] != '\\')
+    i++;
+  return i;
+}
+
+/* a quoted string, room for the worst case must have been reserved */
+static char *put_quoted(char *p, const char *s, size_t length) {
+  static const char hex[] = "0123456789abcdef";
+  size_t i = 0, n;
+  unsigned char c;
+
+  *p++ = '"';
+  for (;;) {
+    n = plain_prefix((const unsigned char*)s + i, length - i);
+    memcpy(p, s + i, n);
+    p += n;
+    i += n;
+    if (i == length)
+      break;
+    c = (unsigned char)s[i++];
+    *p++ = '\\';
+    switch (c) {
+    case '"':
+    case '\\':
+      *p++ = c;
+      break;
+    case '\n':
+      *p++ = 'n';
+      break;
+    case '\r':
+      *p++ = 'r';
+      break;
+    case '\t':
+      *p++ = 't';
+      break;
+    default:
+      p = put_string(p, "u00");
+      *p++ = hex[c >> 4];
+      *p++ = hex[c & 15];
+      break;
+    }
+  }
+  *p++ = '"';
+  return p;
+}
+
+static size_t quoted_size(size_t length) {
+  return 6 * length + 2;
+}
+
+static int append_quoted(webvtt_buffer *out, const char *s, size_t length) {
+  if (webvtt_buffer_reserve(out, quoted_size(length)) < 0)
+    return -1;
+  out->length = put_quoted(out->data + out->length, s, length) - out->data;
+  return 0;
+}
+
+#define PUT(s) webvtt_buffer_append(out, s, sizeof(s) - 1)
+
+/* the cue text tree in JsonML: an element is an array of its name, an
+object of its attributes when it has any, then its children. text is a
+string. the root is the array of the top level children */
+typedef struct dom_writer dom_writer;
+struct dom_writer {
+  node_visitor base;
+  webvtt_buffer *out;
+  webvtt_atoms *atoms;
+  const webvtt_timestamp_map *map;  /* of the cue's file */
+  int comma;                /* a sibling came before */
+};
+
+static const char *element_names[] = {
+  "", "c", "i", "b", "u", "ruby", "rt", "v", "lang", "", "timestamp"
+};
+
+static int put_attributes(webvtt_buffer *out, webvtt_atoms *atoms,
+                          const webvtt_timestamp_map *map, const node *n) {
+  char number[32];
+  const class_set *classes = node_classes(n);
+  webvtt_atom atom = class_set_next(classes, WEBVTT_NO_ATOM);
+  node_type type = node_get_type(n);
+  const char *name;
+  unsigned length;
+  int64_t time;
+
+  if (atom == WEBVTT_NO_ATOM && type != voice_type && type != timestamp_type)
+    return 0;
+  if (PUT(",{") < 0)
+    return -1;
+  if (type == timestamp_type) {
+    /* a karaoke time is in the file's clock, like the cue timings */
+    time = webvtt_map_timestamp(map, node_time(n));
+    length = put_seconds(number, webvtt_rescale(time, map->timebase,
+                                                webvtt_timebase_ms)) - number;
+    if (PUT("\"time\":") < 0 ||
+        webvtt_buffer_append(out, number, length) < 0)
+      return -1;
+    return PUT("}");
+  }
+  if (type == voice_type) {
+    name = webvtt_atom_string(atoms, node_voice(n), &length);
+    if (PUT("\"voice\":") < 0 || append_quoted(out, name, length) < 0)
+      return -1;
+    if (atom != WEBVTT_NO_ATOM && PUT(",") < 0)
+      return -1;
+  }
+  if (atom != WEBVTT_NO_ATOM) {
+    if (PUT("\"class\":[") < 0)
+      return -1;
+    for (; atom != WEBVTT_NO_ATOM; atom = class_set_next(classes, atom)) {
+      name = webvtt_atom_string(atoms, atom, &length);
+      if (append_quoted(out, name, length) < 0)
+        return -1;
+      if (class_set_next(classes, atom) != WEBVTT_NO_ATOM && PUT(",") < 0)
+        return -1;
+    }
+    if (PUT("]") < 0)
+      return -1;
+  }
+  return PUT("}");
+}
+
+static int dom_enter(node_visitor *visitor, const node *n, unsigned depth) {
+  dom_writer *w = (dom_writer*)visitor;
+  webvtt_buffer *out = w->out;
+  node_type type = node_get_type(n);
+  const char *name = element_names[type];
+  (void)depth;
+
+  if (w->comma && PUT(",") < 0)
+    return 1;
+  w->comma = 1;
+  if (type == text_type) {
+    name = node_text(n);
+    return append_quoted(out, name, strlen(name)) < 0;
+  }
+  if (type == list_type) {
+    w->comma = 0;
+    return PUT("[") < 0;
+  }
+  if (PUT("[\"") < 0 || webvtt_buffer_append(out, name, strlen(name)) < 0 ||
+      PUT("\"") < 0 || put_attributes(out, w->atoms, w->map, n) < 0)
+    return 1;
+  /* a timestamp has no children and is closed right away */
+  return type == timestamp_type && PUT("]") < 0;
+}
+
+static int dom_leave(node_visitor *visitor, const node *n, unsigned depth) {
+  dom_writer *w = (dom_writer*)visitor;
+  node_type type = node_get_type(n);
+  (void)depth;
+
+  w->comma = 1;
+  if (type == text_type || type == timestamp_type)
+    return 0;
+  return webvtt_buffer_append(w->out, "]", 1) < 0;
+}
+
+static int write_dom(webvtt_json *json, const webvtt_cue_view *view) {
+  webvtt_buffer *out = json->out;
+  webvtt_timestamp_map map;
+  dom_writer w;
+  node *root;
+  int r;
+
+  /* the cue text parser wants its input NUL terminated */
+  json->text.length = 0;
+  if (webvtt_buffer_append(&json->text, view->text, view->text_length) < 0 ||
+      webvtt_buffer_append(&json->text, "", 1) < 0)
+    return -1;
+  if (json->atoms == NULL)
+    return -1;
+  root = parse_cue_text(json->text.data, json->atoms);
+  if (root == NULL)
+    return -1;
+
+  w.base.enter = dom_enter;
+  w.base.leave = dom_leave;
+  w.out = out;
+  w.atoms = json->atoms;
+  w.map = json->map;
+  if (w.map == NULL) {
+    webvtt_timestamp_map_init(&map, json->timebase);
+    w.map = &map;
+  }
+  w.comma = 0;
+  r = PUT(",\"dom\":") < 0 || walk_nodes(root, &w.base) ? -1 : 0;
+  free_nodes(root);
+  return r;
+}
+
+void
+  webvtt_json_init(webvtt_json *json, webvtt_buffer *out, int fd,
+                   unsigned flags, webvtt_timebase timebase)
+{
+  json->out = out;
+  json->fd = fd;
+  json->flags = flags;
+  json->timebase = timebase;
+  json->own_atoms = NULL;
+  if (flags & WEBVTT_JSON_DOM)
+    json->own_atoms = webvtt_atoms_new();
+  json->atoms = json->own_atoms;
+  json->header = NULL;
+  json->map = NULL;
+  json->count = 0;
+  webvtt_buffer_init(&json->text);
+}
+
+void
+  webvtt_json_free(webvtt_json *json)
+{
+  webvtt_buffer_free(&json->text);
+  webvtt_atoms_free(json->own_atoms);
+  json->own_atoms = NULL;
+  json->atoms = NULL;
+}
+
+int
+  webvtt_json_begin(webvtt_json *json)
+{
+  if (json->flags & WEBVTT_JSON_LINES)
+    return 0;
+  return webvtt_buffer_append(json->out, "[", 1);
+}
+
+int
+  webvtt_json_write_view(webvtt_json *json, const webvtt_cue_view *view)
+{
+  webvtt_buffer *out = json->out;
+  unsigned region_length = 0;
+  const char *region = webvtt_header_region_id(json->header, view->region,
+                                               &region_length);
+  char *p;
+
+  if (webvtt_buffer_reserve(out, OBJECT_MAX +
+                            quoted_size(view->cueID_length) +
+                            quoted_size(region_length) +
+                            quoted_size(view->text_length)) < 0)
+    return -1;
+  p = out->data + out->length;
+  if (json->flags & WEBVTT_JSON_LINES) {
+    if (json->count)
+      *p++ = '\n';
+  } else {
+    p = put_string(p, json->count ? ",\n" : "\n");
+  }
+
+  p = put_string(p, "{\"id\":");
+  p = put_quoted(p, view->cueID ? view->cueID : "", view->cueID_length);
+  p = put_string(p, ",\"start\":");
+  p = put_seconds(p, webvtt_rescale(view->start, json->timebase,
+                                    webvtt_timebase_ms));
+  p = put_string(p, ",\"end\":");
+  p = put_seconds(p, webvtt_rescale(view->end, json->timebase,
+                                    webvtt_timebase_ms));
+  p = put_string(p, ",\"vertical\":\"");
+  p = put_string(p, vertical_names[view->vertical]);
+  p = put_string(p, "\",\"line\":");
+  if (view->lineAuto)
+    p = put_string(p, "\"auto\"");
+  else
+    p = put_number(p, view->line);
+  p = put_string(p, view->snapToLine ? ",\"snapToLine\":true" :
+                 ",\"snapToLine\":false");
+  p = put_string(p, ",\"position\":");
+  p = put_number(p, view->position);
+  p = put_string(p, ",\"size\":");
+  p = put_number(p, view->size);
+  p = put_string(p, ",\"align\":\"");
+  p = put_string(p, align_names[view->align]);
+  p = put_string(p, view->pauseOnExit ? "\",\"pauseOnExit\":true" :
+                 "\",\"pauseOnExit\":false");
+  if (region) {
+    p = put_string(p, ",\"region\":");
+    p = put_quoted(p, region, region_length);
+  }
+  p = put_string(p, ",\"text\":");
+  p = put_quoted(p, view->text, view->text_length);
+  out->length = p - out->data;
+
+  if ((json->flags & WEBVTT_JSON_DOM) && write_dom(json, view) < 0)
+    return -1;
+  if (webvtt_buffer_append(out, "}", 1) < 0)
+    return -1;
+  json->count++;
+
+  if (json->fd >= 0 && out->length >= FLUSH_AT)
+    return webvtt_buffer_flush(out, json->fd);
+  return 0;
+}
+
+int
+  webvtt_json_end(webvtt_json *json)
+{
+  webvtt_buffer *out = json->out;
+
+  if (json->flags & WEBVTT_JSON_LINES) {
+    if (json->count && PUT("\n") < 0)
+      return -1;
+  } else if (PUT("\n]\n") < 0) {
+    return -1;
+  }
+  if (json->fd >= 0)
+    return webvtt_buffer_flush(out, json->fd);
+  return 0;
+}
+
+int
+  webvtt_json_write_source(webvtt_json *json, webvtt_cue_source *source)
+{
+  webvtt_cue_view view;
+  int r;
+
+  json->timebase = source->timebase;
+  if (webvtt_json_begin(json) < 0)
+    return -1;
+  while ((r = source->next(source, &view)) == 1) {
+    if (webvtt_json_write_view(json, &view) < 0)
+      return -1;
+  }
+  if (r < 0)
+    return -1;
+  return webvtt_json_end(json);
+}
@@ -0,0 +1,76 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_JSON_H_
+#define _WEBVTT_JSON_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+#include "webvtt_buffer.h"
+#include "webvtt_merge.h"
+
+  /* JSON output. every cue becomes an object with the fields of a
+  VTTCue: id, start and end in seconds, the typed settings, the region
+  id when the cue has a region the header knows, and the text. nothing
+  but the cue being written is held, so a track of any size streams
+  through in constant memory. all functions return 0 on success and -1
+  when out of memory or on a write error */
+
+  enum webvtt_json_flags {
+    WEBVTT_JSON_LINES = 0x1,  /** one object per line, no enclosing array */
+    WEBVTT_JSON_DOM = 0x2     /** add the cue text tree as "dom" */
+  };
+
+  typedef struct webvtt_json webvtt_json;
+  struct webvtt_json {
+    webvtt_buffer *out;
+    int fd;                   /** when >= 0, out is flushed to it as it fills */
+    unsigned flags;
+    webvtt_timebase timebase; /** of the timestamps handed in */
+    webvtt_atoms *atoms;      /** names of the dom, the writer's own
+                                  table unless set to another */
+    webvtt_atoms *own_atoms;  /** made by init, freed by free */
+    const webvtt_header *header;  /** the cues' regions index into it,
+                                      NULL until set */
+    const webvtt_timestamp_map *map;  /** the cues' file's, karaoke times
+                                          go through it. NULL until set,
+                                          as for a file without one */
+    unsigned count;           /** cues written so far */
+    webvtt_buffer text;       /** NUL terminated cue text for the dom */
+  };
+
+  /* with WEBVTT_JSON_DOM, the names met in cue text go in a table of
+  the writer's own, freed with it, so a long run over untrusted files
+  neither keeps them nor takes the process table's lock. when that
+  table cannot be made, writing a dom fails */
+  void webvtt_json_init(webvtt_json *json, webvtt_buffer *out, int fd,
+                        unsigned flags, webvtt_timebase timebase);
+
+  void webvtt_json_free(webvtt_json *json);
+
+  /* the opening bracket, unless in lines mode */
+  int webvtt_json_begin(webvtt_json *json);
+
+  int webvtt_json_write_view(webvtt_json *json, const webvtt_cue_view *view);
+
+  /* the closing bracket, then whatever is left is flushed to fd */
+  int webvtt_json_end(webvtt_json *json);
+
+  /* a whole document from a cue source, straight off its iterator.
+  the timebase is taken from the source */
+  int webvtt_json_write_source(webvtt_json *json, webvtt_cue_source *source);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_JSON_H_ */
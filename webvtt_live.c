@@ -0,0 +1,277 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_live.h"
+#include "webvtt_arena.h"
+#include "webvtt_epoch.h"
+
+#define CHUNK_SHIFT 8
+#define CHUNK_CUES (1u << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_CUES - 1)
+
+typedef struct live_cue live_cue;
+struct live_cue {
+  webvtt_cue_view view;     /* strings in the chunk's arena */
+  int64_t max_end;          /* largest end of this cue and all before */
+};
+
+typedef struct chunk chunk;
+struct chunk {
+  webvtt_retired retired;
+  webvtt_arena strings;
+  live_cue cues[CHUNK_CUES];
+};
+
+/* which chunks exist: chunks[i] holds cues from (first + i) * CHUNK_CUES.
+readers may hold on to an old directory, so slots in use never change;
+it is replaced to grow or to drop chunks at the front */
+typedef struct directory directory;
+struct directory {
+  webvtt_retired retired;
+  unsigned first;           /* chunk number of chunks[0] */
+  unsigned count, capacity;
+  chunk *chunks[];
+};
+
+struct webvtt_live {
+  directory *directory;
+  unsigned count;           /* cues complete and visible to readers */
+  webvtt_timebase timebase;
+  webvtt_epoch epoch;
+  int64_t last_start, max_end;
+};
+
+static void release_chunk(webvtt_retired *retired) {
+  chunk *c = (chunk*)retired;
+  webvtt_arena_free(&c->strings);
+  free(c);
+}
+
+static void release_directory(webvtt_retired *retired) {
+  free(retired);
+}
+
+static directory *new_directory(unsigned first, unsigned capacity) {
+  directory *d = (directory*)malloc(sizeof(*d) + capacity * sizeof(chunk*));
+
+  if (d) {
+    d->retired.release = release_directory;
+    d->first = first;
+    d->count = 0;
+    d->capacity = capacity;
+  }
+  return d;
+}
+
+webvtt_live *
+  webvtt_live_new(webvtt_timebase timebase)
+{
+  webvtt_live *live = (webvtt_live*)malloc(sizeof(*live));
+
+  if (live == NULL)
+    return NULL;
+  live->directory = new_directory(0, 4);
+  if (live->directory == NULL) {
+    free(live);
+    return NULL;
+  }
+  live->count = 0;
+  live->timebase = timebase;
+  webvtt_epoch_init(&live->epoch);
+  live->last_start = INT64_MIN;
+  live->max_end = INT64_MIN;
+  return live;
+}
+
+void
+  webvtt_live_free(webvtt_live *live)
+{
+  unsigned i;
+
+  if (live == NULL)
+    return;
+  for (i = 0; i < live->directory->count; i++)
+    release_chunk(&live->directory->chunks[i]->retired);
+  free(live->directory);
+  webvtt_epoch_destroy(&live->epoch);
+  free(live);
+}
+
+/* publish d in place of the current directory */
+static void replace_directory(webvtt_live *live, directory *d) {
+  directory *old = live->directory;
+  __atomic_store_n(&live->directory, d, __ATOMIC_RELEASE);
+  webvtt_epoch_retire(&live->epoch, &old->retired);
+}
+
+/* a new chunk at the end, in a larger copy of the directory when it is
+full. -1 when out of memory */
+static int add_chunk(webvtt_live *live) {
+  directory *d = live->directory, *grown;
+  chunk *c = (chunk*)malloc(sizeof(*c));
+
+  if (c == NULL)
+    return -1;
+  c->retired.release = release_chunk;
+  webvtt_arena_init(&c->strings);
+  if (d->count < d->capacity) {
+    /* readers never look past the published cue count, so a slot that
+    is filled only now is not seen before its cues are */
+    d->chunks[d->count++] = c;
+    return 0;
+  }
+  grown = new_directory(d->first, d->capacity * 2);
+  if (grown == NULL) {
+    free(c);
+    return -1;
+  }
+  memcpy(grown->chunks, d->chunks, d->count * sizeof(chunk*));
+  grown->chunks[d->count] = c;
+  grown->count = d->count + 1;
+  replace_directory(live, grown);
+  return 0;
+}
+
+static const char *copy_string(chunk *c, const char *s, unsigned length) {
+  return s ? webvtt_arena_strndup(&c->strings, s, length) : NULL;
+}
+
+int
+  webvtt_live_append(webvtt_live *live, const webvtt_cue_view *view)
+{
+  unsigned n = live->count;
+  directory *d = live->directory;
+  live_cue *cue;
+  chunk *c;
+
+  if (view->start < live->last_start)
+    return -1;
+  if ((n >> CHUNK_SHIFT) - d->first >= d->count) {
+    if (add_chunk(live) < 0)
+      return -1;
+    d = live->directory;
+  }
+  c = d->chunks[(n >> CHUNK_SHIFT) - d->first];
+  cue = &c->cues[n & CHUNK_MASK];
+  cue->view = *view;
+  cue->view.text = copy_string(c, view->text, view->text_length);
+  cue->view.cueID = copy_string(c, view->cueID, view->cueID_length);
+  cue->view.settings = copy_string(c, view->settings, view->settings_length);
+  if (cue->view.text == NULL || (view->cueID && cue->view.cueID == NULL) ||
+      (view->settings && cue->view.settings == NULL))
+    return -1;
+  if (view->end > live->max_end)
+    live->max_end = view->end;
+  cue->max_end = live->max_end;
+  live->last_start = view->start;
+
+  /* the cue is complete, let readers see it */
+  __atomic_store_n(&live->count, n + 1, __ATOMIC_RELEASE);
+  if ((n & CHUNK_MASK) == 0)
+    webvtt_epoch_collect(&live->epoch);
+  return 0;
+}
+
+unsigned
+  webvtt_live_trim(webvtt_live *live, int64_t t)
+{
+  directory *d = live->directory, *kept;
+  unsigned drop = 0, i;
+
+  /* whole chunks before the one being filled, whose cues all ended */
+  while (drop + 1 < d->count &&
+         d->chunks[drop]->cues[CHUNK_MASK].max_end <= t)
+    drop++;
+  if (drop == 0)
+    return 0;
+  kept = new_directory(d->first + drop, d->capacity);
+  if (kept == NULL)
+    return 0;
+  memcpy(kept->chunks, d->chunks + drop, (d->count - drop) * sizeof(chunk*));
+  kept->count = d->count - drop;
+  __atomic_store_n(&live->directory, kept, __ATOMIC_RELEASE);
+  for (i = 0; i < drop; i++)
+    webvtt_epoch_retire(&live->epoch, &d->chunks[i]->retired);
+  webvtt_epoch_retire(&live->epoch, &d->retired);
+  return drop * CHUNK_CUES;
+}
+
+unsigned
+  webvtt_live_enter(webvtt_live *live)
+{
+  return webvtt_epoch_enter(&live->epoch);
+}
+
+void
+  webvtt_live_leave(webvtt_live *live, unsigned slot)
+{
+  webvtt_epoch_leave(&live->epoch, slot);
+}
+
+unsigned
+  webvtt_live_count(webvtt_live *live)
+{
+  return __atomic_load_n(&live->count, __ATOMIC_ACQUIRE);
+}
+
+static const live_cue *cue_at(const directory *d, unsigned n) {
+  return &d->chunks[(n >> CHUNK_SHIFT) - d->first]->cues[n & CHUNK_MASK];
+}
+
+unsigned
+  webvtt_live_active(webvtt_live *live, int64_t t, webvtt_cue_view *out,
+                     unsigned max)
+{
+  /* the count first: any directory published after it covers it */
+  unsigned count = __atomic_load_n(&live->count, __ATOMIC_ACQUIRE);
+  const directory *d = __atomic_load_n(&live->directory, __ATOMIC_ACQUIRE);
+  unsigned lo, hi, mid, first, last, i;
+  unsigned found = 0;
+  const live_cue *cue;
+
+  lo = d->first << CHUNK_SHIFT;
+  if (count <= lo)
+    return 0;
+  first = lo;
+
+  /* cues starting at or before t: [first, last) */
+  hi = count;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (cue_at(d, mid)->view.start <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  last = lo;
+
+  /* max_end never decreases, skip the prefix that ended before t */
+  lo = first;
+  hi = last;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (cue_at(d, mid)->max_end <= t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (i = lo; i < last; i++) {
+    cue = cue_at(d, i);
+    if (t < cue->view.end) {
+      if (found < max)
+        out[found] = cue->view;
+      found++;
+    }
+  }
+  return found;
+}
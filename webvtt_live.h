@@ -0,0 +1,64 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_LIVE_H_
+#define _WEBVTT_LIVE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+
+  /* a track that grows while it is being read, for live streams. one
+  writer thread appends cues in start order; any number of reader
+  threads ask which cues are active at some time, without locks. cues
+  live in fixed chunks that never move, the length is published
+  atomically after a cue is complete, and the chunk directory is
+  replaced rather than changed when it grows or the front is trimmed.
+  what is replaced is freed once no reader can still see it */
+  typedef struct webvtt_live webvtt_live;
+
+  /* NULL when out of memory */
+  webvtt_live *webvtt_live_new(webvtt_timebase timebase);
+
+  /* no thread may be using the track any more */
+  void webvtt_live_free(webvtt_live *live);
+
+  /* writer side, from a single thread at a time */
+
+  /* append a copy of a cue, timestamps in the track's timebase. returns
+  -1 when out of memory or when it starts before the previous cue */
+  int webvtt_live_append(webvtt_live *live, const webvtt_cue_view *view);
+
+  /* let go of cues that have all ended by t, a chunk at a time. returns
+  how many were dropped */
+  unsigned webvtt_live_trim(webvtt_live *live, int64_t t);
+
+  /* reader side, from any thread. queries go between enter and leave,
+  and the views they fill stay valid until leave */
+
+  unsigned webvtt_live_enter(webvtt_live *live);
+
+  void webvtt_live_leave(webvtt_live *live, unsigned slot);
+
+  /* store views of the cues active at time t (start <= t < end) into
+  out, in start order. returns how many cues are active, which may be
+  more than max; only the first max are stored */
+  unsigned webvtt_live_active(webvtt_live *live, int64_t t,
+                              webvtt_cue_view *out, unsigned max);
+
+  /* cues appended so far, trimmed ones included */
+  unsigned webvtt_live_count(webvtt_live *live);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_LIVE_H_ */
@@ -0,0 +1,319 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_merge.h"
+#include "webvtt_buffer.h"
+
+static int track_source_next(webvtt_cue_source *base, webvtt_cue_view *view) {
+  webvtt_track_source *source = (webvtt_track_source*)base;
+  const webvtt_track *track = source->track;
+
+  if (source->index >= track->count)
+    return 0;
+  webvtt_cue_view_of(track->cues[source->index], view);
+  view->start = track->start[source->index];
+  view->end = track->end[source->index];
+  source->index++;
+  return 1;
+}
+
+void
+  webvtt_track_source_init(webvtt_track_source *source,
+                           const webvtt_track *track)
+{
+  source->base.next = track_source_next;
+  source->base.timebase = track->timebase;
+  source->track = track;
+  source->index = 0;
+}
+
+static int store_source_next(webvtt_cue_source *base, webvtt_cue_view *view) {
+  webvtt_store_source *source = (webvtt_store_source*)base;
+  return webvtt_store_next(&source->it, view);
+}
+
+void
+  webvtt_store_source_init(webvtt_store_source *source,
+                           const webvtt_store *store)
+{
+  source->base.next = store_source_next;
+  source->base.timebase = webvtt_store_timebase(store);
+  webvtt_store_begin(store, &source->it);
+}
+
+/* read at a time by a stream source. small, a merge has one per source */
+#define STREAM_CHUNK (64 * 1024)
+
+static int stream_source_next(webvtt_cue_source *base,
+                              webvtt_cue_view *view) {
+  webvtt_stream_cue_source *source = (webvtt_stream_cue_source*)base;
+  webvtt_cue *cue;
+  ssize_t n;
+
+  /* the last view is done with once next is called again */
+  webvtt_cue_free(source->current);
+  source->current = NULL;
+  while (source->pending == NULL) {
+    source->pending = webvtt_stream_take(source->stream);
+    if (source->pending != NULL)
+      break;
+    if (source->finished)
+      return 0;
+    n = source->fill(source->data, source->buffer, STREAM_CHUNK);
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      source->finished = 1;
+      if (webvtt_stream_finish(source->stream) < 0)
+        return -1;
+    } else if (webvtt_stream_feed(source->stream, source->buffer, n) < 0) {
+      return -1;
+    }
+  }
+  cue = source->pending;
+  source->pending = cue->next;
+  cue->next = NULL;
+  source->current = cue;
+  webvtt_cue_view_of(cue, view);
+  return 1;
+}
+
+int
+  webvtt_stream_cue_source_init(webvtt_stream_cue_source *source,
+                                webvtt_stream *stream,
+                                webvtt_stream_source fill, void *data)
+{
+  source->base.next = stream_source_next;
+  source->base.timebase = webvtt_stream_timebase(stream);
+  source->stream = stream;
+  source->fill = fill;
+  source->data = data;
+  source->pending = NULL;
+  source->current = NULL;
+  source->finished = 0;
+  source->buffer = (char*)malloc(STREAM_CHUNK);
+  return source->buffer ? 0 : -1;
+}
+
+void
+  webvtt_stream_cue_source_free(webvtt_stream_cue_source *source)
+{
+  webvtt_cue *next;
+
+  webvtt_cue_free(source->current);
+  source->current = NULL;
+  for (; source->pending != NULL; source->pending = next) {
+    next = source->pending->next;
+    webvtt_cue_free(source->pending);
+  }
+  free(source->buffer);
+  source->buffer = NULL;
+}
+
+struct webvtt_merge {
+  webvtt_cue_source **sources;
+  const char **prefixes;
+  unsigned count;
+  webvtt_timebase timebase;
+  enum webvtt_merge_policy policy;
+  webvtt_cue_view *current; /* current cue of every source */
+  unsigned *heap;           /* source numbers, smallest cue first */
+  unsigned heap_size;
+  int refill;               /* the root was emitted, pull its successor */
+  webvtt_buffer id;         /* prefixed id of the cue just emitted */
+  webvtt_buffer text;       /* text of the cue just emitted */
+  int64_t last_start, last_end;
+  int have_last;
+  unsigned dropped;
+};
+
+static int pull(webvtt_merge *merge, unsigned i) {
+  webvtt_cue_source *source = merge->sources[i];
+  webvtt_cue_view *view = &merge->current[i];
+  int r = source->next(source, view);
+
+  if (r == 1 && (source->timebase.num != merge->timebase.num ||
+                 source->timebase.den != merge->timebase.den)) {
+    view->start = webvtt_rescale(view->start, source->timebase,
+                                 merge->timebase);
+    view->end = webvtt_rescale(view->end, source->timebase, merge->timebase);
+  }
+  return r;
+}
+
+static int less(const webvtt_merge *merge, unsigned a, unsigned b) {
+  const webvtt_cue_view *x = &merge->current[a];
+  const webvtt_cue_view *y = &merge->current[b];
+  unsigned n;
+  int c;
+
+  if (x->start != y->start)
+    return x->start < y->start;
+  if (x->end != y->end)
+    return x->end < y->end;
+  n = x->text_length < y->text_length ? x->text_length : y->text_length;
+  c = memcmp(x->text, y->text, n);
+  if (c)
+    return c < 0;
+  if (x->text_length != y->text_length)
+    return x->text_length < y->text_length;
+  return a < b;
+}
+
+static void sift_up(webvtt_merge *merge, unsigned i) {
+  unsigned *heap = merge->heap;
+  unsigned n = heap[i], parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!less(merge, n, heap[parent]))
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = n;
+}
+
+static void sift_down(webvtt_merge *merge, unsigned i) {
+  unsigned *heap = merge->heap;
+  unsigned n = heap[i], child;
+
+  while ((child = 2 * i + 1) < merge->heap_size) {
+    if (child + 1 < merge->heap_size && less(merge, heap[child + 1], heap[child]))
+      child++;
+    if (!less(merge, heap[child], n))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = n;
+}
+
+webvtt_merge *
+  webvtt_merge_new(webvtt_cue_source **sources, const char **prefixes,
+                   unsigned count, webvtt_timebase timebase,
+                   enum webvtt_merge_policy policy)
+{
+  webvtt_merge *merge = (webvtt_merge*)calloc(1, sizeof(*merge));
+  unsigned i;
+  int r;
+
+  if (merge == NULL)
+    return NULL;
+  merge->sources = sources;
+  merge->prefixes = prefixes;
+  merge->count = count;
+  merge->timebase = timebase;
+  merge->policy = policy;
+  webvtt_buffer_init(&merge->id);
+  webvtt_buffer_init(&merge->text);
+  merge->current = (webvtt_cue_view*)malloc((count ? count : 1) *
+                                            sizeof(*merge->current));
+  merge->heap = (unsigned*)malloc((count ? count : 1) * sizeof(*merge->heap));
+  if (merge->current == NULL || merge->heap == NULL) {
+    webvtt_merge_free(merge);
+    return NULL;
+  }
+
+  for (i = 0; i < count; i++) {
+    r = pull(merge, i);
+    if (r < 0) {
+      webvtt_merge_free(merge);
+      return NULL;
+    }
+    if (r == 1) {
+      merge->heap[merge->heap_size] = i;
+      sift_up(merge, merge->heap_size++);
+    }
+  }
+  return merge;
+}
+
+void
+  webvtt_merge_free(webvtt_merge *merge)
+{
+  if (merge) {
+    free(merge->current);
+    free(merge->heap);
+    webvtt_buffer_free(&merge->id);
+    webvtt_buffer_free(&merge->text);
+    free(merge);
+  }
+}
+
+static int is_duplicate(const webvtt_merge *merge, const webvtt_cue_view *view) {
+  return merge->have_last && view->start == merge->last_start &&
+    view->end == merge->last_end && view->text_length == merge->text.length &&
+    memcmp(view->text, merge->text.data, view->text_length) == 0;
+}
+
+int
+  webvtt_merge_next(webvtt_merge *merge, webvtt_cue_view *view,
+                    unsigned *source)
+{
+  const char *prefix;
+  unsigned n;
+  int r;
+
+  for (;;) {
+    if (merge->refill) {
+      r = pull(merge, merge->heap[0]);
+      if (r < 0)
+        return -1;
+      if (r == 0)
+        merge->heap[0] = merge->heap[--merge->heap_size];
+      if (merge->heap_size)
+        sift_down(merge, 0);
+      merge->refill = 0;
+    }
+    if (merge->heap_size == 0)
+      return 0;
+
+    n = merge->heap[0];
+    *view = merge->current[n];
+    merge->refill = 1;
+
+    if (merge->policy == WEBVTT_MERGE_DROP_DUPLICATES) {
+      if (is_duplicate(merge, view)) {
+        merge->dropped++;
+        continue;
+      }
+      merge->text.length = 0;
+      if (webvtt_buffer_append(&merge->text, view->text, view->text_length) < 0)
+        return -1;
+      merge->last_start = view->start;
+      merge->last_end = view->end;
+      merge->have_last = 1;
+    }
+    break;
+  }
+
+  prefix = merge->prefixes ? merge->prefixes[n] : NULL;
+  if (prefix && view->cueID) {
+    merge->id.length = 0;
+    if (webvtt_buffer_append(&merge->id, prefix, strlen(prefix)) < 0 ||
+        webvtt_buffer_append(&merge->id, view->cueID, view->cueID_length) < 0 ||
+        webvtt_buffer_append(&merge->id, "", 1) < 0)
+      return -1;
+    view->cueID = merge->id.data;
+    view->cueID_length = merge->id.length - 1;
+  }
+  if (source)
+    *source = n;
+  return 1;
+}
+
+unsigned
+  webvtt_merge_dropped(const webvtt_merge *merge)
+{
+  return merge->dropped;
+}
@@ -0,0 +1,116 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_MERGE_H_
+#define _WEBVTT_MERGE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+#include "webvtt_store.h"
+#include "webvtt_stream.h"
+#include "webvtt_track.h"
+
+  /* anything that yields cues in start order. next returns 1 when it
+  produced a cue, 0 at the end and -1 on error. the strings of a view
+  must stay valid until next is called again on the same source */
+  typedef struct webvtt_cue_source webvtt_cue_source;
+  struct webvtt_cue_source {
+    int (*next)(webvtt_cue_source *source, webvtt_cue_view *view);
+    webvtt_timebase timebase;
+  };
+
+  /* a source reading a track */
+  typedef struct webvtt_track_source webvtt_track_source;
+  struct webvtt_track_source {
+    webvtt_cue_source base;
+    const webvtt_track *track;
+    unsigned index;
+  };
+
+  void webvtt_track_source_init(webvtt_track_source *source,
+                                const webvtt_track *track);
+
+  /* a source decoding a compressed store */
+  typedef struct webvtt_store_source webvtt_store_source;
+  struct webvtt_store_source {
+    webvtt_cue_source base;
+    webvtt_store_iter it;
+  };
+
+  void webvtt_store_source_init(webvtt_store_source *source,
+                                const webvtt_store *store);
+
+  /* a source parsing a file as it is read. cues are handed out as soon
+  as the stream has parsed them, and fill is only asked for more when
+  none are left, so a merge of N files holds a piece and a block of
+  each rather than N parsed files. the order is the file's, which
+  WebVTT requires to be by start. stream and data are the caller's;
+  data is handed to fill, see webvtt_stream_pull. returns -1 when out
+  of memory */
+  typedef struct webvtt_stream_cue_source webvtt_stream_cue_source;
+  struct webvtt_stream_cue_source {
+    webvtt_cue_source base;
+    webvtt_stream *stream;
+    webvtt_stream_source fill;
+    void *data;
+    char *buffer;             /** what fill fills */
+    webvtt_cue *pending;      /** parsed, not handed out yet */
+    webvtt_cue *current;      /** the cue of the last view */
+    int finished;             /** fill has reached the end */
+  };
+
+  int webvtt_stream_cue_source_init(webvtt_stream_cue_source *source,
+                                    webvtt_stream *stream,
+                                    webvtt_stream_source fill, void *data);
+
+  /* the cues not handed out are freed, the stream is not */
+  void webvtt_stream_cue_source_free(webvtt_stream_cue_source *source);
+
+  /* what to do with a cue that has the same timings and text as the one
+  emitted just before it */
+  enum webvtt_merge_policy {
+    WEBVTT_MERGE_KEEP_ALL = 0,
+    WEBVTT_MERGE_DROP_DUPLICATES  /** keep the one from the first source */
+  };
+
+  /* k-way merge of cue sources by start time. only the current cue of
+  each source is held, so memory does not grow with the tracks. ties
+  are broken by end time, then text, then source order, which puts
+  exact duplicates next to each other */
+  typedef struct webvtt_merge webvtt_merge;
+
+  /* sources are not copied and must outlive the merge. prefixes may be
+  NULL; otherwise prefixes[i], when not NULL, is put in front of the id
+  of every cue from source i. output times are in timebase. regions
+  are passed through as they are, each indexing the header of the
+  track its source reads */
+  webvtt_merge *webvtt_merge_new(webvtt_cue_source **sources,
+                                 const char **prefixes, unsigned count,
+                                 webvtt_timebase timebase,
+                                 enum webvtt_merge_policy policy);
+
+  void webvtt_merge_free(webvtt_merge *merge);
+
+  /* produce the next cue of the merged output. the view is valid until
+  the next call. returns 1 for a cue, 0 at the end and -1 on error;
+  source, when not NULL, is set to the index of the cue's source */
+  int webvtt_merge_next(webvtt_merge *merge, webvtt_cue_view *view,
+                        unsigned *source);
+
+  /* how many duplicates have been dropped so far */
+  unsigned webvtt_merge_dropped(const webvtt_merge *merge);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_MERGE_H_ */
@@ -0,0 +1,84 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "webvtt_pool.h"
+
+/* contexts kept per thread */
+#define POOL_SIZE 4
+
+typedef struct parser_pool parser_pool;
+struct parser_pool {
+  webvtt_parser *contexts[POOL_SIZE];
+  unsigned count;
+};
+
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void free_pool(void *data) {
+  parser_pool *pool = (parser_pool*)data;
+
+  while (pool->count)
+    webvtt_parse_free(pool->contexts[--pool->count]);
+  free(pool);
+}
+
+static void make_key(void) {
+  pthread_key_create(&pool_key, free_pool);
+}
+
+static parser_pool *thread_pool(void) {
+  parser_pool *pool;
+
+  pthread_once(&pool_once, make_key);
+  pool = (parser_pool*)pthread_getspecific(pool_key);
+  if (pool == NULL) {
+    pool = (parser_pool*)calloc(1, sizeof(*pool));
+    if (pool && pthread_setspecific(pool_key, pool) != 0) {
+      free(pool);
+      pool = NULL;
+    }
+  }
+  return pool;
+}
+
+webvtt_parser *
+  webvtt_parse_acquire(void)
+{
+  parser_pool *pool = thread_pool();
+
+  if (pool && pool->count)
+    return pool->contexts[--pool->count];
+  return webvtt_parse_new();
+}
+
+void
+  webvtt_parse_release(webvtt_parser *ctx)
+{
+  parser_pool *pool;
+  webvtt_limits limits;
+
+  if (ctx == NULL)
+    return;
+  pool = thread_pool();
+  if (pool == NULL || pool->count == POOL_SIZE) {
+    webvtt_parse_free(ctx);
+    return;
+  }
+  webvtt_parse_reset(ctx);
+  webvtt_parse_set_timebase(ctx, webvtt_timebase_ms);
+  webvtt_parse_set_atoms(ctx, NULL);
+  webvtt_parse_set_format(ctx, WEBVTT_FORMAT_VTT);
+  webvtt_limits_init(&limits);
+  webvtt_parse_set_limits(ctx, &limits);
+  pool->contexts[pool->count++] = ctx;
+}
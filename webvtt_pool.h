@@ -0,0 +1,36 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_POOL_H_
+#define _WEBVTT_POOL_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+
+  /* per thread pool of parser contexts for servers, so a request does
+  not allocate a context and its input buffer. every thread has its
+  own pool, no locks are taken; contexts left in a pool are freed when
+  the thread exits */
+
+  /* a context with the defaults of webvtt_parse_new, from the calling
+  thread's pool when it has one. NULL when out of memory */
+  webvtt_parser *webvtt_parse_acquire(void);
+
+  /* reset a context and give it to the calling thread's pool, or free
+  it when the pool is full. it need not come from the same thread */
+  void webvtt_parse_release(webvtt_parser *ctx);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_POOL_H_ */
@@ -0,0 +1,179 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "webvtt_segmenter.h"
+#include "webvtt_writer.h"
+
+/* "WEBVTT\nX-TIMESTAMP-MAP=MPEGTS:<20 digits>,LOCAL:00:00:00.000\n\n" */
+#define SEGMENT_HEADER_MAX 80
+
+/* every segment is a file of its own and declares the track's regions
+and styles again, blocks holding them already rendered */
+static int write_segment_header(webvtt_buffer *out, uint64_t mpegts,
+                                const webvtt_buffer *blocks) {
+  char header[SEGMENT_HEADER_MAX];
+  int n = snprintf(header, sizeof(header),
+                   "WEBVTT\nX-TIMESTAMP-MAP=MPEGTS:%llu,LOCAL:00:00:00.000\n\n",
+                   (unsigned long long)mpegts);
+  if (webvtt_buffer_append(out, header, n) < 0)
+    return -1;
+  if (blocks->length == 0)
+    return 0;
+  return webvtt_buffer_append(out, blocks->data, blocks->length);
+}
+
+static int write_cue(webvtt_buffer *out, const webvtt_track *track,
+                     unsigned i) {
+  webvtt_cue_view view;
+  webvtt_cue_view_of(track->cues[i], &view);
+  view.start = track->start[i];
+  view.end = track->end[i];
+  return webvtt_write_view(out, &view, track->timebase, track->header);
+}
+
+int
+  webvtt_segment_track(const webvtt_track *track, int64_t duration,
+                       uint64_t mpegts, webvtt_segments *segments)
+{
+  const int64_t *start = track->start, *end = track->end;
+  webvtt_cue_view view;
+  webvtt_buffer blocks;
+  unsigned *carry = NULL;
+  unsigned i, s, next, carried, kept;
+  int64_t last = 0, from, to, spans;
+  size_t size;
+
+  segments->count = 0;
+  segments->offsets = NULL;
+  segments->durations = NULL;
+  segments->timebase = track->timebase;
+  webvtt_buffer_init(&segments->data);
+  webvtt_buffer_init(&blocks);
+
+  if (duration <= 0)
+    return -1;
+  for (i = 0; i < track->count; i++) {
+    if (start[i] < 0 || (i && start[i] < start[i - 1]))
+      return -1;
+    if (end[i] > last)
+      last = end[i];
+  }
+
+  /* size everything up front so the sweep never reallocates */
+  segments->count = last > 0 ? (unsigned)((last + duration - 1) / duration) : 1;
+  if (webvtt_write_header_blocks(&blocks, track->header) < 0)
+    goto fail;
+  size = (size_t)segments->count * (SEGMENT_HEADER_MAX + blocks.length);
+  for (i = 0; i < track->count; i++) {
+    webvtt_cue_view_of(track->cues[i], &view);
+    spans = (end[i] + duration - 1) / duration - start[i] / duration;
+    size += (spans > 1 ? spans : 1) *
+      webvtt_write_view_size(&view, track->header);
+  }
+  segments->offsets = (size_t*)malloc((segments->count + 1) *
+                                      sizeof(*segments->offsets));
+  segments->durations = (int64_t*)malloc(segments->count *
+                                         sizeof(*segments->durations));
+  carry = (unsigned*)malloc((track->count + 1) * sizeof(*carry));
+  if (segments->offsets == NULL || segments->durations == NULL ||
+      carry == NULL || webvtt_buffer_reserve(&segments->data, size) < 0)
+    goto fail;
+
+  /* cues that started in an earlier segment and are still showing are
+  kept in carry, in start order, ahead of the ones starting here */
+  next = carried = 0;
+  for (s = 0; s < segments->count; s++) {
+    from = (int64_t)s * duration;
+    to = from + duration;
+    segments->offsets[s] = segments->data.length;
+    segments->durations[s] = (to < last ? to : last) - from;
+    if (write_segment_header(&segments->data, mpegts, &blocks) < 0)
+      goto fail;
+
+    for (i = kept = 0; i < carried; i++) {
+      if (write_cue(&segments->data, track, carry[i]) < 0)
+        goto fail;
+      if (end[carry[i]] > to)
+        carry[kept++] = carry[i];
+    }
+    for (; next < track->count && start[next] < to; next++) {
+      if (write_cue(&segments->data, track, next) < 0)
+        goto fail;
+      if (end[next] > to)
+        carry[kept++] = next;
+    }
+    carried = kept;
+  }
+  segments->offsets[segments->count] = segments->data.length;
+  free(carry);
+  webvtt_buffer_free(&blocks);
+  return 0;
+
+fail:
+  free(carry);
+  webvtt_buffer_free(&blocks);
+  webvtt_segments_free(segments);
+  return -1;
+}
+
+void
+  webvtt_segments_free(webvtt_segments *segments)
+{
+  free(segments->offsets);
+  free(segments->durations);
+  webvtt_buffer_free(&segments->data);
+  segments->offsets = NULL;
+  segments->durations = NULL;
+  segments->count = 0;
+}
+
+int
+  webvtt_segments_playlist(const webvtt_segments *segments,
+                           const char *prefix, const char *suffix,
+                           webvtt_buffer *out)
+{
+  char line[64];
+  int64_t ms, longest = 0;
+  unsigned s;
+  int n;
+
+  for (s = 0; s < segments->count; s++) {
+    if (segments->durations[s] > longest)
+      longest = segments->durations[s];
+  }
+  longest = webvtt_rescale(longest, segments->timebase, webvtt_timebase_ms);
+
+  n = snprintf(line, sizeof(line),
+               "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%lld\n",
+               (long long)((longest + 999) / 1000));
+  if (webvtt_buffer_append(out, line, n) < 0)
+    return -1;
+  if (webvtt_buffer_append(out, "#EXT-X-MEDIA-SEQUENCE:0\n"
+                           "#EXT-X-PLAYLIST-TYPE:VOD\n", 49) < 0)
+    return -1;
+
+  for (s = 0; s < segments->count; s++) {
+    ms = webvtt_rescale(segments->durations[s], segments->timebase,
+                        webvtt_timebase_ms);
+    n = snprintf(line, sizeof(line), "#EXTINF:%lld.%03d,\n",
+                 (long long)(ms / 1000), (int)(ms % 1000));
+    if (webvtt_buffer_append(out, line, n) < 0 ||
+        webvtt_buffer_append(out, prefix, strlen(prefix)) < 0)
+      return -1;
+    n = snprintf(line, sizeof(line), "%u", s);
+    if (webvtt_buffer_append(out, line, n) < 0 ||
+        webvtt_buffer_append(out, suffix, strlen(suffix)) < 0 ||
+        webvtt_buffer_append(out, "\n", 1) < 0)
+      return -1;
+  }
+  return webvtt_buffer_append(out, "#EXT-X-ENDLIST\n", 15);
+}
@@ -0,0 +1,52 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_SEGMENTER_H_
+#define _WEBVTT_SEGMENTER_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt_buffer.h"
+#include "webvtt_track.h"
+
+  /* HLS subtitle segmentation. the timeline is cut every target
+  duration, starting at 0, and every cue is written to each segment it
+  overlaps. each payload carries an X-TIMESTAMP-MAP header mapping
+  local time 0 to the given MPEG-TS timestamp, so cue times stay the
+  track times */
+  typedef struct webvtt_segments webvtt_segments;
+  struct webvtt_segments {
+    unsigned count;
+    webvtt_buffer data;   /** all payloads back to back */
+    size_t *offsets;      /** payload i is data[offsets[i], offsets[i+1]) */
+    int64_t *durations;   /** in ticks of timebase */
+    webvtt_timebase timebase;
+  };
+
+  /* segment a track whose cues are sorted by start time, in a single
+  pass. duration is in ticks of the track timebase and mpegts in 90 kHz
+  ticks. returns -1 when out of memory or when the track is not sorted */
+  int webvtt_segment_track(const webvtt_track *track, int64_t duration,
+                           uint64_t mpegts, webvtt_segments *segments);
+
+  void webvtt_segments_free(webvtt_segments *segments);
+
+  /* a VOD media playlist for the segments. segment i is referenced as
+  prefix, i, suffix, e.g. "sub_" 3 ".webvtt" */
+  int webvtt_segments_playlist(const webvtt_segments *segments,
+                               const char *prefix, const char *suffix,
+                               webvtt_buffer *out);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_SEGMENTER_H_ */
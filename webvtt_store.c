@@ -0,0 +1,472 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "webvtt_store.h"
+
+/* a checkpoint every this many cues lets webvtt_store_seek skip ahead
+without decoding the whole stream */
+#define CHECKPOINT_INTERVAL 64
+
+/* packed settings word, laid out so that the common cases (an id, a
+settings line and a non default align) fit in a single varint byte */
+#define PACK_HAS_ID 0x001
+#define PACK_HAS_SETTINGS 0x002
+#define PACK_ALIGN_SHIFT 2      /* 3 bits */
+#define PACK_VERTICAL_SHIFT 5   /* 2 bits */
+#define PACK_LAYOUT 0x080       /* line set, position or size not default */
+#define PACK_PAUSE_ON_EXIT 0x100
+#define PACK_NO_SNAP_TO_LINE 0x200
+#define PACK_LINE 0x400         /* line is set, part of the layout */
+#define PACK_REGION 0x800       /* a region index follows */
+
+#define DEFAULT_LINE 0
+#define DEFAULT_POSITION 50
+#define DEFAULT_SIZE 100
+
+typedef struct checkpoint checkpoint;
+struct checkpoint {
+  uint32_t offset;  /* into the stream */
+  int64_t start;    /* start of the cue before it */
+};
+
+struct webvtt_store {
+  unsigned cue_count;
+  unsigned string_count;
+  webvtt_timebase timebase;
+  size_t size;
+  size_t shared;
+  const unsigned char *stream;
+  const uint32_t *strings;  /* offset into pool and length of each string */
+  const char *pool;
+  const checkpoint *checkpoints;
+};
+
+/* growable byte buffer used while packing */
+typedef struct bytes bytes;
+struct bytes {
+  unsigned char *data;
+  size_t length, capacity;
+};
+
+static int bytes_reserve(bytes *b, size_t more) {
+  size_t capacity;
+  unsigned char *data;
+  if (b->length + more <= b->capacity)
+    return 0;
+  capacity = b->capacity ? b->capacity * 2 : 256;
+  while (capacity < b->length + more)
+    capacity *= 2;
+  data = (unsigned char*)realloc(b->data, capacity);
+  if (data == NULL)
+    return -1;
+  b->data = data;
+  b->capacity = capacity;
+  return 0;
+}
+
+static int put_varint(bytes *b, unsigned long long v) {
+  if (bytes_reserve(b, 10) < 0)
+    return -1;
+  while (v >= 0x80) {
+    b->data[b->length++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  b->data[b->length++] = (unsigned char)v;
+  return 0;
+}
+
+static int put_signed(bytes *b, long long v) {
+  return put_varint(b, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+}
+
+static unsigned long long get_varint(const unsigned char **p) {
+  unsigned long long v = 0;
+  unsigned shift = 0;
+  while (**p & 0x80) {
+    v |= (unsigned long long)(*(*p)++ & 0x7f) << shift;
+    shift += 7;
+  }
+  v |= (unsigned long long)*(*p)++ << shift;
+  return v;
+}
+
+static long long get_signed(const unsigned char **p) {
+  unsigned long long v = get_varint(p);
+  return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+/* deduplicating string table, open addressing over (pointer, length).
+a string that is a prefix of another one can be stored inside it, see
+strings_share */
+typedef struct strings strings;
+struct strings {
+  const char **s;
+  unsigned *length;
+  unsigned *alias;          /* index + 1 of a string this one prefixes */
+  unsigned count, capacity;
+  unsigned *slots;          /* index + 1, 0 is empty */
+  unsigned slot_count;
+  size_t pool_size;
+  size_t shared;            /* bytes saved by strings_share */
+};
+
+static unsigned hash_string(const char *s, unsigned length) {
+  unsigned h = 2166136261u;
+  unsigned i;
+  for (i = 0; i < length; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static int strings_grow(strings *t) {
+  unsigned slot_count = t->slot_count ? t->slot_count * 2 : 64;
+  unsigned *slots = (unsigned*)calloc(slot_count, sizeof(*slots));
+  const char **s;
+  unsigned *length, *alias;
+  unsigned i, h;
+
+  if (slots == NULL)
+    return -1;
+  s = (const char**)realloc(t->s, slot_count / 2 * sizeof(*s));
+  if (s == NULL) {
+    free(slots);
+    return -1;
+  }
+  t->s = s;
+  length = (unsigned*)realloc(t->length, slot_count / 2 * sizeof(*length));
+  if (length == NULL) {
+    free(slots);
+    return -1;
+  }
+  t->length = length;
+  alias = (unsigned*)realloc(t->alias, slot_count / 2 * sizeof(*alias));
+  if (alias == NULL) {
+    free(slots);
+    return -1;
+  }
+  memset(alias + t->capacity, 0, (slot_count / 2 - t->capacity) * sizeof(*alias));
+  t->alias = alias;
+  for (i = 0; i < t->count; i++) {
+    h = hash_string(t->s[i], t->length[i]) & (slot_count - 1);
+    while (slots[h])
+      h = (h + 1) & (slot_count - 1);
+    slots[h] = i + 1;
+  }
+  free(t->slots);
+  t->slots = slots;
+  t->slot_count = slot_count;
+  t->capacity = slot_count / 2;
+  return 0;
+}
+
+/* returns the index of s in the table, adding it if needed */
+static long strings_add(strings *t, const char *s, unsigned length) {
+  unsigned h, n;
+  if (t->count == t->capacity && strings_grow(t) < 0)
+    return -1;
+  h = hash_string(s, length) & (t->slot_count - 1);
+  while ((n = t->slots[h]) != 0) {
+    if (t->length[n - 1] == length && memcmp(t->s[n - 1], s, length) == 0)
+      return n - 1;
+    h = (h + 1) & (t->slot_count - 1);
+  }
+  t->s[t->count] = s;
+  t->length[t->count] = length;
+  t->slots[h] = ++t->count;
+  t->pool_size += length + 1;
+  return t->count - 1;
+}
+
+/* roll-up captions repeat the previous cue's text with a line added.
+when one string starts with the other, the shorter one is kept as a
+window on the longer one instead of a copy of its own */
+static void strings_share(strings *t, long a, long b) {
+  long shorter = a, longer = b;
+
+  if (t->length[a] > t->length[b]) {
+    shorter = b;
+    longer = a;
+  }
+  if (a == b || t->alias[shorter] || t->length[shorter] == t->length[longer] ||
+      memcmp(t->s[shorter], t->s[longer], t->length[shorter]) != 0)
+    return;
+  t->alias[shorter] = longer + 1;
+  t->pool_size -= t->length[shorter] + 1;
+  t->shared += t->length[shorter];
+}
+
+static void strings_free(strings *t) {
+  free(t->s);
+  free(t->length);
+  free(t->alias);
+  free(t->slots);
+}
+
+static int pack_cue(bytes *b, strings *t, const webvtt_cue_view *view,
+                    int64_t previous_start, long *previous_text) {
+  unsigned packed = 0;
+  long text, id = 0, settings = 0;
+
+  text = strings_add(t, view->text, view->text_length);
+  if (text >= 0 && *previous_text >= 0)
+    strings_share(t, *previous_text, text);
+  *previous_text = text;
+  if (view->cueID) {
+    packed |= PACK_HAS_ID;
+    id = strings_add(t, view->cueID, view->cueID_length);
+  }
+  if (view->settings) {
+    packed |= PACK_HAS_SETTINGS;
+    settings = strings_add(t, view->settings, view->settings_length);
+  }
+  if (text < 0 || id < 0 || settings < 0)
+    return -1;
+
+  packed |= (unsigned)view->align << PACK_ALIGN_SHIFT;
+  packed |= (unsigned)view->vertical << PACK_VERTICAL_SHIFT;
+  if (!view->lineAuto)
+    packed |= PACK_LINE | PACK_LAYOUT;
+  if (view->position != DEFAULT_POSITION || view->size != DEFAULT_SIZE)
+    packed |= PACK_LAYOUT;
+  if (view->pauseOnExit)
+    packed |= PACK_PAUSE_ON_EXIT;
+  if (!view->snapToLine)
+    packed |= PACK_NO_SNAP_TO_LINE;
+  if (view->region)
+    packed |= PACK_REGION;
+
+  if (put_varint(b, packed) < 0 ||
+      put_signed(b, view->start - previous_start) < 0 ||
+      put_signed(b, view->end - view->start) < 0 ||
+      put_varint(b, text) < 0)
+    return -1;
+  if (packed & PACK_HAS_ID && put_varint(b, id) < 0)
+    return -1;
+  if (packed & PACK_HAS_SETTINGS && put_varint(b, settings) < 0)
+    return -1;
+  if (packed & PACK_LINE && put_signed(b, view->line) < 0)
+    return -1;
+  if (packed & PACK_LAYOUT &&
+      (put_signed(b, view->position) < 0 ||
+       put_signed(b, view->size) < 0))
+    return -1;
+  if (packed & PACK_REGION && put_varint(b, view->region) < 0)
+    return -1;
+  return 0;
+}
+
+webvtt_store *
+  webvtt_store_new(const webvtt_cue *head, webvtt_timebase timebase)
+{
+  bytes stream = { NULL, 0, 0 };
+  bytes marks = { NULL, 0, 0 };
+  strings table;
+  const webvtt_cue *cue;
+  webvtt_cue_view view;
+  webvtt_store *store = NULL;
+  checkpoint mark;
+  unsigned count = 0, marks_count, i, root;
+  int64_t previous_start = 0;
+  long previous_text = -1;
+  size_t size, offset;
+  uint32_t *offsets;
+  char *block, *pool;
+
+  memset(&table, 0, sizeof(table));
+
+  for (cue = head; cue != NULL; cue = cue->next, count++) {
+    if (count % CHECKPOINT_INTERVAL == 0) {
+      mark.offset = (uint32_t)stream.length;
+      mark.start = previous_start;
+      if (bytes_reserve(&marks, sizeof(mark)) < 0)
+        goto done;
+      memcpy(marks.data + marks.length, &mark, sizeof(mark));
+      marks.length += sizeof(mark);
+    }
+    webvtt_cue_view_of(cue, &view);
+    if (pack_cue(&stream, &table, &view, previous_start, &previous_text) < 0)
+      goto done;
+    previous_start = view.start;
+  }
+  marks_count = marks.length / sizeof(mark);
+
+  /* store, checkpoints and string offsets first to keep them aligned,
+  then the byte stream and the pool */
+  size = sizeof(*store);
+  size += marks.length;
+  size += table.count * 2 * sizeof(uint32_t);
+  size += stream.length + table.pool_size;
+  block = (char*)malloc(size);
+  if (block == NULL)
+    goto done;
+
+  store = (webvtt_store*)block;
+  store->cue_count = count;
+  store->string_count = table.count;
+  store->timebase = timebase;
+  store->size = size;
+  store->shared = table.shared;
+  offset = sizeof(*store);
+  if (marks_count)
+    memcpy(block + offset, marks.data, marks.length);
+  store->checkpoints = (const checkpoint*)(block + offset);
+  offset += marks.length;
+  offsets = (uint32_t*)(block + offset);
+  store->strings = offsets;
+  offset += table.count * 2 * sizeof(uint32_t);
+  if (stream.length)
+    memcpy(block + offset, stream.data, stream.length);
+  store->stream = (const unsigned char*)(block + offset);
+  offset += stream.length;
+  pool = block + offset;
+  store->pool = pool;
+
+  /* strings of their own first, then the shared ones point into the
+  longest string of their chain */
+  offset = 0;
+  for (i = 0; i < table.count; i++) {
+    offsets[2 * i + 1] = table.length[i];
+    if (table.alias[i])
+      continue;
+    offsets[2 * i] = (uint32_t)offset;
+    memcpy(pool + offset, table.s[i], table.length[i]);
+    pool[offset + table.length[i]] = '\0';
+    offset += table.length[i] + 1;
+  }
+  for (i = 0; i < table.count; i++) {
+    root = i;
+    while (table.alias[root])
+      root = table.alias[root] - 1;
+    offsets[2 * i] = offsets[2 * root];
+  }
+
+done:
+  free(stream.data);
+  free(marks.data);
+  strings_free(&table);
+  return store;
+}
+
+void
+  webvtt_store_free(webvtt_store *store)
+{
+  free(store);
+}
+
+unsigned
+  webvtt_store_cue_count(const webvtt_store *store)
+{
+  return store->cue_count;
+}
+
+webvtt_timebase
+  webvtt_store_timebase(const webvtt_store *store)
+{
+  return store->timebase;
+}
+
+size_t
+  webvtt_store_size(const webvtt_store *store)
+{
+  return store->size;
+}
+
+size_t
+  webvtt_store_shared(const webvtt_store *store)
+{
+  return store->shared;
+}
+
+void
+  webvtt_store_begin(const webvtt_store *store, webvtt_store_iter *it)
+{
+  it->store = store;
+  it->p = store->stream;
+  it->index = 0;
+  it->start = 0;
+}
+
+int
+  webvtt_store_seek(webvtt_store_iter *it, unsigned index)
+{
+  const webvtt_store *store = it->store;
+  const checkpoint *mark;
+  webvtt_cue_view view;
+
+  if (index > store->cue_count)
+    return -1;
+  if (index == store->cue_count) {
+    it->index = index;
+    return 0;
+  }
+  mark = store->checkpoints + index / CHECKPOINT_INTERVAL;
+  it->p = store->stream + mark->offset;
+  it->index = index - index % CHECKPOINT_INTERVAL;
+  it->start = mark->start;
+  while (it->index < index)
+    webvtt_store_next(it, &view);
+  return 0;
+}
+
+static void string_view(const webvtt_store *store, unsigned long long n,
+                        const char **s, unsigned *length) {
+  *s = store->pool + store->strings[2 * n];
+  *length = store->strings[2 * n + 1];
+}
+
+int
+  webvtt_store_next(webvtt_store_iter *it, webvtt_cue_view *view)
+{
+  const webvtt_store *store = it->store;
+  unsigned packed;
+
+  if (it->index >= store->cue_count)
+    return 0;
+
+  packed = (unsigned)get_varint(&it->p);
+  view->start = it->start + get_signed(&it->p);
+  view->end = view->start + get_signed(&it->p);
+  string_view(store, get_varint(&it->p), &view->text, &view->text_length);
+
+  view->cueID = NULL;
+  view->cueID_length = 0;
+  if (packed & PACK_HAS_ID)
+    string_view(store, get_varint(&it->p), &view->cueID, &view->cueID_length);
+
+  view->settings = NULL;
+  view->settings_length = 0;
+  if (packed & PACK_HAS_SETTINGS)
+    string_view(store, get_varint(&it->p), &view->settings,
+                &view->settings_length);
+
+  view->align = (enum webvtt_align)(packed >> PACK_ALIGN_SHIFT & 0x7);
+  view->vertical = (enum webvtt_vertical)(packed >> PACK_VERTICAL_SHIFT & 0x3);
+  view->pauseOnExit = (packed & PACK_PAUSE_ON_EXIT) != 0;
+  view->snapToLine = (packed & PACK_NO_SNAP_TO_LINE) == 0;
+  view->lineAuto = (packed & PACK_LINE) == 0;
+  view->line = DEFAULT_LINE;
+  if (packed & PACK_LINE)
+    view->line = (long)get_signed(&it->p);
+  view->position = DEFAULT_POSITION;
+  view->size = DEFAULT_SIZE;
+  if (packed & PACK_LAYOUT) {
+    view->position = (long)get_signed(&it->p);
+    view->size = (long)get_signed(&it->p);
+  }
+  view->region = 0;
+  if (packed & PACK_REGION)
+    view->region = (unsigned)get_varint(&it->p);
+
+  it->start = view->start;
+  it->index++;
+  return 1;
+}
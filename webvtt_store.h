@@ -0,0 +1,71 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_STORE_H_
+#define _WEBVTT_STORE_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "webvtt.h"
+
+  /* compressed read-only cue store for keeping many tracks resident.
+  each cue is a short byte record: bit-packed settings, varint start
+  delta and duration, and indexes into a deduplicated string table.
+  when a cue's text is a prefix of the next one's, or the other way
+  round, only the longer text is kept. a whole store is one allocation */
+  typedef struct webvtt_store webvtt_store;
+
+  /* decoding position inside a store, cheap to copy */
+  typedef struct webvtt_store_iter webvtt_store_iter;
+  struct webvtt_store_iter {
+    const webvtt_store *store;
+    const unsigned char *p;
+    unsigned index;
+    int64_t start;            /** start of the previous cue */
+  };
+
+  /* pack a cue list whose timestamps are in the given timebase,
+  returns NULL when out of memory */
+  webvtt_store *webvtt_store_new(const webvtt_cue *head,
+                                 webvtt_timebase timebase);
+
+  void webvtt_store_free(webvtt_store *store);
+
+  unsigned webvtt_store_cue_count(const webvtt_store *store);
+
+  webvtt_timebase webvtt_store_timebase(const webvtt_store *store);
+
+  /* total bytes held by the store */
+  size_t webvtt_store_size(const webvtt_store *store);
+
+  /* text bytes that are shared with a neighbouring cue rather than
+  stored again */
+  size_t webvtt_store_shared(const webvtt_store *store);
+
+  /* position an iterator before the first cue */
+  void webvtt_store_begin(const webvtt_store *store, webvtt_store_iter *it);
+
+  /* position an iterator before cue number index, returns -1 if there
+  is no such cue */
+  int webvtt_store_seek(webvtt_store_iter *it, unsigned index);
+
+  /* decode the next cue into view. strings point into the store and
+  are not always NUL terminated, use the lengths. returns 1 when a cue
+  was produced and 0 at the end */
+  int webvtt_store_next(webvtt_store_iter *it, webvtt_cue_view *view);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_STORE_H_ */
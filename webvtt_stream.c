@@ -0,0 +1,464 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "webvtt_stream.h"
+#include "webvtt_buffer.h"
+#include "webvtt_utf8.h"
+
+/* big enough that a read is worth a thread switch, small enough that
+two of them stay in the cache the parser works from */
+#define READ_SIZE (256 * 1024)
+
+struct webvtt_stream {
+  webvtt_parser *ctx;
+  webvtt_buffer pending;    /* UTF-8 not parsed yet, from a block start */
+  size_t scan;              /* bytes of pending already looked at */
+  size_t line;              /* where the line being scanned starts */
+  size_t mark;              /* and where its trailing spaces start */
+  int blank;                /* the line being scanned is blank so far */
+  int skip;                 /* the block is past what the limits keep */
+  int started;              /* the encoding is known */
+  enum webvtt_encoding encoding;
+  char carry[4];            /* bytes waiting for the rest of a unit */
+  unsigned carry_length;
+  webvtt_buffer scratch;    /* UTF-16 to convert, a block to repair */
+  int failed;
+  webvtt_cue *head, *tail;
+  unsigned count;           /* cues parsed, taken or not */
+};
+
+webvtt_stream *
+  webvtt_stream_new(webvtt_parser *ctx)
+{
+  webvtt_stream *stream = (webvtt_stream*)calloc(1, sizeof(*stream));
+
+  if (stream == NULL)
+    return NULL;
+  stream->ctx = ctx;
+  webvtt_parse_reset(ctx);
+  webvtt_buffer_init(&stream->pending);
+  webvtt_buffer_init(&stream->scratch);
+  if (webvtt_buffer_reserve(&stream->pending, 1) < 0 ||
+      webvtt_buffer_reserve(&stream->scratch, 1) < 0) {
+    webvtt_stream_free(stream);
+    return NULL;
+  }
+  stream->blank = 1;
+  return stream;
+}
+
+void
+  webvtt_stream_free(webvtt_stream *stream)
+{
+  webvtt_cue *next;
+
+  if (stream) {
+    for (; stream->head != NULL; stream->head = next) {
+      next = stream->head->next;
+      webvtt_cue_free(stream->head);
+    }
+    webvtt_buffer_free(&stream->pending);
+    webvtt_buffer_free(&stream->scratch);
+    free(stream);
+  }
+}
+
+webvtt_cue *
+  webvtt_stream_take(webvtt_stream *stream)
+{
+  webvtt_cue *head = stream->head;
+  stream->head = stream->tail = NULL;
+  return head;
+}
+
+webvtt_timebase
+  webvtt_stream_timebase(const webvtt_stream *stream)
+{
+  return webvtt_parse_timestamp_map(stream->ctx).timebase;
+}
+
+static int parse_one(webvtt_stream *stream, const char *block,
+                     unsigned length) {
+  unsigned limit = webvtt_parse_limits(stream->ctx)->cues;
+  webvtt_cue *cue, *next;
+
+  /* past the cue limit the rest of the file is only skipped */
+  if (limit && stream->count >= limit)
+    return 0;
+
+  /* blocks end at a line break, so no sequence is cut in two and
+  repairing one block at a time is the same as the whole file */
+  if (webvtt_utf8_valid(block, length) != length) {
+    stream->scratch.length = 0;
+    if (webvtt_utf8_repair(block, length, &stream->scratch) < 0)
+      return -1;
+    block = stream->scratch.data;
+    length = stream->scratch.length;
+  }
+  if (webvtt_parse_block(stream->ctx, block, length, &cue) < 0)
+    return -1;
+  for (; cue != NULL; cue = next) {
+    next = cue->next;
+    if (limit && stream->count == limit) {
+      webvtt_cue_free(cue);
+      continue;
+    }
+    if (stream->head == NULL)
+      stream->head = cue;
+    else
+      stream->tail->next = cue;
+    stream->tail = cue;
+    cue->next = NULL;
+    stream->count++;
+  }
+  return 0;
+}
+
+/* parse pending up to the end of its last blank line, or all of it at
+the end of the file, and keep the rest for the next piece. what the
+parser would drop is dropped while scanning, so one endless line or
+block is skipped through rather than held: trailing spaces, lines past
+the line length limit, timing lines included, and the lines of a block
+past what its id, timing line and cue text can keep. a cut line ends
+in a mark past the limit, so the parser strips its trailing spaces as
+it would have for the whole line */
+static int parse_pending(webvtt_stream *stream, int final) {
+  const webvtt_limits *limits = webvtt_parse_limits(stream->ctx);
+  size_t line_cap = limits->line_length ? limits->line_length + 4 : 0;
+  /* a line held takes at most one and a half times the cue text it
+  makes, the line break counted */
+  size_t block_cap = line_cap && limits->cue_text ?
+    2 * (limits->cue_text + line_cap + 3) : 0;
+  char *s = stream->pending.data;
+  size_t length = stream->pending.length, i, w, limit = 0;
+  unsigned start = 0, end;
+
+  for (i = w = stream->scan; i < length; i++) {
+    if (isNewline(s[i])) {
+      if (s[i] == '\r' && i + 1 == length && !final)
+        break;              /* \r\n cut in two */
+      if (stream->skip && stream->blank)
+        stream->skip = 0;
+      if (!stream->skip) {
+        /* the \n after a blank line could join a \r before it */
+        w = stream->mark;
+        s[w] = s[i] == '\n' && w > 0 && s[w - 1] == '\r' ? '\r' : s[i];
+        w++;
+      }
+      if (s[i] == '\r' && i + 1 < length && s[i + 1] == '\n' &&
+          (i++, !stream->skip))
+        s[w++] = s[i];
+      stream->line = stream->mark = w;
+      if (stream->blank)
+        limit = w;
+      else if (block_cap && w - limit > block_cap)
+        stream->skip = 1;
+      stream->blank = 1;
+      continue;
+    }
+    if (!isASpace(s[i]))
+      stream->blank = 0;
+    if (stream->skip)
+      continue;
+    if (line_cap && w - stream->line >= line_cap) {
+      if (w - stream->line == line_cap && !isASpace(s[i])) {
+        s[w++] = '~';
+        stream->mark = w;
+      }
+      continue;
+    }
+    s[w++] = s[i];
+    if (!isASpace(s[i]))
+      stream->mark = w;
+  }
+  memmove(s + w, s + i, length - i);
+  stream->pending.length = w + (length - i);
+  stream->scan = w;
+  if (final)
+    limit = stream->pending.length;
+  if (limit == 0)
+    return 0;
+
+  while (start < limit) {
+    end = webvtt_next_block(s, limit, &start);
+    if (start == limit)
+      break;
+    if (parse_one(stream, s + start, end - start) < 0)
+      return -1;
+    start = end;
+  }
+  length = stream->pending.length;
+  memmove(s, s + limit, length - limit);
+  stream->pending.length -= limit;
+  stream->scan -= limit;
+  stream->line = final ? 0 : stream->line - limit;
+  stream->mark = final ? 0 : stream->mark - limit;
+  return 0;
+}
+
+/* UTF-16 goes in as whole units and pairs, what is left of a piece
+waits in carry. at the end of the file a lone byte or surrogate
+becomes U+FFFD */
+static int convert_utf16(webvtt_stream *stream, const char *data,
+                         size_t length, int final) {
+  webvtt_buffer *in = &stream->scratch;
+  size_t n;
+  unsigned high;
+
+  in->length = 0;
+  if (webvtt_buffer_append(in, stream->carry, stream->carry_length) < 0 ||
+      webvtt_buffer_append(in, data, length) < 0)
+    return -1;
+  n = final ? in->length : in->length & ~(size_t)1;
+  if (!final && n >= 2) {
+    high = stream->encoding == WEBVTT_ENCODING_UTF16BE ?
+      (unsigned char)in->data[n - 2] : (unsigned char)in->data[n - 1];
+    if (high >= 0xd8 && high <= 0xdb)
+      n -= 2;
+  }
+  stream->carry_length = in->length - n;
+  memcpy(stream->carry, in->data + n, stream->carry_length);
+  return webvtt_utf16_to_utf8(in->data, n,
+                              stream->encoding == WEBVTT_ENCODING_UTF16BE,
+                              &stream->pending);
+}
+
+static int feed(webvtt_stream *stream, const char *data, size_t length,
+                int final) {
+  size_t take;
+
+  if (stream->failed)
+    return -1;
+  if (!stream->started) {
+    /* two bytes tell a UTF-16 byte order mark */
+    take = length < 2 - stream->carry_length ? length :
+      2 - stream->carry_length;
+    memcpy(stream->carry + stream->carry_length, data, take);
+    stream->carry_length += take;
+    data += take;
+    length -= take;
+    if (stream->carry_length < 2 && !final)
+      return 0;
+    stream->started = 1;
+    stream->encoding = webvtt_detect_encoding(stream->carry,
+                                              stream->carry_length);
+    if (stream->encoding != WEBVTT_ENCODING_UTF8) {
+      stream->carry_length = 0;
+    } else {
+      if (webvtt_buffer_append(&stream->pending, stream->carry,
+                               stream->carry_length) < 0)
+        goto fail;
+      stream->carry_length = 0;
+    }
+  }
+  if (stream->encoding != WEBVTT_ENCODING_UTF8) {
+    if (convert_utf16(stream, data, length, final) < 0)
+      goto fail;
+  } else if (webvtt_buffer_append(&stream->pending, data, length) < 0) {
+    goto fail;
+  }
+  if (parse_pending(stream, final) < 0)
+    goto fail;
+  return 0;
+
+fail:
+  stream->failed = 1;
+  return -1;
+}
+
+int
+  webvtt_stream_feed(webvtt_stream *stream, const char *data, size_t length)
+{
+  return feed(stream, data, length, 0);
+}
+
+int
+  webvtt_stream_finish(webvtt_stream *stream)
+{
+  if (feed(stream, "", 0, 1) < 0)
+    return -1;
+  if (!webvtt_parse_signed(stream->ctx)) {
+    stream->failed = 1;
+    return -1;
+  }
+  return 0;
+}
+
+/* fill buf unless the file ends first */
+ssize_t
+  webvtt_stream_fd_source(void *data, char *buf, size_t size)
+{
+  int fd = *(int*)data;
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < size) {
+    n = read(fd, buf + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+/* two buffers passed between the producing thread and the parser. a
+slot is full once filled, and free again once parsed. a full slot of
+length 0 is the end of the input, -1 an error */
+typedef struct reader reader;
+struct reader {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  webvtt_stream_source source;
+  void *data;
+  char *slots[2];
+  ssize_t lengths[2];
+  int full[2];
+  int stop;                 /* the parser gave up */
+};
+
+static void *read_ahead(void *arg) {
+  reader *r = (reader*)arg;
+  unsigned k;
+  ssize_t n;
+
+  for (k = 0;; k ^= 1) {
+    pthread_mutex_lock(&r->lock);
+    while (r->full[k] && !r->stop)
+      pthread_cond_wait(&r->changed, &r->lock);
+    if (r->stop) {
+      pthread_mutex_unlock(&r->lock);
+      break;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    n = r->source(r->data, r->slots[k], READ_SIZE);
+
+    pthread_mutex_lock(&r->lock);
+    r->lengths[k] = n;
+    r->full[k] = 1;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+    if (n <= 0)
+      break;
+  }
+  return NULL;
+}
+
+static int pull_overlapped(webvtt_stream *stream,
+                           webvtt_stream_source source, void *data) {
+  reader r;
+  pthread_t thread;
+  unsigned k;
+  ssize_t n;
+  int result = 0;
+
+  memset(&r, 0, sizeof(r));
+  r.source = source;
+  r.data = data;
+  r.slots[0] = (char*)malloc(2 * READ_SIZE);
+  if (r.slots[0] == NULL)
+    return -1;
+  r.slots[1] = r.slots[0] + READ_SIZE;
+  if (pthread_mutex_init(&r.lock, NULL) != 0) {
+    free(r.slots[0]);
+    return -1;
+  }
+  if (pthread_cond_init(&r.changed, NULL) != 0) {
+    pthread_mutex_destroy(&r.lock);
+    free(r.slots[0]);
+    return -1;
+  }
+  if (pthread_create(&thread, NULL, read_ahead, &r) != 0) {
+    pthread_cond_destroy(&r.changed);
+    pthread_mutex_destroy(&r.lock);
+    free(r.slots[0]);
+    return -1;
+  }
+
+  for (k = 0;; k ^= 1) {
+    pthread_mutex_lock(&r.lock);
+    while (!r.full[k])
+      pthread_cond_wait(&r.changed, &r.lock);
+    n = r.lengths[k];
+    pthread_mutex_unlock(&r.lock);
+    if (n <= 0) {
+      result = n < 0 ? -1 : webvtt_stream_finish(stream);
+      break;
+    }
+    if (webvtt_stream_feed(stream, r.slots[k], n) < 0) {
+      result = -1;
+      break;
+    }
+    pthread_mutex_lock(&r.lock);
+    r.full[k] = 0;
+    pthread_cond_broadcast(&r.changed);
+    pthread_mutex_unlock(&r.lock);
+  }
+
+  pthread_mutex_lock(&r.lock);
+  r.stop = 1;
+  pthread_cond_broadcast(&r.changed);
+  pthread_mutex_unlock(&r.lock);
+  pthread_join(thread, NULL);
+  pthread_cond_destroy(&r.changed);
+  pthread_mutex_destroy(&r.lock);
+  free(r.slots[0]);
+  return result;
+}
+
+int
+  webvtt_stream_pull(webvtt_stream *stream, webvtt_stream_source source,
+                     void *data, int overlap)
+{
+  char *buf;
+  ssize_t n;
+  int result;
+
+  if (overlap)
+    return pull_overlapped(stream, source, data);
+
+  buf = (char*)malloc(READ_SIZE);
+  if (buf == NULL)
+    return -1;
+  while ((n = source(data, buf, READ_SIZE)) > 0) {
+    if (webvtt_stream_feed(stream, buf, n) < 0)
+      break;
+  }
+  result = n == 0 ? webvtt_stream_finish(stream) : -1;
+  free(buf);
+  return result;
+}
+
+int
+  webvtt_stream_read(webvtt_stream *stream, int fd, int overlap)
+{
+  struct stat st;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  /* a file that fits in one read has nothing to overlap with */
+  if (overlap && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size <= READ_SIZE)
+    overlap = 0;
+  return webvtt_stream_pull(stream, webvtt_stream_fd_source, &fd, overlap);
+}
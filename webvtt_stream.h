@@ -0,0 +1,79 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_STREAM_H_
+#define _WEBVTT_STREAM_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "webvtt.h"
+
+  /* a file handed over in pieces of any size. every block that is
+  known to be complete, the ones a blank line follows, is parsed as
+  soon as it arrives, so only the block in progress is held, and of it
+  no more than the line length and cue text limits keep. pieces are
+  converted to UTF-8 on the way in, like a whole file is */
+
+  typedef struct webvtt_stream webvtt_stream;
+
+  /* a stream parsing with ctx, whose timebase, atoms and format apply.
+  ctx is reset and must not be used for anything else until the
+  stream is freed */
+  webvtt_stream *webvtt_stream_new(webvtt_parser *ctx);
+
+  /* the cues not taken are freed, ctx is not */
+  void webvtt_stream_free(webvtt_stream *stream);
+
+  /* the next piece of the file. returns -1 when out of memory or when
+  the file turns out not to be WebVTT, and from then on */
+  int webvtt_stream_feed(webvtt_stream *stream, const char *data,
+                         size_t length);
+
+  /* the file has ended, parse what is left of it. returns -1 as feed
+  does, and also when a WebVTT file ended before its signature */
+  int webvtt_stream_finish(webvtt_stream *stream);
+
+  /* the cues parsed so far, in file order. the caller owns them */
+  webvtt_cue *webvtt_stream_take(webvtt_stream *stream);
+
+  /* the timebase of the cues, the parser's */
+  webvtt_timebase webvtt_stream_timebase(const webvtt_stream *stream);
+
+  /* where webvtt_stream_pull gets the file from: puts up to size bytes
+  in buf and returns how many, 0 once the end has been reached and -1
+  on an error */
+  typedef ssize_t (*webvtt_stream_source)(void *data, char *buf,
+                                          size_t size);
+
+  /* a source reading the file descriptor data points at */
+  ssize_t webvtt_stream_fd_source(void *data, char *buf, size_t size);
+
+  /* feed everything source has, then finish. with overlap, source is
+  called on a second thread, filling one buffer while the other is
+  parsed. returns -1 when source or a feed fails */
+  int webvtt_stream_pull(webvtt_stream *stream, webvtt_stream_source source,
+                         void *data, int overlap);
+
+  /* feed everything read from fd up to its end, then finish. with
+  overlap, the next piece is read on a second thread while the last
+  one is parsed, so reading from a cold disk costs about as long as
+  the slower of the two rather than both. returns -1 on a read error
+  or when a feed fails */
+  int webvtt_stream_read(webvtt_stream *stream, int fd, int overlap);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_STREAM_H_ */
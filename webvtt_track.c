@@ -0,0 +1,242 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdlib.h>
+
+#include "webvtt_track.h"
+
+#define INITIAL_CAPACITY 64
+
+webvtt_track *
+  webvtt_track_new(webvtt_timebase timebase)
+{
+  webvtt_track *track;
+
+  if (timebase.num == 0 || timebase.den == 0)
+    return NULL;
+  track = (webvtt_track*)malloc(sizeof(*track));
+  if (track) {
+    track->count = 0;
+    track->capacity = 0;
+    track->start = NULL;
+    track->end = NULL;
+    track->cues = NULL;
+    track->timebase = timebase;
+    track->header = NULL;
+    track->atoms = NULL;
+  }
+  return track;
+}
+
+void
+  webvtt_track_free(webvtt_track *track)
+{
+  unsigned i;
+  if (track) {
+    for (i = 0; i < track->count; i++)
+      webvtt_cue_free(track->cues[i]);
+    free(track->start);
+    free(track->end);
+    free(track->cues);
+    webvtt_header_free(track->header);
+    webvtt_atoms_free(track->atoms);
+    free(track);
+  }
+}
+
+static int track_reserve(webvtt_track *track, unsigned capacity) {
+  int64_t *start, *end;
+  webvtt_cue **cues;
+
+  if (capacity <= track->capacity)
+    return 0;
+  start = (int64_t*)realloc(track->start, capacity * sizeof(*start));
+  if (start == NULL)
+    return -1;
+  track->start = start;
+  end = (int64_t*)realloc(track->end, capacity * sizeof(*end));
+  if (end == NULL)
+    return -1;
+  track->end = end;
+  cues = (webvtt_cue**)realloc(track->cues, capacity * sizeof(*cues));
+  if (cues == NULL)
+    return -1;
+  track->cues = cues;
+  track->capacity = capacity;
+  return 0;
+}
+
+int
+  webvtt_track_append(webvtt_track *track, webvtt_cue *cue)
+{
+  if (track->count == track->capacity &&
+      track_reserve(track, track->capacity ?
+                    track->capacity * 2 : INITIAL_CAPACITY) < 0)
+    return -1;
+  track->start[track->count] = cue->start;
+  track->end[track->count] = cue->end;
+  track->cues[track->count] = cue;
+  track->count++;
+  return 0;
+}
+
+webvtt_track *
+  webvtt_track_from_cues(webvtt_cue *head, webvtt_timebase timebase)
+{
+  webvtt_track *track = webvtt_track_new(timebase);
+  webvtt_cue *cue;
+  unsigned count = 0;
+
+  if (track == NULL)
+    return NULL;
+  for (cue = head; cue != NULL; cue = cue->next)
+    count++;
+  if (track_reserve(track, count) < 0) {
+    track->count = 0;
+    webvtt_track_free(track);
+    return NULL;
+  }
+  for (cue = head; cue != NULL; cue = cue->next)
+    webvtt_track_append(track, cue);
+  return track;
+}
+
+webvtt_cue *
+  webvtt_track_sync(webvtt_track *track)
+{
+  unsigned i;
+
+  if (track->count == 0)
+    return NULL;
+  for (i = 0; i < track->count; i++) {
+    track->cues[i]->start = track->start[i];
+    track->cues[i]->end = track->end[i];
+    track->cues[i]->next = i + 1 < track->count ? track->cues[i + 1] : NULL;
+  }
+  return track->cues[0];
+}
+
+void
+  webvtt_track_offset(webvtt_track *track, int64_t ticks)
+{
+  int64_t *start = track->start, *end = track->end;
+  unsigned i, n = track->count;
+
+  for (i = 0; i < n; i++)
+    start[i] += ticks;
+  for (i = 0; i < n; i++)
+    end[i] += ticks;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* multiply both columns by mul/div. when nothing can overflow this is a
+plain integer loop, otherwise each value goes through webvtt_rescale
+from one timebase to the other, which is the same ratio */
+static void scale_columns(webvtt_track *track, uint64_t mul, uint64_t div,
+                          webvtt_timebase from, webvtt_timebase to) {
+  int64_t *start = track->start, *end = track->end;
+  int64_t lo = 0, hi = 0, m, d, half;
+  unsigned i, n = track->count;
+  uint64_t g = gcd(mul, div);
+
+  if (g) {
+    mul /= g;
+    div /= g;
+  }
+  if (mul == div || n == 0)
+    return;
+
+  for (i = 0; i < n; i++) {
+    lo = start[i] < lo ? start[i] : lo;
+    hi = end[i] > hi ? end[i] : hi;
+  }
+  for (i = 0; i < n; i++) {
+    lo = end[i] < lo ? end[i] : lo;
+    hi = start[i] > hi ? start[i] : hi;
+  }
+
+  if (lo >= 0 && mul <= INT64_MAX && div <= INT64_MAX &&
+      (uint64_t)hi <= (INT64_MAX - div / 2) / mul) {
+    m = (int64_t)mul;
+    d = (int64_t)div;
+    half = d / 2;
+    for (i = 0; i < n; i++)
+      start[i] = (start[i] * m + half) / d;
+    for (i = 0; i < n; i++)
+      end[i] = (end[i] * m + half) / d;
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    start[i] = webvtt_rescale(start[i], from, to);
+    end[i] = webvtt_rescale(end[i], from, to);
+  }
+}
+
+int
+  webvtt_track_scale(webvtt_track *track, uint32_t num, uint32_t den)
+{
+  /* v * num / den is v rescaled from ticks of num s to ticks of den s */
+  webvtt_timebase from, to;
+
+  if (num == 0 || den == 0)
+    return -1;
+  from.num = num;
+  from.den = 1;
+  to.num = den;
+  to.den = 1;
+  scale_columns(track, num, den, from, to);
+  return 0;
+}
+
+int
+  webvtt_track_rescale(webvtt_track *track, webvtt_timebase timebase)
+{
+  if (timebase.num == 0 || timebase.den == 0)
+    return -1;
+  scale_columns(track, (uint64_t)track->timebase.num * timebase.den,
+                (uint64_t)track->timebase.den * timebase.num,
+                track->timebase, timebase);
+  track->timebase = timebase;
+  return 0;
+}
+
+unsigned
+  webvtt_track_clamp(webvtt_track *track, int64_t lo, int64_t hi)
+{
+  int64_t *start = track->start, *end = track->end;
+  unsigned i, kept, n = track->count;
+
+  for (i = 0; i < n; i++)
+    start[i] = start[i] < lo ? lo : start[i];
+  for (i = 0; i < n; i++)
+    end[i] = end[i] > hi ? hi : end[i];
+
+  /* compact in place, keeping the order */
+  for (i = kept = 0; i < n; i++) {
+    if (start[i] >= end[i]) {
+      webvtt_cue_free(track->cues[i]);
+      continue;
+    }
+    start[kept] = start[i];
+    end[kept] = end[i];
+    track->cues[kept] = track->cues[i];
+    kept++;
+  }
+  track->count = kept;
+  return n - kept;
+}
@@ -0,0 +1,77 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_TRACK_H_
+#define _WEBVTT_TRACK_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+
+  /* a parsed track as an array of cues. the timings are kept in their
+  own contiguous columns so that retiming a whole track is a couple of
+  straight loops the compiler can vectorize; start[i] and end[i] are the
+  authoritative timings of cues[i] until webvtt_track_sync is called.
+  the track owns its cues, the header their regions refer to and the
+  atom table their ids, settings and names were interned in */
+  typedef struct webvtt_track webvtt_track;
+  struct webvtt_track {
+    unsigned count, capacity;
+    int64_t *start;
+    int64_t *end;
+    webvtt_cue **cues;
+    webvtt_timebase timebase;
+    webvtt_header *header;  /** owned, may be NULL */
+    webvtt_atoms *atoms;    /** owned, may be NULL */
+  };
+
+  /* an empty track. returns NULL when out of memory or when num or den
+  of timebase is 0 */
+  webvtt_track *webvtt_track_new(webvtt_timebase timebase);
+
+  /* release a track, all of its cues, its header and its atom table */
+  void webvtt_track_free(webvtt_track *track);
+
+  /* append a cue, the track takes ownership. returns -1 when out of
+  memory, the cue is left to the caller then */
+  int webvtt_track_append(webvtt_track *track, webvtt_cue *cue);
+
+  /* build a track from a parsed cue list, taking ownership of the cues.
+  returns NULL when out of memory or for a timebase with a 0 part, the
+  list is untouched then */
+  webvtt_track *webvtt_track_from_cues(webvtt_cue *head,
+                                       webvtt_timebase timebase);
+
+  /* write the timing columns back into the cues and relink them in
+  track order. returns the first cue, which stays owned by the track */
+  webvtt_cue *webvtt_track_sync(webvtt_track *track);
+
+  /* shift every cue by ticks */
+  void webvtt_track_offset(webvtt_track *track, int64_t ticks);
+
+  /* multiply every timestamp by num/den, rounding to the nearest tick.
+  23.976 fps material conformed to 25 fps is num 960, den 1001. returns
+  -1, leaving the track as it was, when num or den is 0 */
+  int webvtt_track_scale(webvtt_track *track, uint32_t num, uint32_t den);
+
+  /* move the track to another timebase. returns -1, leaving the track
+  as it was, when num or den of timebase is 0 */
+  int webvtt_track_rescale(webvtt_track *track, webvtt_timebase timebase);
+
+  /* clip every cue to [lo, hi) and drop cues left empty. returns how
+  many cues were dropped */
+  unsigned webvtt_track_clamp(webvtt_track *track, int64_t lo, int64_t hi);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_TRACK_H_ */
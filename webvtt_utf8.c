@@ -0,0 +1,226 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "webvtt_utf8.h"
+
+static const char replacement[] = "\xef\xbf\xbd";
+
+enum webvtt_encoding
+  webvtt_detect_encoding(const char *s, size_t length)
+{
+  if (length >= 2 && (unsigned char)s[0] == 0xff && (unsigned char)s[1] == 0xfe)
+    return WEBVTT_ENCODING_UTF16LE;
+  if (length >= 2 && (unsigned char)s[0] == 0xfe && (unsigned char)s[1] == 0xff)
+    return WEBVTT_ENCODING_UTF16BE;
+  return WEBVTT_ENCODING_UTF8;
+}
+
+/* bytes from s on below 0x80 */
+static size_t ascii_prefix(const unsigned char *s, size_t length) {
+  size_t i = 0;
+#ifdef __SSE2__
+  int mask;
+
+  for (; i + 16 <= length; i += 16) {
+    mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#else
+  uint64_t x;
+
+  for (; i + 8 <= length; i += 8) {
+    memcpy(&x, s + i, 8);
+    if (x & 0x8080808080808080ULL)
+      break;
+  }
+#endif
+  while (i < length && s[i] < 0x80)
+    i++;
+  return i;
+}
+
+/* the length of the well formed sequence at s, or minus the length of
+the ill formed one, i.e. of the longest start of a sequence that could
+still have become well formed */
+static int sequence_length(const unsigned char *s, size_t length) {
+  unsigned char c = s[0], lo = 0x80, hi = 0xbf;
+  int need, i;
+
+  if (c < 0x80)
+    return 1;
+  if (c >= 0xc2 && c <= 0xdf) {
+    need = 1;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    need = 2;
+    if (c == 0xe0)
+      lo = 0xa0;          /* overlong */
+    else if (c == 0xed)
+      hi = 0x9f;          /* surrogates */
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    need = 3;
+    if (c == 0xf0)
+      lo = 0x90;          /* overlong */
+    else if (c == 0xf4)
+      hi = 0x8f;          /* past U+10FFFF */
+  } else {
+    return -1;
+  }
+  for (i = 1; i <= need; i++) {
+    if ((size_t)i >= length || s[i] < lo || s[i] > hi)
+      return -i;
+    lo = 0x80;
+    hi = 0xbf;
+  }
+  return need + 1;
+}
+
+size_t
+  webvtt_utf8_valid(const char *s, size_t length)
+{
+  const unsigned char *u = (const unsigned char*)s;
+  size_t i = 0;
+  int n;
+
+  for (;;) {
+    i += ascii_prefix(u + i, length - i);
+    while (i < length && u[i] >= 0x80) {
+      n = sequence_length(u + i, length - i);
+      if (n < 0)
+        return i;
+      i += n;
+    }
+    if (i == length)
+      return i;
+  }
+}
+
+int
+  webvtt_utf8_repair(const char *s, size_t length, webvtt_buffer *out)
+{
+  const unsigned char *u = (const unsigned char*)s;
+  size_t i = 0, valid;
+  char *p;
+  int n;
+
+  /* every bad byte can grow into three */
+  if (webvtt_buffer_reserve(out, 3 * length) < 0)
+    return -1;
+  p = out->data + out->length;
+  while (i < length) {
+    valid = webvtt_utf8_valid(s + i, length - i);
+    memcpy(p, s + i, valid);
+    p += valid;
+    i += valid;
+    if (i == length)
+      break;
+    n = sequence_length(u + i, length - i);
+    memcpy(p, replacement, 3);
+    p += 3;
+    i += -n;
+  }
+  out->length = p - out->data;
+  return 0;
+}
+
+static char *put_utf8(char *p, uint32_t c) {
+  if (c < 0x80) {
+    *p++ = (char)c;
+  } else if (c < 0x800) {
+    *p++ = (char)(0xc0 | c >> 6);
+    *p++ = (char)(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    *p++ = (char)(0xe0 | c >> 12);
+    *p++ = (char)(0x80 | (c >> 6 & 0x3f));
+    *p++ = (char)(0x80 | (c & 0x3f));
+  } else {
+    *p++ = (char)(0xf0 | c >> 18);
+    *p++ = (char)(0x80 | (c >> 12 & 0x3f));
+    *p++ = (char)(0x80 | (c >> 6 & 0x3f));
+    *p++ = (char)(0x80 | (c & 0x3f));
+  }
+  return p;
+}
+
+static uint32_t unit_at(const unsigned char *s, int big_endian) {
+  return big_endian ? (uint32_t)s[0] << 8 | s[1] : (uint32_t)s[1] << 8 | s[0];
+}
+
+int
+  webvtt_utf16_to_utf8(const char *s, size_t length, int big_endian,
+                       webvtt_buffer *out)
+{
+  const unsigned char *u = (const unsigned char*)s;
+  size_t i = 0;
+  uint32_t c, next;
+  char *p;
+#ifdef __SSE2__
+  const __m128i high = _mm_set1_epi16((short)0xff80);
+  __m128i v;
+#endif
+
+  /* a unit takes at most three bytes, a pair of them four */
+  if (webvtt_buffer_reserve(out, length / 2 * 3 + 3) < 0)
+    return -1;
+  p = out->data + out->length;
+  while (i + 2 <= length) {
+#ifdef __SSE2__
+    /* eight ASCII units at a time, narrowed with a saturating pack */
+    while (i + 16 <= length) {
+      v = _mm_loadu_si128((const __m128i*)(u + i));
+      if (big_endian)
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high),
+                                            _mm_setzero_si128())) != 0xffff)
+        break;
+      _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(v, v));
+      p += 8;
+      i += 16;
+    }
+    if (i + 2 > length)
+      break;
+#endif
+    c = unit_at(u + i, big_endian);
+    i += 2;
+    if (c >= 0xd800 && c <= 0xdbff && i + 2 <= length &&
+        (next = unit_at(u + i, big_endian)) >= 0xdc00 && next <= 0xdfff) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (next - 0xdc00);
+      i += 2;
+    } else if (c >= 0xd800 && c <= 0xdfff) {
+      c = 0xfffd;
+    }
+    p = put_utf8(p, c);
+  }
+  if (i < length)
+    p = put_utf8(p, 0xfffd);
+  out->length = p - out->data;
+  return 0;
+}
+
+int
+  webvtt_to_utf8(const char *s, size_t length, webvtt_buffer *out)
+{
+  switch (webvtt_detect_encoding(s, length)) {
+  case WEBVTT_ENCODING_UTF16LE:
+    return webvtt_utf16_to_utf8(s + 2, length - 2, 0, out) < 0 ? -1 : 1;
+  case WEBVTT_ENCODING_UTF16BE:
+    return webvtt_utf16_to_utf8(s + 2, length - 2, 1, out) < 0 ? -1 : 1;
+  default:
+    break;
+  }
+  if (webvtt_utf8_valid(s, length) == length)
+    return 0;
+  return webvtt_utf8_repair(s, length, out) < 0 ? -1 : 1;
+}
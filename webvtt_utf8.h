@@ -0,0 +1,55 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_UTF8_H_
+#define _WEBVTT_UTF8_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "webvtt_buffer.h"
+
+  /* the input stage: everything past it is well formed UTF-8. valid
+  input, the common case, is only scanned, ASCII a vector at a time */
+
+  enum webvtt_encoding {
+    WEBVTT_ENCODING_UTF8 = 0,
+    WEBVTT_ENCODING_UTF16LE,
+    WEBVTT_ENCODING_UTF16BE
+  };
+
+  /* from the byte order mark, UTF-8 when there is none */
+  enum webvtt_encoding webvtt_detect_encoding(const char *s, size_t length);
+
+  /* how many bytes at the start of s are well formed UTF-8 */
+  size_t webvtt_utf8_valid(const char *s, size_t length);
+
+  /* append s to out with every ill formed sequence replaced by U+FFFD,
+  one per maximal subpart as browsers do. returns -1 when out of memory */
+  int webvtt_utf8_repair(const char *s, size_t length, webvtt_buffer *out);
+
+  /* append UTF-16 code units, without a byte order mark, to out as
+  UTF-8. unpaired surrogates and a trailing odd byte become U+FFFD.
+  returns -1 when out of memory */
+  int webvtt_utf16_to_utf8(const char *s, size_t length, int big_endian,
+                           webvtt_buffer *out);
+
+  /* returns 0 when s is UTF-8 without errors and can be used as it is,
+  1 when out was given the UTF-8 to use instead and -1 when out of
+  memory. a UTF-16 byte order mark is dropped, a UTF-8 one is kept */
+  int webvtt_to_utf8(const char *s, size_t length, webvtt_buffer *out);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_UTF8_H_ */
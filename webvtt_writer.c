@@ -0,0 +1,368 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "webvtt_writer.h"
+
+/* longest timing line: two 19 digit hour timestamps, the arrow, every
+setting, " region:" without the id and the newline */
+#define TIMING_MAX 192
+
+/* cues per writev() call, up to six iovecs each plus the header */
+#define WRITEV_BATCH 170
+
+static const char *align_names[] = {
+  "middle", "start", "end", "left", "right"
+};
+
+static const char *vertical_names[] = {
+  "", "rl", "lr"
+};
+
+static char *put_string(char *p, const char *s) {
+  while (*s)
+    *p++ = *s++;
+  return p;
+}
+
+static char *put_number(char *p, int64_t value, int width) {
+  char digits[20];
+  int n = 0;
+  uint64_t v;
+
+  if (value < 0) {
+    *p++ = '-';
+    v = -(uint64_t)value;
+  } else {
+    v = value;
+  }
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (width-- > n)
+    *p++ = '0';
+  while (n)
+    *p++ = digits[--n];
+  return p;
+}
+
+static char *put_two(char *p, int v) {
+  p[0] = '0' + v / 10;
+  p[1] = '0' + v % 10;
+  return p + 2;
+}
+
+/* hh:mm:ss.ttt, hours grow past two digits when needed */
+static char *put_timestamp(char *p, int64_t ticks, webvtt_timebase timebase) {
+  int64_t ms = webvtt_rescale(ticks, timebase, webvtt_timebase_ms);
+  int rest;
+
+  if (ms < 0)
+    ms = 0;
+  p = put_number(p, ms / 3600000, 2);
+  rest = (int)(ms % 3600000);
+  *p++ = ':';
+  p = put_two(p, rest / 60000);
+  rest %= 60000;
+  *p++ = ':';
+  p = put_two(p, rest / 1000);
+  rest %= 1000;
+  *p++ = '.';
+  *p++ = '0' + rest / 100;
+  return put_two(p, rest % 100);
+}
+
+/* the timing line with the settings that differ from the defaults,
+but for the region and the newline, which the caller adds */
+static char *put_timing(char *p, int64_t start, int64_t end,
+                        const webvtt_cue_view *view,
+                        webvtt_timebase timebase) {
+  p = put_timestamp(p, start, timebase);
+  p = put_string(p, " --> ");
+  p = put_timestamp(p, end, timebase);
+
+  if (view->vertical != WEBVTT_HORIZONTAL) {
+    p = put_string(p, " vertical:");
+    p = put_string(p, vertical_names[view->vertical]);
+  }
+  if (!view->lineAuto) {
+    p = put_string(p, " line:");
+    p = put_number(p, view->line, 1);
+    if (!view->snapToLine)
+      *p++ = '%';
+  }
+  if (view->position != 50) {
+    p = put_string(p, " position:");
+    p = put_number(p, view->position, 1);
+    *p++ = '%';
+  }
+  if (view->size != 100) {
+    p = put_string(p, " size:");
+    p = put_number(p, view->size, 1);
+    *p++ = '%';
+  }
+  if (view->align != WEBVTT_ALIGN_MIDDLE) {
+    p = put_string(p, " align:");
+    p = put_string(p, align_names[view->align]);
+  }
+  return p;
+}
+
+/* a REGION block with the settings that differ from the defaults */
+static int write_region(webvtt_buffer *out, const webvtt_header *header,
+                        const webvtt_region *region) {
+  char line[128], *p = line;
+  unsigned length;
+  const char *id = webvtt_atom_string(header->atoms, region->id, &length);
+
+  if (webvtt_buffer_append(out, "REGION\nid:", 10) < 0 ||
+      webvtt_buffer_append(out, id, length) < 0)
+    return -1;
+  if (region->width != 100) {
+    p = put_string(p, "\nwidth:");
+    p = put_number(p, region->width, 1);
+    *p++ = '%';
+  }
+  if (region->lines != 3) {
+    p = put_string(p, "\nlines:");
+    p = put_number(p, region->lines, 1);
+  }
+  if (region->region_anchor_x != 0 || region->region_anchor_y != 100) {
+    p = put_string(p, "\nregionanchor:");
+    p = put_number(p, region->region_anchor_x, 1);
+    p = put_string(p, "%,");
+    p = put_number(p, region->region_anchor_y, 1);
+    *p++ = '%';
+  }
+  if (region->viewport_anchor_x != 0 || region->viewport_anchor_y != 100) {
+    p = put_string(p, "\nviewportanchor:");
+    p = put_number(p, region->viewport_anchor_x, 1);
+    p = put_string(p, "%,");
+    p = put_number(p, region->viewport_anchor_y, 1);
+    *p++ = '%';
+  }
+  if (region->scroll == WEBVTT_SCROLL_UP)
+    p = put_string(p, "\nscroll:up");
+  p = put_string(p, "\n\n");
+  return webvtt_buffer_append(out, line, p - line);
+}
+
+int
+  webvtt_write_header_blocks(webvtt_buffer *out, const webvtt_header *header)
+{
+  unsigned i;
+
+  if (header == NULL)
+    return 0;
+  for (i = 0; i < header->region_count; i++) {
+    if (write_region(out, header, header->regions + i) < 0)
+      return -1;
+  }
+  for (i = 0; i < header->style_count; i++) {
+    if (webvtt_buffer_append(out, "STYLE\n", 6) < 0 ||
+        webvtt_buffer_append(out, header->styles[i].text,
+                             header->styles[i].length) < 0 ||
+        webvtt_buffer_append(out, "\n\n", 2) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+int
+  webvtt_write_header(webvtt_buffer *out, const webvtt_header *header)
+{
+  if (webvtt_buffer_append(out, "WEBVTT\n\n", 8) < 0)
+    return -1;
+  return webvtt_write_header_blocks(out, header);
+}
+
+static int write_block(webvtt_buffer *out, int64_t start, int64_t end,
+                       const webvtt_cue_view *view,
+                       webvtt_timebase timebase,
+                       const webvtt_header *header) {
+  const char *region;
+  unsigned region_length;
+  char *p;
+
+  if (webvtt_buffer_reserve(out, webvtt_write_view_size(view, header)) < 0)
+    return -1;
+  p = out->data + out->length;
+  if (view->cueID) {
+    memcpy(p, view->cueID, view->cueID_length);
+    p += view->cueID_length;
+    *p++ = '\n';
+  }
+  p = put_timing(p, start, end, view, timebase);
+  region = webvtt_header_region_id(header, view->region, &region_length);
+  if (region) {
+    p = put_string(p, " region:");
+    memcpy(p, region, region_length);
+    p += region_length;
+  }
+  *p++ = '\n';
+  memcpy(p, view->text, view->text_length);
+  p += view->text_length;
+  *p++ = '\n';
+  *p++ = '\n';
+  out->length = p - out->data;
+  return 0;
+}
+
+int
+  webvtt_write_view(webvtt_buffer *out, const webvtt_cue_view *view,
+                    webvtt_timebase timebase, const webvtt_header *header)
+{
+  return write_block(out, view->start, view->end, view, timebase, header);
+}
+
+size_t
+  webvtt_write_view_size(const webvtt_cue_view *view,
+                         const webvtt_header *header)
+{
+  unsigned region_length = 0;
+
+  if (webvtt_header_region_id(header, view->region, &region_length))
+    region_length += 8;
+  return view->cueID_length + view->text_length + region_length +
+    TIMING_MAX + 4;
+}
+
+int
+  webvtt_write_cue(webvtt_buffer *out, const webvtt_cue *cue,
+                   webvtt_timebase timebase, const webvtt_header *header)
+{
+  webvtt_cue_view view;
+  webvtt_cue_view_of(cue, &view);
+  return write_block(out, view.start, view.end, &view, timebase, header);
+}
+
+int
+  webvtt_write_cues(webvtt_buffer *out, const webvtt_cue *head,
+                    webvtt_timebase timebase, const webvtt_header *header)
+{
+  const webvtt_cue *cue;
+
+  if (webvtt_write_header(out, header) < 0)
+    return -1;
+  for (cue = head; cue != NULL; cue = cue->next) {
+    if (webvtt_write_cue(out, cue, timebase, header) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+int
+  webvtt_write_track(webvtt_buffer *out, const webvtt_track *track)
+{
+  webvtt_cue_view view;
+  unsigned i;
+
+  if (webvtt_write_header(out, track->header) < 0)
+    return -1;
+  for (i = 0; i < track->count; i++) {
+    webvtt_cue_view_of(track->cues[i], &view);
+    if (write_block(out, track->start[i], track->end[i], &view,
+                    track->timebase, track->header) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, int count) {
+  ssize_t n;
+
+  while (count > 0) {
+    n = writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+int
+  webvtt_writev_track(int fd, const webvtt_track *track)
+{
+  struct iovec iov[WRITEV_BATCH * 6 + 1];
+  char scratch[WRITEV_BATCH * (TIMING_MAX + 1)];
+  webvtt_cue_view view;
+  webvtt_buffer header;
+  const char *region;
+  unsigned region_length, i = 0;
+  int n = 0;
+  char *p;
+
+  webvtt_buffer_init(&header);
+  if (webvtt_write_header(&header, track->header) < 0) {
+    webvtt_buffer_free(&header);
+    return -1;
+  }
+  iov[n].iov_base = header.data;
+  iov[n++].iov_len = header.length;
+
+  while (i < track->count) {
+    p = scratch;
+    while (i < track->count && n + 6 <= WRITEV_BATCH * 6 + 1) {
+      webvtt_cue_view_of(track->cues[i], &view);
+      if (view.cueID) {
+        iov[n].iov_base = (void*)view.cueID;
+        iov[n++].iov_len = view.cueID_length;
+      }
+      iov[n].iov_base = p;
+      if (view.cueID)
+        *p++ = '\n';
+      p = put_timing(p, track->start[i], track->end[i], &view,
+                     track->timebase);
+      /* the region id is handed over from the header like the text */
+      region = webvtt_header_region_id(track->header, view.region,
+                                       &region_length);
+      if (region) {
+        p = put_string(p, " region:");
+        iov[n].iov_len = p - (char*)iov[n].iov_base;
+        n++;
+        iov[n].iov_base = (void*)region;
+        iov[n++].iov_len = region_length;
+        iov[n].iov_base = p;
+      }
+      *p++ = '\n';
+      iov[n].iov_len = p - (char*)iov[n].iov_base;
+      n++;
+      iov[n].iov_base = (void*)view.text;
+      iov[n++].iov_len = view.text_length;
+      iov[n].iov_base = (void*)"\n\n";
+      iov[n++].iov_len = 2;
+      i++;
+    }
+    if (writev_all(fd, iov, n) < 0) {
+      webvtt_buffer_free(&header);
+      return -1;
+    }
+    n = 0;
+  }
+  if (n && writev_all(fd, iov, n) < 0) {
+    webvtt_buffer_free(&header);
+    return -1;
+  }
+  webvtt_buffer_free(&header);
+  return 0;
+}
@@ -0,0 +1,66 @@
+/* WebVTT parser
+Copyright 2012 Mozilla Foundation
+
+This Source Code Form is subject to the terms of the Mozilla
+Public License, v. 2.0. If a copy of the MPL was not distributed
+with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef _WEBVTT_WRITER_H_
+#define _WEBVTT_WRITER_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "webvtt.h"
+#include "webvtt_buffer.h"
+#include "webvtt_track.h"
+
+  /* WebVTT output. cue blocks are rendered straight into a buffer:
+  the optional id line, the timing line with settings generated from
+  the typed fields (defaults are left out), the text and a blank line.
+  what is written parses back to the same cues. header is the one the
+  cues' regions index into; it may be NULL, and a region it does not
+  have is left out. all functions return 0 on success and -1 when out
+  of memory or on a write error */
+
+  /* the REGION blocks, then the STYLE blocks of header, nothing when
+  it is NULL */
+  int webvtt_write_header_blocks(webvtt_buffer *out,
+                                 const webvtt_header *header);
+
+  /* the signature line and the blank line after it, then the blocks
+  of header */
+  int webvtt_write_header(webvtt_buffer *out, const webvtt_header *header);
+
+  /* one cue block, timestamps in ticks of timebase */
+  int webvtt_write_view(webvtt_buffer *out, const webvtt_cue_view *view,
+                        webvtt_timebase timebase,
+                        const webvtt_header *header);
+
+  int webvtt_write_cue(webvtt_buffer *out, const webvtt_cue *cue,
+                       webvtt_timebase timebase, const webvtt_header *header);
+
+  /* upper bound of what webvtt_write_view appends for view */
+  size_t webvtt_write_view_size(const webvtt_cue_view *view,
+                                const webvtt_header *header);
+
+  /* a whole file from a cue list */
+  int webvtt_write_cues(webvtt_buffer *out, const webvtt_cue *head,
+                        webvtt_timebase timebase,
+                        const webvtt_header *header);
+
+  /* a whole file from a track, using its timing columns and header */
+  int webvtt_write_track(webvtt_buffer *out, const webvtt_track *track);
+
+  /* a whole file from a track with writev(). only the timing lines are
+  formatted, ids and text are handed to the kernel where they are */
+  int webvtt_writev_track(int fd, const webvtt_track *track);
+
+#if defined(__cplusplus)
+} /* close extern "C" */
+#endif
+
+#endif /* _WEBVTT_WRITER_H_ */